@@ -0,0 +1,51 @@
+/*************************************************************************
+Copyright (C), chernecoff@gmail.com, 2014-2015
+--------------------------------------------------------------------------
+History:
+
+- 16.10.2026   23:33 : Created by agent
+-------------------------------------------------------------------------
+Checksum of blowfish packets : XOR of little endian 32-bit words of
+encoded bytes, last word is padded by zeros. Same value as old byte by
+byte loop, so old clients and master servers check it too.
+On x86 words are XORed by 16 bytes with SSE2, other CPUs use scalar loop.
+*************************************************************************/
+
+#ifndef _Checksum_
+#define _Checksum_
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define CHECKSUM_SSE2
+#endif
+
+inline unsigned int PacketChecksum(const unsigned char* bytes, unsigned int size)
+{
+	unsigned int checksum = 0;
+	unsigned int i = 0;
+
+#ifdef CHECKSUM_SSE2
+	// x86 is little endian, so 4 lanes are packet words
+	__m128i acc = _mm_setzero_si128();
+	for(; i + 16 <= size; i += 16)
+		acc = _mm_xor_si128(acc, _mm_loadu_si128((const __m128i*)(bytes + i)));
+
+	acc = _mm_xor_si128(acc, _mm_srli_si128(acc, 8));
+	acc = _mm_xor_si128(acc, _mm_srli_si128(acc, 4));
+	checksum = (unsigned int)_mm_cvtsi128_si32(acc);
+#endif
+
+	for(; i + 4 <= size; i += 4)
+	{
+		checksum ^= (unsigned int)bytes[i] | ((unsigned int)bytes[i + 1] << 8) |
+			((unsigned int)bytes[i + 2] << 16) | ((unsigned int)bytes[i + 3] << 24);
+	}
+
+	// Tail shorter than word
+	for(unsigned int shift = 0; i < size; i++, shift += 8)
+		checksum ^= (unsigned int)bytes[i] << shift;
+
+	return checksum;
+}
+
+#endif
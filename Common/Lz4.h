@@ -0,0 +1,233 @@
+/*************************************************************************
+Copyright (C), chernecoff@gmail.com, 2014-2015
+--------------------------------------------------------------------------
+History:
+
+- 16.10.2026   23:31 : Created by agent
+-------------------------------------------------------------------------
+LZ4 block format, compatible with reference LZ4 block compressor.
+Block is list of sequences :
+token(literals length : 4 | match length - 4 : 4) | more literals length |
+literals | match offset(2) | more match length
+Length 15 in token is continued by bytes, 255 means next byte follows.
+Last sequence has only literals, last 5 bytes are always literals and
+last match starts at least 12 bytes before block end.
+Compressor is greedy single pass with 4K entries hash table, it is made
+for packets, not for best ratio. Decompressor checks every length and
+offset, so broken block never reads or writes out of buffers.
+*************************************************************************/
+
+#ifndef _Lz4_
+#define _Lz4_
+
+#include <string.h>
+
+#define LZ4_HASH_LOG 12
+#define LZ4_MIN_MATCH 4
+#define LZ4_LAST_LITERALS 5
+#define LZ4_MF_LIMIT 12
+#define LZ4_MAX_OFFSET 65535
+// Biggest decompressed size of one block byte : every 255 bytes of match length cost one byte
+#define LZ4_MAX_RATIO 255
+
+// Biggest compressed size of size bytes
+inline unsigned int Lz4Bound(unsigned int size)
+{
+	return size + size / 255 + 16;
+}
+
+inline unsigned int Lz4Read32(const unsigned char* p)
+{
+	unsigned int value;
+	memcpy(&value, p, 4);
+	return value;
+}
+
+inline unsigned int Lz4Hash(unsigned int value)
+{
+	return (value * 2654435761u) >> (32 - LZ4_HASH_LOG);
+}
+
+// Sequence with literals and match, match length is without LZ4_MIN_MATCH. No match if offset is 0
+inline bool Lz4WriteSequence(unsigned char*& op, unsigned char* oend, const unsigned char* literals, unsigned int literalsLength,
+	unsigned int offset, unsigned int matchLength)
+{
+	// Token, length bytes, literals, offset
+	unsigned int need = 1 + literalsLength / 255 + 1 + literalsLength + 2 + matchLength / 255 + 1;
+	if(need > (unsigned int)(oend - op))
+		return false;
+
+	unsigned char* token = op++;
+	*token = (unsigned char)((literalsLength >= 15 ? 15 : literalsLength) << 4);
+
+	if(literalsLength >= 15)
+	{
+		unsigned int length = literalsLength - 15;
+		for(; length >= 255; length -= 255)
+			*op++ = 255;
+		*op++ = (unsigned char)length;
+	}
+
+	memcpy(op, literals, literalsLength);
+	op += literalsLength;
+
+	if(offset == 0)
+		return true;
+
+	*op++ = (unsigned char)(offset & 0xFF);
+	*op++ = (unsigned char)(offset >> 8);
+
+	*token |= (unsigned char)(matchLength >= 15 ? 15 : matchLength);
+
+	if(matchLength >= 15)
+	{
+		unsigned int length = matchLength - 15;
+		for(; length >= 255; length -= 255)
+			*op++ = 255;
+		*op++ = (unsigned char)length;
+	}
+
+	return true;
+}
+
+// Returns compressed size, 0 if out is too small. Lz4Bound(size) bytes are always enough
+inline unsigned int Lz4Compress(const unsigned char* src, unsigned int size, unsigned char* dst, unsigned int capacity)
+{
+	const unsigned char* ip = src;
+	const unsigned char* anchor = src;
+	const unsigned char* iend = src + size;
+
+	unsigned char* op = dst;
+	unsigned char* oend = dst + capacity;
+
+	if(size > LZ4_MF_LIMIT)
+	{
+		const unsigned char* mflimit = iend - LZ4_MF_LIMIT;
+		const unsigned char* matchlimit = iend - LZ4_LAST_LITERALS;
+
+		// Position + 1 of last 4 bytes with this hash, 0 - empty
+		unsigned int table[1 << LZ4_HASH_LOG];
+		memset(table, 0, sizeof(table));
+
+		while(ip < mflimit)
+		{
+			unsigned int sequence = Lz4Read32(ip);
+			unsigned int hash = Lz4Hash(sequence);
+			unsigned int position = (unsigned int)(ip - src);
+			unsigned int ref = table[hash];
+			table[hash] = position + 1;
+
+			if(ref == 0 || position + 1 - ref > LZ4_MAX_OFFSET || Lz4Read32(src + ref - 1) != sequence)
+			{
+				ip++;
+				continue;
+			}
+
+			const unsigned char* match = src + ref - 1;
+
+			// Match can start before found position
+			while(ip > anchor && match > src && ip[-1] == match[-1])
+			{
+				ip--;
+				match--;
+			}
+
+			const unsigned char* end = ip + LZ4_MIN_MATCH;
+			const unsigned char* ref2 = match + LZ4_MIN_MATCH;
+			while(end < matchlimit && *end == *ref2)
+			{
+				end++;
+				ref2++;
+			}
+
+			if(!Lz4WriteSequence(op, oend, anchor, (unsigned int)(ip - anchor), (unsigned int)(ip - match), (unsigned int)(end - ip) - LZ4_MIN_MATCH))
+				return 0;
+
+			ip = end;
+			anchor = ip;
+
+			if(ip - 2 >= src && ip < mflimit)
+				table[Lz4Hash(Lz4Read32(ip - 2))] = (unsigned int)(ip - 2 - src) + 1;
+		}
+	}
+
+	// Last literals
+	if(!Lz4WriteSequence(op, oend, anchor, (unsigned int)(iend - anchor), 0, 0))
+		return 0;
+
+	return (unsigned int)(op - dst);
+}
+
+// Length bytes after token. False if block ends inside length
+inline bool Lz4ReadLength(const unsigned char*& ip, const unsigned char* iend, unsigned int& length)
+{
+	unsigned char c;
+	do
+	{
+		if(ip >= iend || length > 0x7FFFFFFF)
+			return false;
+
+		c = *ip++;
+		length += c;
+	}
+	while(c == 255);
+
+	return true;
+}
+
+// Returns decompressed size, 0 if block is broken or doesn't fit out
+inline unsigned int Lz4Decompress(const unsigned char* src, unsigned int size, unsigned char* dst, unsigned int capacity)
+{
+	const unsigned char* ip = src;
+	const unsigned char* iend = src + size;
+
+	unsigned char* op = dst;
+	unsigned char* oend = dst + capacity;
+
+	while(ip < iend)
+	{
+		unsigned int token = *ip++;
+
+		unsigned int literalsLength = token >> 4;
+		if(literalsLength == 15 && !Lz4ReadLength(ip, iend, literalsLength))
+			return 0;
+
+		if(literalsLength > (unsigned int)(iend - ip) || literalsLength > (unsigned int)(oend - op))
+			return 0;
+
+		memcpy(op, ip, literalsLength);
+		ip += literalsLength;
+		op += literalsLength;
+
+		// Last sequence has no match
+		if(ip == iend)
+			break;
+
+		if(iend - ip < 2)
+			return 0;
+
+		unsigned int offset = (unsigned int)ip[0] | ((unsigned int)ip[1] << 8);
+		ip += 2;
+
+		if(offset == 0 || offset > (unsigned int)(op - dst))
+			return 0;
+
+		unsigned int matchLength = token & 15;
+		if(matchLength == 15 && !Lz4ReadLength(ip, iend, matchLength))
+			return 0;
+
+		matchLength += LZ4_MIN_MATCH;
+		if(matchLength > (unsigned int)(oend - op))
+			return 0;
+
+		// Match can overlap bytes it makes, so it is copied by byte
+		const unsigned char* match = op - offset;
+		for(unsigned int i = 0; i < matchLength; i++)
+			op[i] = match[i];
+		op += matchLength;
+	}
+
+	return (unsigned int)(op - dst);
+}
+
+#endif
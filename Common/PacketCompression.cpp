@@ -0,0 +1,80 @@
+/*************************************************************************
+Copyright (C), chernecoff@gmail.com, 2014-2015
+--------------------------------------------------------------------------
+History:
+
+- 16.10.2026   23:31 : Created by agent
+-------------------------------------------------------------------------
+
+*************************************************************************/
+#include "StdAfx.h"
+#include "PacketCompression.h"
+#include "Packets/PacketChunks.h"
+#include "Packets/Packets.h"
+#include "Packets/PacketBuilder.h"
+#include "Packets/RSP.h"
+#include "Lz4.h"
+
+Packet* CPacketCompression::Compress(const unsigned char* message, unsigned int size, const char* version, bool bProtocolV2)
+{
+	if(message == NULL || size <= 2)
+		return NULL;
+
+	// Length header of message is not compressed, receiver makes new one
+	unsigned int bound = Lz4Bound(size - 2);
+	unsigned char* data = new unsigned char [bound];
+
+	unsigned int dataSize = Lz4Compress(message + 2, size - 2, data, bound);
+
+	// Compressed packet has 4 more fields, it must win more than them
+	if(dataSize == 0 || dataSize + 64 >= size)
+	{
+		delete[] data;
+		return NULL;
+	}
+
+	Packet* p = new Packet();
+	CPacketBuilder pb(p, dataSize + 64);
+
+	SchemaWriteHeader(pb, PACKET_COMPRESSED, version, bProtocolV2); // Packet type and version or opcode
+
+	pb.WriteUInt(size);                                          // Message size
+	pb.WriteUInt(dataSize);                                      // Data size
+	pb.WriteBytes(data, dataSize);                               // LZ4 block
+
+	SchemaWriteEnd(pb, bProtocolV2);                             // End block
+
+	pb.Finish();
+
+	delete[] data;
+	return p;
+}
+
+Packet* CPacketCompression::Decompress(Packet* p)
+{
+	unsigned int size = p->readUInt();                           // Message size
+	unsigned int dataSize = p->readUInt();                       // Data size
+
+	// Sizes are checked before anything is allocated : block can't make more than
+	// LZ4_MAX_RATIO bytes of each byte
+	if(size <= 2 || size > PACKET_MAX_MESSAGE_SIZE || dataSize == 0 || !p->canReadBytes(dataSize) ||
+		size - 2 > (unsigned long long)dataSize * LZ4_MAX_RATIO)
+		return NULL;
+
+	unsigned char* data = new unsigned char [dataSize];
+	p->readBytes(data, dataSize);
+
+	unsigned char* message = new unsigned char [size];
+	message[0] = (unsigned char)(size & 0xFF);
+	message[1] = (unsigned char)((size >> 8) & 0xFF);
+
+	// Block must fill message exactly
+	Packet* pMessage = NULL;
+	if(Lz4Decompress(data, dataSize, message + 2, size - 2) == size - 2)
+		pMessage = new Packet(message, size);
+
+	delete[] data;
+	delete[] message;
+
+	return pMessage;
+}
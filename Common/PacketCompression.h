@@ -0,0 +1,35 @@
+/*************************************************************************
+Copyright (C), chernecoff@gmail.com, 2014-2015
+--------------------------------------------------------------------------
+History:
+
+- 16.10.2026   23:31 : Created by agent
+-------------------------------------------------------------------------
+Big plain message (game servers list) can be sent compressed by LZ4
+when both sides accepted it by identification packets. Message is
+compressed before encoding, compressed packet bigger than
+PACKET_CHUNK_SIZE is split to chunks like any other message.
+Compressed : type | version | message size | data size | LZ4 block | end block
+Protocol v2 compressed : opcode | message size | data size | LZ4 block
+Shared by server and client, each project builds it against own Packet
+and RSP.h found by project include directory.
+*************************************************************************/
+
+#ifndef _PacketCompression_
+#define _PacketCompression_
+
+class Packet;
+
+class CPacketCompression
+{
+public:
+	// Compress plain message with length header to plain compressed packet,
+	// protocol v2 packet has opcode header. Returns NULL if message doesn't get smaller.
+	// Caller deletes packet
+	static Packet* Compress(const unsigned char* message, unsigned int size, const char* version, bool bProtocolV2);
+	// Decompress decoded compressed packet, header is already read.
+	// Returns message with length header, NULL if packet is broken. Caller deletes packet
+	static Packet* Decompress(Packet* p);
+};
+
+#endif
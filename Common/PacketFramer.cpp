@@ -0,0 +1,101 @@
+/*************************************************************************
+Copyright (C), chernecoff@gmail.com, 2014-2015
+--------------------------------------------------------------------------
+History:
+
+- 16.10.2026   22:58 : Created by agent
+-------------------------------------------------------------------------
+
+*************************************************************************/
+#include <stdlib.h>
+#include <string.h>
+#include "PacketFramer.h"
+
+CPacketFramer::CPacketFramer()
+{
+	bufferSize = FRAMER_BUFFER_SIZE;
+	buffer = (char*)malloc(bufferSize);
+	readPos = 0;
+	writePos = 0;
+	bBroken = false;
+}
+
+CPacketFramer::~CPacketFramer()
+{
+	free(buffer);
+}
+
+void CPacketFramer::Commit(int size)
+{
+	if(size > 0)
+		writePos += size;
+}
+
+bool CPacketFramer::NextPacket(char*& data, int& size)
+{
+	if(bBroken)
+		return false;
+
+	int available = writePos - readPos;
+	if(available < 2)
+		return false;
+
+	const unsigned char* header = (const unsigned char*)buffer + readPos;
+	int packetSize = header[0] | (header[1] << 8);
+
+	if(packetSize < FRAMER_MIN_PACKET_SIZE)
+	{
+		bBroken = true;
+		return false;
+	}
+
+	if(available < packetSize)
+		return false;
+
+	data = buffer + readPos;
+	size = packetSize;
+
+	readPos += packetSize;
+	return true;
+}
+
+bool CPacketFramer::Compact()
+{
+	if(bBroken)
+		return false;
+
+	int rest = writePos - readPos;
+
+	// Common case - whole buffer was read, nothing to move
+	if(rest > 0 && readPos > 0)
+		memmove(buffer, buffer + readPos, rest);
+
+	readPos = 0;
+	writePos = rest;
+
+	// Incomplete packet bigger than buffer
+	if(rest >= 2)
+	{
+		const unsigned char* header = (const unsigned char*)buffer;
+		int packetSize = header[0] | (header[1] << 8);
+
+		if(packetSize > bufferSize)
+		{
+			char* newBuffer = (char*)realloc(buffer, packetSize);
+			if(!newBuffer)
+				return false;
+
+			buffer = newBuffer;
+			bufferSize = packetSize;
+		}
+	}
+
+	return true;
+}
+
+void CPacketFramer::Reset()
+{
+	readPos = 0;
+	writePos = 0;
+	bBroken = false;
+}
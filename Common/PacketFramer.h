@@ -0,0 +1,49 @@
+/*************************************************************************
+Copyright (C), chernecoff@gmail.com, 2014-2015
+--------------------------------------------------------------------------
+History:
+
+- 16.10.2026   22:58 : Created by agent
+-------------------------------------------------------------------------
+Splits tcp stream to packets by 2-byte length header (offsets 0 and 1).
+One recv can hold many packets or only part of packet.
+*************************************************************************/
+
+#ifndef _PacketFramer_
+#define _PacketFramer_
+
+// Start size of receive buffer
+#define FRAMER_BUFFER_SIZE 2048
+// Length header + packet type
+#define FRAMER_MIN_PACKET_SIZE 6
+
+class CPacketFramer
+{
+public:
+	CPacketFramer();
+	~CPacketFramer();
+
+	// Free space for next recv
+	char* GetWritePtr() { return buffer + writePos; }
+	int   GetWriteSize() { return bufferSize - writePos; }
+
+	// Account bytes received to GetWritePtr()
+	void Commit(int size);
+
+	// Get next complete packet. Data points to framer buffer and valid until Compact()
+	bool NextPacket(char*& data, int& size);
+
+	// Keep incomplete packet for next recv. Returns false if stream is broken
+	bool Compact();
+
+	void Reset();
+
+private:
+	char* buffer;
+	int bufferSize;
+	int readPos;
+	int writePos;
+	bool bBroken;
+};
+
+#endif
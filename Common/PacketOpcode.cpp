@@ -0,0 +1,23 @@
+/*************************************************************************
+Copyright (C), chernecoff@gmail.com, 2014-2015
+--------------------------------------------------------------------------
+History:
+
+- 16.10.2026   23:15 : Created by agent
+-------------------------------------------------------------------------
+
+*************************************************************************/
+#include <string.h>
+#include "PacketOpcode.h"
+
+unsigned int CPacketOpcode::Wrap(const unsigned char* packet, unsigned int size, unsigned char* out)
+{
+	out[2] = PACKET_OPCODE_LEGACY;
+	memcpy(out + 3, packet + 2, size - 2);
+
+	unsigned int result = size + 1;
+	out[0] = (unsigned char)(result & 0xFF);
+	out[1] = (unsigned char)((result >> 8) & 0xFF);
+
+	return result;
+}
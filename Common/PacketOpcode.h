@@ -0,0 +1,32 @@
+/*************************************************************************
+Copyright (C), chernecoff@gmail.com, 2014-2015
+--------------------------------------------------------------------------
+History:
+
+- 16.10.2026   23:15 : Created by agent
+-------------------------------------------------------------------------
+Protocol v2 packet : length(2) | opcode(1) | fields
+Version is checked once by identification packets and integrity comes
+from blowfish checksum or AES-GCM tag, so v2 packets don't carry version
+string and end block. Opcode is packet type. Opcode 0 carries old packet
+as is : length(2) | 0 | type | version | fields | end block
+Senders write v2 packets directly (SchemaWritePacket in PacketSchema.h),
+packets with schema carry fields as varints and length prefixed strings,
+other packets keep old fields. Old packet without v2 copy is wrapped
+under opcode 0.
+*************************************************************************/
+
+#ifndef _PacketOpcode_
+#define _PacketOpcode_
+
+// Protocol v2 opcode of old packet carried as is
+#define PACKET_OPCODE_LEGACY 0
+
+class CPacketOpcode
+{
+public:
+	// Old plain packet under opcode 0. Out must have size + 1 bytes, returns v2 packet size
+	static unsigned int Wrap(const unsigned char* packet, unsigned int size, unsigned char* out);
+};
+
+#endif
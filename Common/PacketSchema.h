@@ -0,0 +1,473 @@
+/*************************************************************************
+Copyright (C), chernecoff@gmail.com, 2014-2015
+--------------------------------------------------------------------------
+History:
+
+- 16.10.2026   23:04 : Created by agent
+-------------------------------------------------------------------------
+Packet structures and their fields order, shared by master server,
+CryModule and tools. Every schema lists fields once, the same list is
+used to count exact size, to write and to read packet body. Visitors
+are templates, so writing to CPacketBuilder has no virtual calls.
+Included by RSP.h after EndBlock and SOCKET are defined.
+Protocol v2 packets carry same fields as varints and length prefixed
+strings, they are written and read by CSchemaVar visitors. Senders
+write v2 packets directly from message by SchemaWritePacket.
+*************************************************************************/
+
+#ifndef _PacketSchema_
+#define _PacketSchema_
+
+#include <string.h>
+#include "Varint.h"
+#include "PacketOpcode.h"
+
+// Chat message area. Global, private, system, etc. messages
+enum EChatMessageArea
+{
+	CHAT_MESSAGE_GLOBAL = 0,
+	CHAT_MESSAGE_PRIVATE,
+	CHAT_MESSAGE_SYSTEM,
+};
+
+// Chat message structure. Using for sending chat messages to client/master server
+struct SMessage
+{
+	const char* message;
+	EChatMessageArea area; // Global, private, system, etc.
+};
+
+// Request kinds. Protocol v2 sends id, old packets send request name
+enum ERequestId
+{
+	REQUEST_UNKNOWN = 0,
+	REQUEST_GET_SERVERS,           // Client : game servers list
+	REQUEST_GET_PLAYER,            // Client : account info
+	REQUEST_GET_MASTER_INFO,       // Client : master server info
+	REQUEST_REMOVE_GAME_SERVER,    // Master server : game server with id iParam is gone
+
+	REQUEST_COUNT,
+};
+
+// Name of request in old packets, NULL for unknown id
+inline const char* GetRequestName(ERequestId id)
+{
+	static const char* const names[REQUEST_COUNT] =
+	{
+		NULL,
+		"GetServers",
+		"GetPlayer",
+		"GetMasterInfo",
+		"RemoveGameServer",
+	};
+
+	return id > REQUEST_UNKNOWN && id < REQUEST_COUNT ? names[id] : NULL;
+}
+
+// Only for old packets, new code uses ids
+inline ERequestId GetRequestId(const char* name)
+{
+	if(name != NULL)
+	{
+		for(int i = REQUEST_UNKNOWN + 1; i < REQUEST_COUNT; i++)
+		{
+			if(!strcmp(name, GetRequestName((ERequestId)i)))
+				return (ERequestId)i;
+		}
+	}
+
+	return REQUEST_UNKNOWN;
+}
+
+// Request packet structure. Using for sending request to client/master server.
+// Readers set both id and name, name points to GetRequestName string
+struct SRequestPacket
+{
+	ERequestId id;
+	const char* request;
+	const char* sParam;
+	int iParam;
+};
+
+// Login packet structure. Using in login and register client!
+struct SLoginPacket
+{
+	const char* login;
+	const char* password;
+	const char* nickname;
+};
+
+// Game server structur. Using for sending game server info to client/master server.
+struct SGameServer
+{
+	SOCKET socket;
+	int id;
+	const char* ip;
+	int port;
+	const char* serverName;
+	int currentPlayers;
+	int maxPlayers;
+	const char* mapName;
+	const char* gameRules;
+};
+
+// Master server info structure
+struct SMasterServerInfo
+{
+	int playersOnline;
+	int gameServersOnline;
+};
+
+// Account info structure. Nickname is owned by sender
+struct SAccountInfo
+{
+	int playerId;
+	const char* nickname;
+	int xp;
+	int level;
+	int money;
+	int banStatus;
+};
+
+//////////////////////////////////////////////////////////////////////////
+// Schemas. Packet : type | version | fields | end block
+// Protocol v2 packet : opcode | fields
+//////////////////////////////////////////////////////////////////////////
+
+// Chat message : message | area
+struct SMessageSchema
+{
+	template <class V, class T> static void Fields(V& v, T& m)
+	{
+		v.String(m.message);
+		v.Enum(m.area);
+	}
+};
+
+// Request : request | string param | int param
+struct SRequestSchema
+{
+	template <class V, class T> static void Fields(V& v, T& m)
+	{
+		v.String(m.request);
+		v.String(m.sParam);
+		v.Int(m.iParam);
+	}
+};
+
+// Protocol v2 request : request id | string param | int param
+struct SRequestIdSchema
+{
+	template <class V, class T> static void Fields(V& v, T& m)
+	{
+		v.Enum(m.id);
+		v.String(m.sParam);
+		v.Int(m.iParam);
+	}
+};
+
+// Login : login | password
+struct SLoginSchema
+{
+	template <class V, class T> static void Fields(V& v, T& m)
+	{
+		v.String(m.login);
+		v.String(m.password);
+	}
+};
+
+// Registration : login | password | nickname
+struct SRegistrationSchema
+{
+	template <class V, class T> static void Fields(V& v, T& m)
+	{
+		v.String(m.login);
+		v.String(m.password);
+		v.String(m.nickname);
+	}
+};
+
+// Game server, alone and in game servers list. Socket is not sent
+struct SGameServerSchema
+{
+	template <class V, class T> static void Fields(V& v, T& m)
+	{
+		v.Int(m.id);
+		v.String(m.ip);
+		v.Int(m.port);
+		v.String(m.serverName);
+		v.Int(m.currentPlayers);
+		v.Int(m.maxPlayers);
+		v.String(m.mapName);
+		v.String(m.gameRules);
+	}
+};
+
+// Account : id | nickname | xp | level | money | ban status
+struct SAccountSchema
+{
+	template <class V, class T> static void Fields(V& v, T& m)
+	{
+		v.Int(m.playerId);
+		v.String(m.nickname);
+		v.Int(m.xp);
+		v.Int(m.level);
+		v.Int(m.money);
+		v.Int(m.banStatus);
+	}
+};
+
+// Master server info : players online | game servers online
+struct SMasterServerInfoSchema
+{
+	template <class V, class T> static void Fields(V& v, T& m)
+	{
+		v.Int(m.playersOnline);
+		v.Int(m.gameServersOnline);
+	}
+};
+
+//////////////////////////////////////////////////////////////////////////
+// Visitors
+//////////////////////////////////////////////////////////////////////////
+
+// Counts bytes of fields
+class CSchemaSize
+{
+public:
+	CSchemaSize() : size(0) {}
+
+	void Int(int)                      { size += 4; }
+	template <class E> void Enum(E)    { size += 4; }
+	// NULL string is not written
+	void String(const char* s)         { if(s) size += (unsigned int)strlen(s) + 1; }
+
+	unsigned int size;
+};
+
+// Counts bytes of protocol v2 fields. String longer than readers accept doesn't fit
+class CSchemaVarSize
+{
+public:
+	CSchemaVarSize() : size(0), bFits(true) {}
+
+	void Int(int i)                    { size += VarintSize(ZigZagEncode(i)); }
+	template <class E> void Enum(E e)  { size += VarintSize((unsigned int)e); }
+	void String(const char* s)
+	{
+		unsigned int length = s ? (unsigned int)strlen(s) : 0;
+		if(length > VARINT_MAX_STRING)
+			bFits = false;
+		size += VarintSize(length) + length + 1;
+	}
+
+	unsigned int size;
+	bool bFits;
+};
+
+// Writes fields to TOut with WriteInt and WriteString, like CPacketBuilder
+template <class TOut>
+class CSchemaWriter
+{
+public:
+	CSchemaWriter(TOut& o) : out(o) {}
+
+	void Int(int i)                    { out.WriteInt(i); }
+	template <class E> void Enum(E e)  { out.WriteInt((int)e); }
+	void String(const char* s)         { out.WriteString(s); }
+
+private:
+	CSchemaWriter& operator=(const CSchemaWriter&);
+	TOut& out;
+};
+
+// Reads fields from BasePacket or CPacketView. Strings are allocated by BasePacket::readString,
+// view strings point into packet buffer
+template <class TPacket>
+class CSchemaReader
+{
+public:
+	CSchemaReader(TPacket* pPacket) : p(pPacket) {}
+
+	void Int(int& i)                   { i = p->readInt(); }
+	template <class E> void Enum(E& e) { e = (E)p->readInt(); }
+	void String(const char*& s)        { s = p->readString(); }
+
+private:
+	TPacket* p;
+};
+
+// Protocol v2 fields to TOut with WriteVarUInt and WriteLString.
+// Numbers are zigzag varints, enums are plain varints
+template <class TOut>
+class CSchemaVarWriter
+{
+public:
+	CSchemaVarWriter(TOut& o) : out(o) {}
+
+	void Int(int i)                    { out.WriteVarUInt(ZigZagEncode(i)); }
+	template <class E> void Enum(E e)  { out.WriteVarUInt((unsigned int)e); }
+	void String(const char* s)         { out.WriteLString(s); }
+
+private:
+	CSchemaVarWriter& operator=(const CSchemaVarWriter&);
+	TOut& out;
+};
+
+// Protocol v2 fields from BasePacket or CPacketView, strings like CSchemaReader
+template <class TPacket>
+class CSchemaVarReader
+{
+public:
+	CSchemaVarReader(TPacket* pPacket) : p(pPacket) {}
+
+	void Int(int& i)                   { i = p->readVarInt(); }
+	template <class E> void Enum(E& e) { e = (E)p->readVarUInt(); }
+	void String(const char*& s)        { s = p->readLString(); }
+
+private:
+	TPacket* p;
+};
+
+// BasePacket as writer output, for modules without CPacketBuilder
+template <class TPacket>
+class CSchemaPacketOut
+{
+public:
+	CSchemaPacketOut(TPacket* pPacket) : p(pPacket) {}
+
+	void WriteInt(int i)               { p->writeInt(i); }
+	void WriteUChar(unsigned char c)   { p->writeUChar(c); }
+	void WriteString(const char* s)    { p->writeString(s); }
+
+private:
+	TPacket* p;
+};
+
+//////////////////////////////////////////////////////////////////////////
+// Schema functions. Example : SchemaWrite<SMessageSchema>(pb, message)
+//////////////////////////////////////////////////////////////////////////
+
+// Size of packet body
+template <class TSchema, class TMsg>
+inline unsigned int SchemaSize(const TMsg& m)
+{
+	CSchemaSize v;
+	TSchema::Fields(v, m);
+	return v.size;
+}
+
+// Full packet size : length header | type | version | body | end block
+template <class TSchema, class TMsg>
+inline unsigned int SchemaPacketSize(const char* version, const TMsg& m)
+{
+	return 2 + 4 + (unsigned int)strlen(version) + 1 + SchemaSize<TSchema>(m) + sizeof(EndBlock);
+}
+
+template <class TSchema, class TOut, class TMsg>
+inline void SchemaWrite(TOut& out, const TMsg& m)
+{
+	CSchemaWriter<TOut> v(out);
+	TSchema::Fields(v, m);
+}
+
+template <class TSchema, class TPacket, class TMsg>
+inline void SchemaRead(TPacket* p, TMsg& m)
+{
+	CSchemaReader<TPacket> v(p);
+	TSchema::Fields(v, m);
+}
+
+// Protocol v2 body
+template <class TSchema, class TOut, class TMsg>
+inline void SchemaVarWrite(TOut& out, const TMsg& m)
+{
+	CSchemaVarWriter<TOut> v(out);
+	TSchema::Fields(v, m);
+}
+
+// Old body or protocol v2 body with varint fields
+template <class TSchema, class TOut, class TMsg>
+inline void SchemaWrite(TOut& out, const TMsg& m, bool bVarFields)
+{
+	if(bVarFields)
+		SchemaVarWrite<TSchema>(out, m);
+	else
+		SchemaWrite<TSchema>(out, m);
+}
+
+// Protocol v2 body can be read back by receiver
+template <class TSchema, class TMsg>
+inline bool SchemaVarFits(const TMsg& m)
+{
+	CSchemaVarSize v;
+	TSchema::Fields(v, m);
+	return v.bFits;
+}
+
+// Old header : type | version, protocol v2 header : opcode
+template <class TOut>
+inline void SchemaWriteHeader(TOut& out, int type, const char* version, bool bProtocolV2)
+{
+	if(bProtocolV2)
+		out.WriteUChar((unsigned char)type);
+	else
+	{
+		out.WriteInt(type);
+		out.WriteString(version);
+	}
+}
+
+// Protocol v2 packet has no end block
+template <class TOut>
+inline void SchemaWriteEnd(TOut& out, bool bProtocolV2)
+{
+	if(!bProtocolV2)
+		out.WriteString(EndBlock);
+}
+
+// Full size of packet written by SchemaWritePacket
+template <class TSchema, class TMsg>
+inline unsigned int SchemaPacketSize(const char* version, const TMsg& m, bool bProtocolV2)
+{
+	if(!bProtocolV2)
+		return SchemaPacketSize<TSchema>(version, m);
+
+	CSchemaVarSize v;
+	TSchema::Fields(v, m);
+
+	return v.bFits ? 2 + 1 + v.size : 1 + SchemaPacketSize<TSchema>(version, m);
+}
+
+// Header, body and end block of packet. Protocol v2 packet which can't be read back
+// as v2 goes as old packet under opcode 0
+template <class TSchema, class TOut, class TMsg>
+inline void SchemaWritePacket(TOut& out, int type, const char* version, const TMsg& m, bool bProtocolV2)
+{
+	bool bVarFields = bProtocolV2 && SchemaVarFits<TSchema>(m);
+	if(bProtocolV2 && !bVarFields)
+		out.WriteUChar(PACKET_OPCODE_LEGACY);
+
+	SchemaWriteHeader(out, type, version, bVarFields);
+	SchemaWrite<TSchema>(out, m, bVarFields);
+	SchemaWriteEnd(out, bVarFields);
+}
+
+template <class TSchema, class TPacket, class TMsg>
+inline void SchemaVarRead(TPacket* p, TMsg& m)
+{
+	CSchemaVarReader<TPacket> v(p);
+	TSchema::Fields(v, m);
+}
+
+// Old body or protocol v2 body with varint fields
+template <class TSchema, class TPacket, class TMsg>
+inline void SchemaRead(TPacket* p, TMsg& m, bool bVarFields)
+{
+	if(bVarFields)
+		SchemaVarRead<TSchema>(p, m);
+	else
+		SchemaRead<TSchema>(p, m);
+}
+
+#endif
@@ -0,0 +1,157 @@
+/*************************************************************************
+Copyright (C), chernecoff@gmail.com, 2014-2015
+--------------------------------------------------------------------------
+History:
+
+- 16.10.2026   23:08 : Created by agent
+-------------------------------------------------------------------------
+Reader over decoded packet bytes without own copy. Fields are read
+straight from buffer, strings point into it and never go past packet
+end. View doesn't own buffer, so it and all strings read from it are
+valid only while packet is dispatched.
+Protocol v2 fields are read by ReadVarUInt, ReadVarInt and ReadLString.
+*************************************************************************/
+
+#ifndef _PacketView_
+#define _PacketView_
+
+#include <string.h>
+#include "Varint.h"
+
+// String inside packet buffer, without terminating zero in length
+struct SStringRef
+{
+	const char* data;
+	unsigned int length;
+};
+
+class CPacketView
+{
+public:
+	CPacketView() : data(NULL), size(0), pos(0), bError(true) {}
+	// Whole packet with length header, reading starts after header
+	CPacketView(const unsigned char* bytes, unsigned int length)
+		: data(bytes), size(length), pos(2), bError(bytes == NULL || length < 2) {}
+
+	bool ReadUInt(unsigned int& value)
+	{
+		if(!CanRead(4))
+			return Fail();
+
+		value = (unsigned int)data[pos] | ((unsigned int)data[pos + 1] << 8) |
+			((unsigned int)data[pos + 2] << 16) | ((unsigned int)data[pos + 3] << 24);
+		pos += 4;
+		return true;
+	}
+
+	bool ReadUChar(unsigned char& value)
+	{
+		if(!CanRead(1))
+			return Fail();
+
+		value = data[pos++];
+		return true;
+	}
+
+	bool ReadInt(int& value)
+	{
+		unsigned int u;
+		if(!ReadUInt(u))
+			return false;
+
+		value = (int)u;
+		return true;
+	}
+
+	// String must end with zero inside packet
+	bool ReadString(SStringRef& value)
+	{
+		if(bError || pos >= size)
+			return Fail();
+
+		const char* s = (const char*)data + pos;
+		const char* end = (const char*)memchr(s, 0, size - pos);
+		if(end == NULL)
+			return Fail();
+
+		value.data = s;
+		value.length = (unsigned int)(end - s);
+		pos += value.length + 1;
+		return true;
+	}
+
+	bool ReadVarUInt(unsigned int& value)
+	{
+		unsigned int count = bError ? 0 : VarintRead(data + pos, size - pos, value);
+		if(count == 0)
+			return Fail();
+
+		pos += count;
+		return true;
+	}
+
+	bool ReadVarInt(int& value)
+	{
+		unsigned int u;
+		if(!ReadVarUInt(u))
+			return false;
+
+		value = ZigZagDecode(u);
+		return true;
+	}
+
+	// Length prefixed string. Length is checked before payload is touched
+	bool ReadLString(SStringRef& value)
+	{
+		unsigned int length;
+		if(!ReadVarUInt(length))
+			return false;
+
+		if(length > VARINT_MAX_STRING || !CanRead(length + 1) || data[pos + length] != 0)
+			return Fail();
+
+		value.data = (const char*)data + pos;
+		value.length = length;
+		pos += length + 1;
+		return true;
+	}
+
+	bool ReadBytes(unsigned char* bytes, unsigned int count)
+	{
+		if(!CanRead(count))
+			return Fail();
+
+		memcpy(bytes, data + pos, count);
+		pos += count;
+		return true;
+	}
+
+	// BasePacket like readers, for schemas. Broken field gives 0 or NULL
+	unsigned char readUChar()     { unsigned char c = 0; ReadUChar(c); return c; }
+	int readInt()                 { int i = 0; ReadInt(i); return i; }
+	unsigned int readUInt()       { unsigned int i = 0; ReadUInt(i); return i; }
+	const char* readString()      { SStringRef s; return ReadString(s) ? s.data : NULL; }
+	int readVarInt()              { int i = 0; ReadVarInt(i); return i; }
+	unsigned int readVarUInt()    { unsigned int i = 0; ReadVarUInt(i); return i; }
+	const char* readLString()     { SStringRef s; return ReadLString(s) ? s.data : NULL; }
+	bool canReadBytes(unsigned int count) { return CanRead(count); }
+	bool readBytes(unsigned char* bytes, unsigned int count) { return ReadBytes(bytes, count); }
+
+	const unsigned char* GetData() { return data; }
+	unsigned int GetSize()         { return size; }
+	// Bytes left after fields read so far
+	unsigned int GetRemaining()    { return bError ? 0 : size - pos; }
+	// False after any field went past packet end
+	bool IsValid()                 { return !bError; }
+
+private:
+	bool CanRead(unsigned int count) { return !bError && count <= size - pos; }
+	bool Fail()                      { bError = true; return false; }
+
+	const unsigned char* data;
+	unsigned int size;
+	unsigned int pos;
+	bool bError;
+};
+
+#endif
@@ -0,0 +1,84 @@
+/*************************************************************************
+Copyright (C), chernecoff@gmail.com, 2014-2015
+--------------------------------------------------------------------------
+History:
+
+- 16.10.2026   23:20 : Created by agent
+-------------------------------------------------------------------------
+Variable length fields of protocol v2 packets.
+Varint is LEB128 : 7 bits in byte, low bits first, high bit set when
+next byte follows. Signed numbers are zigzag coded before, so small
+negative numbers are short too (0, -1, 1, -2 -> 0, 1, 2, 3).
+String is varint length | bytes | zero. Reader knows string size before
+payload, so it skips or rejects string without scanning it, and zero
+lets strings be used in place as C strings.
+*************************************************************************/
+
+#ifndef _Varint_
+#define _Varint_
+
+// 32 bit value takes 5 bytes at most
+#define VARINT_MAX_SIZE 5
+// Longest string accepted by readers
+#define VARINT_MAX_STRING (16 * 1024)
+
+inline unsigned int ZigZagEncode(int value)
+{
+	return ((unsigned int)value << 1) ^ (unsigned int)(value >> 31);
+}
+
+inline int ZigZagDecode(unsigned int value)
+{
+	return (int)(value >> 1) ^ -(int)(value & 1);
+}
+
+inline unsigned int VarintSize(unsigned int value)
+{
+	unsigned int size = 1;
+	while(value >= 0x80)
+	{
+		value >>= 7;
+		size++;
+	}
+	return size;
+}
+
+// Out must have VarintSize(value) bytes. Returns bytes written
+inline unsigned int VarintWrite(unsigned char* out, unsigned int value)
+{
+	unsigned int size = 0;
+	while(value >= 0x80)
+	{
+		out[size++] = (unsigned char)(value | 0x80);
+		value >>= 7;
+	}
+	out[size++] = (unsigned char)value;
+	return size;
+}
+
+// Returns bytes read, 0 if varint is cut by buffer end or doesn't fit 32 bits
+inline unsigned int VarintRead(const unsigned char* in, unsigned int available, unsigned int& value)
+{
+	unsigned int result = 0;
+
+	for(unsigned int i = 0; i < available && i < VARINT_MAX_SIZE; i++)
+	{
+		unsigned char c = in[i];
+
+		// Last byte has only 4 bits left
+		if(i == VARINT_MAX_SIZE - 1 && c > 0x0F)
+			return 0;
+
+		result |= (unsigned int)(c & 0x7F) << (7 * i);
+
+		if((c & 0x80) == 0)
+		{
+			value = result;
+			return i + 1;
+		}
+	}
+
+	return 0;
+}
+
+#endif
@@ -32,7 +32,6 @@ int CMasterServer::InitWinSock ()
 
 void CMasterServer::ClientThread(SOCKET ServerSocket)
 {
-	char *Buffer = new char [2048];
 	int size = 0;
 
 	gClientEnv->bConnected = true;
@@ -41,18 +40,43 @@ void CMasterServer::ClientThread(SOCKET ServerSocket)
 	SendGameServerInfo();
 #else
 	gClientEnv->pRsp->SendIdentificationPacket(sConnect);
+
+	// Master server switches to session key after our identification packet
+	if(gClientEnv->offeredCrypto == SESSION_CRYPTO_AES_GCM)
+		gClientEnv->pAeadKey = new CAesGcmKey(gClientEnv->offeredKey, false);
+	else if(gClientEnv->offeredCrypto == SESSION_CRYPTO_BLOWFISH)
+		gClientEnv->pSessionKey = new CBlowfishKey(gClientEnv->offeredKey, SESSION_KEY_SIZE);
+
+	// Same for protocol v2
+	gClientEnv->bProtocolV2 = gClientEnv->offeredProtocolV2;
 #endif
 
-	while(size != SOCKET_ERROR)
+	while(true)
 	{
-		if((size = recv (ServerSocket,Buffer,2048,NULL)) > 0)
+		// One recv can hold many packets or only part of one
+		SPacket frame;
+		while(framer.NextPacket(frame.data, frame.size))
 		{
+			// Framer buffer is reused by next recv, so read queue gets own copy
 			SPacket packet;
-			packet.data = Buffer;
-			packet.size = size;
+			packet.data = new char [frame.size];
+			packet.size = frame.size;
+			packet.addr = ServerSocket;
+			memcpy(packet.data, frame.data, frame.size);
 
 			gClientEnv->pPacketQueue->InsertPacketToRead(packet);
 		}
+
+		if(!framer.Compact())
+		{
+			gEnv->pLog->LogWarning(TITLE "Broken packet stream from master server!");
+			break;
+		}
+
+		if((size = recv (ServerSocket,framer.GetWritePtr(),framer.GetWriteSize(),NULL)) <= 0)
+			break;
+
+		framer.Commit(size);
 	}
 
 	gClientEnv->bConnected = false;
@@ -61,7 +85,6 @@ void CMasterServer::ClientThread(SOCKET ServerSocket)
 	args.AddArgument("@ms_connection_lost");
 	CMsEvents::GetInstance()->SendEvent(CMsEvents::eUIGE_Error, args);
 
-	delete[] Buffer;
 	WSACleanup();
 }
 
@@ -88,15 +111,56 @@ const char* CMasterServer::Connect()
 	else
 	{
 		int size = 0 ;
-		char *Buffer = new char [256];
+		SPacket Packet;
 
-		if((size = recv (sConnect,Buffer,256,NULL)) > 0)
+		framer.Reset();
+
+		// Identification packet always comes with default key
+		CBlowfishKey::InitStaticKeys(gEnv->pConsole->GetCVar("fn_master_server_securityKey")->GetString());
+
+		if(gClientEnv->pSessionKey != NULL)
 		{
-			SPacket Packet;
-			Packet.data = Buffer;
-			Packet.size = size;
+			gClientEnv->pSessionKey->Release();
+			gClientEnv->pSessionKey = NULL;
+		}
 
-			EPacketType PacketType = gClientEnv->pRsp->GetPacketType(Packet);
+		if(gClientEnv->pAeadKey != NULL)
+		{
+			gClientEnv->pAeadKey->Release();
+			gClientEnv->pAeadKey = NULL;
+		}
+
+		gClientEnv->offeredCrypto = SESSION_CRYPTO_NONE;
+		gClientEnv->offeredProtocolV2 = false;
+		gClientEnv->bProtocolV2 = false;
+		gClientEnv->offeredLz4 = false;
+
+		// Wait complete identification packet, rest of stream stays in framer for ClientThread
+		while(!framer.NextPacket(Packet.data, Packet.size))
+		{
+			if(!framer.Compact() || (size = recv (sConnect,framer.GetWritePtr(),framer.GetWriteSize(),NULL)) <= 0)
+			{
+				gEnv->pLog->LogWarning(TITLE "Connection refused!!!");
+				WSACleanup();
+				return "@ms_connection_refused";
+			}
+
+			framer.Commit(size);
+		}
+
+		{
+			SDecodedPacket Decoded;
+			EPacketType PacketType = (EPacketType)-1;
+
+			if(gClientEnv->pRsp->DecodePacket(Packet, Decoded))
+			{
+				PacketType = Decoded.type;
+
+				if(PacketType == PACKET_IDENTIFICATION)
+					gClientEnv->offeredCrypto = gClientEnv->pRsp->ReadIdentificationPacket(Decoded, gClientEnv->offeredKey, gClientEnv->publicKey, gClientEnv->offeredProtocolV2, gClientEnv->offeredLz4);
+
+				gClientEnv->pRsp->FreePacket(Decoded);
+			}
 
 			switch (PacketType)
 			{
@@ -118,8 +182,6 @@ const char* CMasterServer::Connect()
 				}
 			}
 		}
-
-		delete[] Buffer;
 	}
 
 	return "@ms_unknown_error";
@@ -216,14 +278,15 @@ void CMasterServer::SendGlobalChatMessage(const char* message)
 	gEnv->pLog->LogError(TITLE "Master server not connected!");
 }
 
-void CMasterServer::SendRequest(const char* request, const char* sParam, int iParam)
+void CMasterServer::SendRequest(ERequestId request, const char* sParam, int iParam)
 {
 	gEnv->pLog->Log(TITLE "CMasterServer::SendRequest()");
 
 	if(gClientEnv->bConnected)
 	{
 		SRequestPacket Request;
-		Request.request = request;
+		Request.id = request;
+		Request.request = GetRequestName(request);
 		Request.sParam = sParam;
 		Request.iParam = iParam;
 
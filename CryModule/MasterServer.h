@@ -28,7 +28,7 @@ public:
 
 	void SendGameServerInfo();
 	void SendGlobalChatMessage(const char* message);
-	void SendRequest(const char* request, const char* sParam, int iParam);
+	void SendRequest(ERequestId request, const char* sParam, int iParam);
 
 	int InitWinSock();
 
@@ -38,6 +38,8 @@ public:
 	
 private:
 	void ClientThread(SOCKET ServerSocket);
+
+	CPacketFramer framer;
 };
 
 #endif
\ No newline at end of file
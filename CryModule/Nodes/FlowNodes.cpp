@@ -540,7 +540,7 @@ namespace FNM
 
 						gClientEnv->pMasterServer->vServers.clear();
 
-						gClientEnv->pMasterServer->SendRequest("GetServers","",0);
+						gClientEnv->pMasterServer->SendRequest(REQUEST_GET_SERVERS,"",0);
 					}
 				}
 				break;
@@ -628,7 +628,7 @@ namespace FNM
 					if(IsPortActive(pActInfo, EIP_Get))
 					{
 						if(!strcmp(gClientEnv->masterPlayer.nickname.c_str(),"Unknown"))
-							gClientEnv->pMasterServer->SendRequest("GetPlayer","",0);
+							gClientEnv->pMasterServer->SendRequest(REQUEST_GET_PLAYER,"",0);
 						else
 						{
 							ActivateOutput(pActInfo,EOP_Nickname,string(gClientEnv->masterPlayer.nickname.c_str()));
@@ -638,7 +638,7 @@ namespace FNM
 						}
 
 						if(gClientEnv->serverInfo.playersOnline == 0)
-							gClientEnv->pMasterServer->SendRequest("GetMasterInfo","",0);
+							gClientEnv->pMasterServer->SendRequest(REQUEST_GET_MASTER_INFO,"",0);
 						else
 						{
 							ActivateOutput(pActInfo,EOP_PlayersOnline,gClientEnv->serverInfo.playersOnline);
@@ -0,0 +1,148 @@
+/*************************************************************************
+Copyright (C), chernecoff@gmail.com, 2014-2015
+-------------------------------------------------------------------------
+History:
+
+- 16.10.2026   22:54 : Created by agent
+-------------------------------------------------------------------------
+
+*************************************************************************/
+#include "StdAfx.h"
+#include <memory>
+#include "AesGcmKey.h"
+#include "Packets.h"
+
+CAesGcmKey::CAesGcmKey(const unsigned char* key, bool bServer)
+{
+	// Key is expanded once, every packet sets only new iv
+	sealCtx = EVP_CIPHER_CTX_new();
+	EVP_EncryptInit_ex(sealCtx, EVP_aes_128_gcm(), NULL, NULL, NULL);
+	EVP_CIPHER_CTX_ctrl(sealCtx, EVP_CTRL_GCM_SET_IVLEN, AEAD_IV_SIZE, NULL);
+	EVP_EncryptInit_ex(sealCtx, NULL, NULL, key, NULL);
+
+	openCtx = EVP_CIPHER_CTX_new();
+	EVP_DecryptInit_ex(openCtx, EVP_aes_128_gcm(), NULL, NULL, NULL);
+	EVP_CIPHER_CTX_ctrl(openCtx, EVP_CTRL_GCM_SET_IVLEN, AEAD_IV_SIZE, NULL);
+	EVP_DecryptInit_ex(openCtx, NULL, NULL, key, NULL);
+
+	memcpy(sealSalt, bServer ? "MSRV" : "MCLI", 4);
+	memcpy(openSalt, bServer ? "MCLI" : "MSRV", 4);
+
+	sealSequence = 0;
+	openSequence = 0;
+
+	refCount = 1;
+}
+
+CAesGcmKey::~CAesGcmKey()
+{
+	EVP_CIPHER_CTX_free(sealCtx);
+	EVP_CIPHER_CTX_free(openCtx);
+}
+
+void CAesGcmKey::MakeIv(const unsigned char* salt, const unsigned char* sequence, unsigned char* iv)
+{
+	memcpy(iv, salt, 4);
+	memcpy(iv + 4, sequence, AEAD_SEQUENCE_SIZE);
+}
+
+bool CAesGcmKey::Seal(Packet* p)
+{
+	const unsigned char* plain = p->getBytesPtr();
+	int plainSize = (int)p->getPacketSize() - 2;
+
+	int size = 2 + AEAD_SEQUENCE_SIZE + plainSize + AEAD_TAG_SIZE;
+	if(plain == NULL || plainSize < 0 || size > 0xFFFF)
+		return false;
+
+	unsigned char* frame = new unsigned char [size];
+	frame[0] = (unsigned char)(size & 0xFF);
+	frame[1] = (unsigned char)((size >> 8) & 0xFF);
+
+	unsigned long long sequence = ++sealSequence;
+	for(int i = 0; i < AEAD_SEQUENCE_SIZE; i++)
+		frame[2 + i] = (unsigned char)((sequence >> (i * 8)) & 0xFF);
+
+	unsigned char iv[AEAD_IV_SIZE];
+	MakeIv(sealSalt, frame + 2, iv);
+
+	int length = 0;
+	unsigned char* data = frame + 2 + AEAD_SEQUENCE_SIZE;
+
+	bool result = EVP_EncryptInit_ex(sealCtx, NULL, NULL, NULL, iv) == 1 &&
+		EVP_EncryptUpdate(sealCtx, NULL, &length, frame, 2 + AEAD_SEQUENCE_SIZE) == 1 &&
+		EVP_EncryptUpdate(sealCtx, data, &length, plain + 2, plainSize) == 1 &&
+		EVP_EncryptFinal_ex(sealCtx, data + length, &length) == 1 &&
+		EVP_CIPHER_CTX_ctrl(sealCtx, EVP_CTRL_GCM_GET_TAG, AEAD_TAG_SIZE, frame + size - AEAD_TAG_SIZE) == 1;
+
+	if(result)
+		p->setBytes(frame, size);
+
+	delete[] frame;
+	return result;
+}
+
+bool CAesGcmKey::Open(Packet* p)
+{
+	const unsigned char* frame = p->getBytesPtr();
+	unsigned int size = p->getPacketSize();
+	unsigned int plainSize = 0;
+
+	if(frame == NULL)
+		return false;
+
+	unsigned char* bytes = new unsigned char [size];
+	memcpy(bytes, frame, size);
+
+	bool result = Open(bytes, size, plainSize);
+	if(result)
+		p->setBytes(bytes, plainSize);
+
+	delete[] bytes;
+	return result;
+}
+
+bool CAesGcmKey::Open(unsigned char* frame, unsigned int size, unsigned int& plainSize)
+{
+	if(frame == NULL || size < 2 + AEAD_SEQUENCE_SIZE + AEAD_TAG_SIZE)
+		return false;
+
+	int dataSize = (int)size - 2 - AEAD_SEQUENCE_SIZE - AEAD_TAG_SIZE;
+
+	unsigned long long sequence = 0;
+	for(int i = AEAD_SEQUENCE_SIZE - 1; i >= 0; i--)
+		sequence = (sequence << 8) | frame[2 + i];
+
+	// Replayed or reordered packet
+	if(sequence <= openSequence)
+		return false;
+
+	unsigned char iv[AEAD_IV_SIZE];
+	MakeIv(openSalt, frame + 2, iv);
+
+	unsigned char tag[AEAD_TAG_SIZE];
+	memcpy(tag, frame + size - AEAD_TAG_SIZE, AEAD_TAG_SIZE);
+
+	// GCM decrypts in place, data is moved after tag is checked
+	unsigned char* data = frame + 2 + AEAD_SEQUENCE_SIZE;
+	int length = 0;
+
+	bool result = EVP_DecryptInit_ex(openCtx, NULL, NULL, NULL, iv) == 1 &&
+		EVP_DecryptUpdate(openCtx, NULL, &length, frame, 2 + AEAD_SEQUENCE_SIZE) == 1 &&
+		EVP_DecryptUpdate(openCtx, data, &length, data, dataSize) == 1 &&
+		EVP_CIPHER_CTX_ctrl(openCtx, EVP_CTRL_GCM_SET_TAG, AEAD_TAG_SIZE, tag) == 1 &&
+		EVP_DecryptFinal_ex(openCtx, data + length, &length) == 1;
+
+	if(!result)
+		return false;
+
+	openSequence = sequence;
+
+	// Plain packet gets own length header
+	plainSize = (unsigned int)dataSize + 2;
+	memmove(frame + 2, data, dataSize);
+	frame[0] = (unsigned char)(plainSize & 0xFF);
+	frame[1] = (unsigned char)((plainSize >> 8) & 0xFF);
+
+	return true;
+}
@@ -0,0 +1,67 @@
+/*************************************************************************
+Copyright (C), chernecoff@gmail.com, 2014-2015
+-------------------------------------------------------------------------
+History:
+
+- 16.10.2026   22:54 : Created by agent
+-------------------------------------------------------------------------
+AES-128-GCM session key. Replaces blowfish, xor checksum and 8 zero
+bytes of old packets by authenticated encryption. OpenSSL uses AES-NI
+and PCLMULQDQ if cpu has them.
+Packet : length(2) | sequence(8) | encrypted data | tag(16)
+Length and sequence are authenticated too. Sequence must grow, so
+old packets can't be sent again. Key is made by CKeyExchange on both
+sides with own label, it is never sent.
+*************************************************************************/
+
+#ifndef _AesGcmKey_
+#define _AesGcmKey_
+
+#include <atomic>
+#include <openssl\evp.h>
+
+#define AEAD_SEQUENCE_SIZE 8
+#define AEAD_TAG_SIZE 16
+#define AEAD_IV_SIZE 12
+
+class Packet;
+
+class CAesGcmKey
+{
+public:
+	// Server and client seal packets with different iv, so same key is safe in both directions.
+	// Creator holds first reference
+	CAesGcmKey(const unsigned char* key, bool bServer);
+
+	void AddRef() { refCount++; }
+	void Release()
+	{
+		if(--refCount == 0)
+			delete this;
+	}
+
+	// Encrypt plain packet. Packets of one connection must be sealed one by one in sending order
+	bool Seal(Packet* p);
+	// Decrypt and check packet. Packets of one connection must be opened one by one
+	bool Open(Packet* p);
+	// Same in place. Plain packet with new length header is moved to buffer start
+	bool Open(unsigned char* frame, unsigned int size, unsigned int& plainSize);
+
+private:
+	~CAesGcmKey();
+
+	void MakeIv(const unsigned char* salt, const unsigned char* sequence, unsigned char* iv);
+
+	EVP_CIPHER_CTX* sealCtx;
+	EVP_CIPHER_CTX* openCtx;
+
+	unsigned char sealSalt[4];
+	unsigned char openSalt[4];
+
+	unsigned long long sealSequence;
+	unsigned long long openSequence;
+
+	std::atomic<int> refCount;
+};
+
+#endif
@@ -0,0 +1,52 @@
+/*************************************************************************
+Copyright (C), chernecoff@gmail.com, 2014-2015
+-------------------------------------------------------------------------
+History:
+
+- 16.10.2026   22:51 : Created by agent
+-------------------------------------------------------------------------
+
+*************************************************************************/
+#include "StdAfx.h"
+#include <memory>
+#include "BlowfishKey.h"
+
+CBlowfishKey* CBlowfishKey::pStaticKey = NULL;
+CBlowfishKey* CBlowfishKey::pDefaultKey = NULL;
+
+CBlowfishKey::CBlowfishKey(const unsigned char* key, unsigned int length)
+{
+	BF_set_key(&schedule, (int)length, key);
+	refCount = 1;
+}
+
+void CBlowfishKey::Decode(unsigned char* bytes, unsigned int size) const
+{
+	for(unsigned int offset = 2; offset + 8 <= size; offset += 8)
+	{
+		unsigned char data[8];
+		memcpy(data, bytes + offset, 8);
+		BF_decrypt((BF_LONG*)data, &schedule);
+		memcpy(bytes + offset, data, 8);
+	}
+}
+
+void CBlowfishKey::InitStaticKeys(const char* securityKey)
+{
+	// Built once, packets of other threads can use them
+	if(pStaticKey != NULL)
+		return;
+
+	// Key buffer is copied, settings buffer is reused by next GetConfigValue
+	unsigned char key[64];
+	memset(key, 0, sizeof(key));
+
+	if(securityKey != NULL)
+		memcpy(key, securityKey, strnlen(securityKey, sizeof(key)));
+
+	pStaticKey = new CBlowfishKey(key, sizeof(key));
+
+	// Old protocol used zero length key, so schedule is made only from first zero byte
+	memset(key, 0, sizeof(key));
+	pDefaultKey = new CBlowfishKey(key, 0);
+}
@@ -0,0 +1,57 @@
+/*************************************************************************
+Copyright (C), chernecoff@gmail.com, 2014-2015
+-------------------------------------------------------------------------
+History:
+
+- 16.10.2026   22:51 : Created by agent
+-------------------------------------------------------------------------
+Prepared blowfish key schedule. BF_set_key costs as much as encoding
+about 4 kb of data, so schedule is built once per key and shared
+by all packets using this key.
+*************************************************************************/
+
+#ifndef _BlowfishKey_
+#define _BlowfishKey_
+
+#include <atomic>
+#include <openssl\blowfish.h>
+
+// Session key length in bytes, key is made by CKeyExchange
+#define SESSION_KEY_SIZE 16
+
+class CBlowfishKey
+{
+public:
+	// Creator holds first reference
+	CBlowfishKey(const unsigned char* key, unsigned int length);
+
+	void AddRef() { refCount++; }
+	void Release()
+	{
+		if(--refCount == 0)
+			delete this;
+	}
+
+	const BF_KEY* Get() const { return &schedule; }
+
+	// Decode whole 8 byte blocks after length header in place. Tail is checksum and zero bytes
+	void Decode(unsigned char* bytes, unsigned int size) const;
+
+	// Shared schedules, built once on startup
+	static void InitStaticKeys(const char* securityKey);
+	// Key from securityKey setting
+	static CBlowfishKey* GetStaticKey() { return pStaticKey; }
+	// Empty key of old protocol, used when blowfish is off
+	static CBlowfishKey* GetDefaultKey() { return pDefaultKey; }
+
+private:
+	~CBlowfishKey() {}
+
+	BF_KEY schedule;
+	std::atomic<int> refCount;
+
+	static CBlowfishKey* pStaticKey;
+	static CBlowfishKey* pDefaultKey;
+};
+
+#endif
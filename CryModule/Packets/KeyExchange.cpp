@@ -0,0 +1,174 @@
+/*************************************************************************
+Copyright (C), chernecoff@gmail.com, 2014-2015
+-------------------------------------------------------------------------
+History:
+
+- 17.10.2026   00:24 : Created by agent
+-------------------------------------------------------------------------
+
+*************************************************************************/
+#include "StdAfx.h"
+#include <memory>
+#include <openssl\ec.h>
+#include <openssl\obj_mac.h>
+#include <openssl\sha.h>
+#include "KeyExchange.h"
+#include "BlowfishKey.h"
+
+static int HexDigit(char c)
+{
+	if(c >= '0' && c <= '9')
+		return c - '0';
+	if(c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if(c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+
+	return -1;
+}
+
+CKeyExchange::CKeyExchange()
+{
+	pKey = NULL;
+}
+
+CKeyExchange::~CKeyExchange()
+{
+	if(pKey != NULL)
+		EVP_PKEY_free(pKey);
+}
+
+bool CKeyExchange::Generate()
+{
+	EC_KEY* pEcKey = EC_KEY_new_by_curve_name(NID_X9_62_prime256v1);
+	if(pEcKey == NULL)
+		return false;
+
+	pKey = EVP_PKEY_new();
+
+	// Key pair belongs to pKey after assign
+	if(pKey == NULL || EC_KEY_generate_key(pEcKey) != 1 || EVP_PKEY_assign_EC_KEY(pKey, pEcKey) != 1)
+	{
+		EC_KEY_free(pEcKey);
+
+		if(pKey != NULL)
+			EVP_PKEY_free(pKey);
+		pKey = NULL;
+
+		return false;
+	}
+
+	return true;
+}
+
+bool CKeyExchange::GetPublicKey(char* hex)
+{
+	static const char digits[] = "0123456789abcdef";
+
+	if(pKey == NULL)
+		return false;
+
+	EC_KEY* pEcKey = EVP_PKEY_get1_EC_KEY(pKey);
+	if(pEcKey == NULL)
+		return false;
+
+	// Length is checked first, i2o doesn't know buffer size
+	unsigned char bytes[KEY_EXCHANGE_PUBLIC_SIZE];
+	unsigned char* pBytes = bytes;
+
+	bool result = i2o_ECPublicKey(pEcKey, NULL) == KEY_EXCHANGE_PUBLIC_SIZE &&
+		i2o_ECPublicKey(pEcKey, &pBytes) == KEY_EXCHANGE_PUBLIC_SIZE;
+
+	EC_KEY_free(pEcKey);
+
+	if(!result)
+		return false;
+
+	for(int i = 0; i < KEY_EXCHANGE_PUBLIC_SIZE; i++)
+	{
+		hex[i * 2] = digits[bytes[i] >> 4];
+		hex[i * 2 + 1] = digits[bytes[i] & 0x0F];
+	}
+
+	hex[KEY_EXCHANGE_PUBLIC_SIZE * 2] = '\0';
+
+	return true;
+}
+
+bool CKeyExchange::DeriveKey(const char* peerHex, const char* label, unsigned char* key)
+{
+	if(pKey == NULL || !IsPublicKey(peerHex))
+		return false;
+
+	unsigned char bytes[KEY_EXCHANGE_PUBLIC_SIZE];
+	for(int i = 0; i < KEY_EXCHANGE_PUBLIC_SIZE; i++)
+		bytes[i] = (unsigned char)((HexDigit(peerHex[i * 2]) << 4) | HexDigit(peerHex[i * 2 + 1]));
+
+	// Point not on curve is rejected by o2i
+	EC_KEY* pPeerEcKey = EC_KEY_new_by_curve_name(NID_X9_62_prime256v1);
+	const unsigned char* pBytes = bytes;
+
+	if(pPeerEcKey == NULL || o2i_ECPublicKey(&pPeerEcKey, &pBytes, sizeof(bytes)) == NULL)
+	{
+		if(pPeerEcKey != NULL)
+			EC_KEY_free(pPeerEcKey);
+
+		return false;
+	}
+
+	EVP_PKEY* pPeerKey = EVP_PKEY_new();
+	if(pPeerKey == NULL || EVP_PKEY_assign_EC_KEY(pPeerKey, pPeerEcKey) != 1)
+	{
+		EC_KEY_free(pPeerEcKey);
+
+		if(pPeerKey != NULL)
+			EVP_PKEY_free(pPeerKey);
+
+		return false;
+	}
+
+	unsigned char secret[64];
+	size_t secretSize = sizeof(secret);
+
+	EVP_PKEY_CTX* pCtx = EVP_PKEY_CTX_new(pKey, NULL);
+	bool result = pCtx != NULL &&
+		EVP_PKEY_derive_init(pCtx) == 1 &&
+		EVP_PKEY_derive_set_peer(pCtx, pPeerKey) == 1 &&
+		EVP_PKEY_derive(pCtx, secret, &secretSize) == 1;
+
+	if(pCtx != NULL)
+		EVP_PKEY_CTX_free(pCtx);
+	EVP_PKEY_free(pPeerKey);
+
+	if(!result)
+		return false;
+
+	// Raw secret is not uniform, key is hash of it
+	unsigned char hash[SHA256_DIGEST_LENGTH];
+	SHA256_CTX sha;
+	SHA256_Init(&sha);
+	SHA256_Update(&sha, secret, secretSize);
+	SHA256_Update(&sha, label, strlen(label));
+	SHA256_Final(hash, &sha);
+
+	memcpy(key, hash, SESSION_KEY_SIZE);
+
+	OPENSSL_cleanse(secret, sizeof(secret));
+	OPENSSL_cleanse(hash, sizeof(hash));
+
+	return true;
+}
+
+bool CKeyExchange::IsPublicKey(const char* hex)
+{
+	if(hex == NULL || strlen(hex) != KEY_EXCHANGE_PUBLIC_SIZE * 2)
+		return false;
+
+	for(int i = 0; i < KEY_EXCHANGE_PUBLIC_SIZE * 2; i++)
+	{
+		if(HexDigit(hex[i]) < 0)
+			return false;
+	}
+
+	return true;
+}
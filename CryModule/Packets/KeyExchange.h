@@ -0,0 +1,49 @@
+/*************************************************************************
+Copyright (C), chernecoff@gmail.com, 2014-2015
+-------------------------------------------------------------------------
+History:
+
+- 17.10.2026   00:24 : Created by agent
+-------------------------------------------------------------------------
+Ephemeral ECDH on P-256. Master server and client make new key pair for
+every connection and send only public keys in identification packets.
+Session key is SHA-256 of shared secret and key purpose, so it never
+travels on network. Public keys are not signed : exchange protects
+against listening, not against man in the middle.
+*************************************************************************/
+
+#ifndef _KeyExchange_
+#define _KeyExchange_
+
+#include <openssl\evp.h>
+
+// Uncompressed P-256 point
+#define KEY_EXCHANGE_PUBLIC_SIZE 65
+// Public key as hex string with terminating zero
+#define KEY_EXCHANGE_HEX_SIZE (KEY_EXCHANGE_PUBLIC_SIZE * 2 + 1)
+
+// Key purposes. One secret gives different key for every purpose
+#define KEY_LABEL_BLOWFISH "FireNET blowfish session key"
+#define KEY_LABEL_AES_GCM "FireNET AES-GCM session key"
+
+class CKeyExchange
+{
+public:
+	CKeyExchange();
+	~CKeyExchange();
+
+	// New key pair. False if OpenSSL failed
+	bool Generate();
+	// Own public key as hex string of KEY_EXCHANGE_HEX_SIZE bytes
+	bool GetPublicKey(char* hex);
+	// SESSION_KEY_SIZE bytes key from public key of other side. False if it is not valid point
+	bool DeriveKey(const char* peerHex, const char* label, unsigned char* key);
+
+	// String has length and digits of public key
+	static bool IsPublicKey(const char* hex);
+
+private:
+	EVP_PKEY* pKey;
+};
+
+#endif
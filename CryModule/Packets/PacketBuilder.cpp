@@ -0,0 +1,50 @@
+/*************************************************************************
+Copyright (C), chernecoff@gmail.com, 2014-2015
+-------------------------------------------------------------------------
+History:
+
+- 16.10.2026   23:00 : Created by agent
+-------------------------------------------------------------------------
+
+*************************************************************************/
+#include "StdAfx.h"
+#include "PacketBuilder.h"
+
+CPacketBuilder::CPacketBuilder(BasePacket* p, unsigned int reserve)
+{
+	pPacket = p;
+	pPacket->create();
+
+	buffer = pPacket->b.getBytesPtr();
+	size = 2;
+	capacity = pPacket->buffer_size;
+
+	if(reserve > capacity)
+		Grow(reserve);
+}
+
+bool CPacketBuilder::Grow(unsigned int needed)
+{
+	unsigned int newCapacity = capacity * 2;
+	if(newCapacity < needed)
+		newCapacity = needed;
+
+	if(!pPacket->b.setSize(newCapacity))
+		return false;
+
+	pPacket->buffer_size = newCapacity;
+	buffer = pPacket->b.getBytesPtr();
+	capacity = newCapacity;
+
+	return true;
+}
+
+void CPacketBuilder::Finish()
+{
+	pPacket->write_ptr = size;
+	pPacket->real_size = size;
+	pPacket->datasize = size - 2;
+
+	buffer[0] = (unsigned char)(size & 0xFF);
+	buffer[1] = (unsigned char)((size >> 8) & 0xFF);
+}
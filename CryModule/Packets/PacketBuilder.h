@@ -0,0 +1,75 @@
+/*************************************************************************
+Copyright (C), chernecoff@gmail.com, 2014-2015
+-------------------------------------------------------------------------
+History:
+
+- 16.10.2026   23:00 : Created by agent
+-------------------------------------------------------------------------
+Fast packet writer for send path. Writes body of packet directly to
+packet buffer without virtual calls, buffer is reserved once and
+length header is set once by Finish. Packet must not be used between
+builder creation and Finish. Writes protocol v2 fields too, so it is
+output of CSchemaVarWriter.
+*************************************************************************/
+
+#ifndef _PacketBuilder_
+#define _PacketBuilder_
+
+#include <string.h>
+#include "BasePacket.h"
+#include "../../Common/Varint.h"
+
+class CPacketBuilder
+{
+public:
+	// Starts packet with empty body. Reserve - expected full packet size
+	CPacketBuilder(BasePacket* p, unsigned int reserve = 256);
+
+	// Numbers are little endian like host, same as BasePacket writes them
+	void WriteInt(int i)                    { WriteRaw(&i, sizeof(int)); }
+	void WriteUInt(unsigned int i)          { WriteRaw(&i, sizeof(unsigned int)); }
+	void WriteUChar(unsigned char c)        { WriteRaw(&c, 1); }
+	// With terminating zero. NULL writes nothing, like BasePacket
+	void WriteString(const char* str)       { if(str) WriteRaw(str, (unsigned int)strlen(str) + 1); }
+	void WriteBytes(const unsigned char* bytes, unsigned int len) { if(bytes) WriteRaw(bytes, len); }
+
+	// Protocol v2 varint and length prefixed string, NULL string is written empty
+	void WriteVarUInt(unsigned int value)
+	{
+		unsigned char bytes[VARINT_MAX_SIZE];
+		WriteRaw(bytes, VarintWrite(bytes, value));
+	}
+
+	void WriteLString(const char* str)
+	{
+		unsigned int length = str ? (unsigned int)strlen(str) : 0;
+		WriteVarUInt(length);
+		WriteRaw(length ? str : "", length + 1);
+	}
+
+	// Make room for more bytes at once
+	void Reserve(unsigned int bytes)        { if(size + bytes > capacity) Grow(size + bytes); }
+
+	void WriteRaw(const void* bytes, unsigned int len)
+	{
+		if(size + len > capacity && !Grow(size + len))
+			return;
+
+		memcpy(buffer + size, bytes, len);
+		size += len;
+	}
+
+	// Set packet size and length header
+	void Finish();
+
+private:
+	bool Grow(unsigned int needed);
+
+private:
+	BasePacket* pPacket;
+	unsigned char* buffer;
+	unsigned int size;
+	unsigned int capacity;
+};
+
+#endif
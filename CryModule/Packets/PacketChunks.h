@@ -0,0 +1,59 @@
+/*************************************************************************
+Copyright (C), chernecoff@gmail.com, 2014-2015
+-------------------------------------------------------------------------
+History:
+
+- 16.10.2026   22:58 : Created by agent
+-------------------------------------------------------------------------
+Packet length header has only 2 bytes, so big message (full game
+servers list) is split to chunk packets. Every chunk is normal packet
+and is encoded alone, receiver puts chunks together in one buffer.
+Chunk : type | version | message size | offset | chunk size | bytes | end block
+Protocol v2 chunk : opcode | message size | offset | chunk size | bytes
+*************************************************************************/
+
+#ifndef _PacketChunks_
+#define _PacketChunks_
+
+#include <vector>
+
+// Bigger plain packets are sent as chunks
+#define PACKET_CHUNK_SIZE 16384
+// Biggest message client will put together (game servers list)
+#define PACKET_MAX_MESSAGE_SIZE (16 * 1024 * 1024)
+
+class Packet;
+class CPacketView;
+
+// Chunks of one connection. Chunks of one message come in order
+class CPacketChunks
+{
+public:
+	// Message bigger than maxSize is dropped by its first chunk, before buffer is made
+	CPacketChunks(unsigned int maxSize = PACKET_MAX_MESSAGE_SIZE);
+	~CPacketChunks();
+
+	// Split plain message to plain chunk packets, protocol v2 chunks have opcode header.
+	// Caller deletes chunks
+	static void Split(const unsigned char* message, unsigned int size, const char* version, bool bProtocolV2, std::vector <Packet*>& chunks);
+
+	// Add decoded chunk, header is already read. Returns whole message after last chunk, else NULL.
+	// Returned packet must be deleted by caller
+	Packet* Add(Packet* pChunk);
+	// Same for chunk view. Returns message buffer with length header, caller deletes it by delete[]
+	unsigned char* Add(CPacketView& chunk, unsigned int& size);
+
+	bool IsEmpty() { return buffer == NULL; }
+
+private:
+	void Reset();
+	// Checks chunk place in message and starts new message by first chunk. Drops message on error
+	bool Accept(unsigned int size, unsigned int offset, unsigned int chunkSize);
+
+	unsigned char* buffer;
+	unsigned int maxMessageSize;
+	unsigned int messageSize;
+	unsigned int received;
+};
+
+#endif
@@ -15,8 +15,20 @@ History:
 
 typedef UINT_PTR SOCKET;
 
+class Packet;
+
 // This define need for checking packet integrity
 #define EndBlock "END_BLOCK"
+// Both sides of identification send public key of CKeyExchange as hex block.
+// Client accepts blowfish session key made from it by this block
+#define SessionKeyBlock "SESSION_KEY"
+// Master server can use session key for AES-GCM, client accepts it by second block
+#define AeadBlock "AES_GCM"
+#define AeadKeyBlock "SESSION_KEY_AES_GCM"
+// Both sides of identification send it to use protocol v2 packets
+#define ProtocolV2Block "PROTOCOL_V2"
+// Both sides of identification send it to get big messages compressed by LZ4
+#define Lz4Block "LZ4"
 
 // Packet types
 enum EPacketType
@@ -32,53 +44,23 @@ enum EPacketType
 	PACKET_GAME_SERVERS,
 	PACKET_CONSOLE_TEXT,
 	PACKET_CONSOLE_COMMAND,
-};
-
-// Chat message area. Global, private, system, etc. messages
-enum EChatMessageArea
-{
-	CHAT_MESSAGE_GLOBAL = 0,
-	CHAT_MESSAGE_PRIVATE,
-	CHAT_MESSAGE_SYSTEM,
-};
 
-
-// Chat message structure. Using for sending chat messages to client/master server
-struct SMessage
-{
-	const char* message;
-	EChatMessageArea area; // Global, private, system, etc.
-};
-
-// Request packet structure. Using for sending request to client/master server.
-struct SRequestPacket
-{
-	const char* request;
-	const char* sParam;
-	int iParam;
+	// Part of big message. Same number in all modules
+	PACKET_CHUNK = 32,
+	// Big message compressed by LZ4
+	PACKET_COMPRESSED = 33,
 };
 
-// Login packet structure. Using in login and register client!
-struct SLoginPacket
+// Session encryption chosen by client in identification packet
+enum ESessionCrypto
 {
-	const char* login;
-	const char* password;
-	const char* nickname;
+	SESSION_CRYPTO_NONE = 0,        // Default key
+	SESSION_CRYPTO_BLOWFISH,        // Blowfish with session key
+	SESSION_CRYPTO_AES_GCM,         // AES-GCM with session key
 };
 
-// Game server structur. Using for sending game server info to client/master server.
-struct SGameServer
-{
-	SOCKET socket;
-	int id;
-	const char* ip;
-	int port;
-	const char* serverName;
-	int currentPlayers;
-	int maxPlayers;
-	char* mapName;
-	char* gameRules;
-};
+// Shared packet structures and schemas
+#include "../../Common/PacketSchema.h"
 
 // Player structure
 struct SPlayer
@@ -91,13 +73,6 @@ struct SPlayer
 	bool banStatus;
 };
 
-// Master server info structure
-struct SMasterServerInfo
-{
-	int playersOnline;
-	int gameServersOnline;
-};
-
 // Packet structurs
 struct SPacket
 {
@@ -106,6 +81,14 @@ struct SPacket
 	SOCKET addr;
 };
 
+// Decoded inbound packet. Decrypted and header checked once, typed readers continue after header
+struct SDecodedPacket
+{
+	EPacketType type;
+	bool bLegacy;                  // Old packet with version and end block
+	Packet* pPacket;
+};
+
 // Read/send packet class. Using for sendind/reading packets
 class CReadSendPacket
 {
@@ -117,6 +100,13 @@ public:
 	// Gets packet type
 	EPacketType GetPacketType (SPacket packet);
 
+	// Decrypt packet and check header. Decoded packet must be freed by FreePacket
+	bool DecodePacket(SPacket packet, SDecodedPacket& decoded);
+	// Check header of decrypted or put together packet, frees packet on error.
+	// Packets have opcode header after protocol v2 is accepted
+	bool DecodeHeader(SDecodedPacket& decoded);
+	void FreePacket(SDecodedPacket& decoded);
+
 
 	//   
 	// Sends identification packet
@@ -144,33 +134,39 @@ public:
 	/* Console helper */
 	void SendConsoleTextPacket(SOCKET Socket, int textType, const char* text);
 
-	void ReadConsoleCommandPacket(SPacket packet);
+	void ReadConsoleCommandPacket(SDecodedPacket& packet);
 	/*----------------*/
 
 	//   
-	// Read identification packet
-	void ReadIdentificationPacket (SPacket packet);
+	// Read identification packet. Returns best session encryption offered by master server
+	// and if master server supports protocol v2. Session key is made from public key of master server,
+	// own public key of KEY_EXCHANGE_HEX_SIZE bytes is sent back in identification packet
+	ESessionCrypto ReadIdentificationPacket (SDecodedPacket& packet, unsigned char* sessionKey, char* publicKey, bool& bProtocolV2, bool& bLz4);
 
 	//    
 	// Read message packet
-	SMessage ReadMsg(SPacket packet);
+	SMessage ReadMsg(SDecodedPacket& packet);
 
 	//      
 	// Read account information
-	SPlayer ReadAccountInfo(SPacket packet);
+	SPlayer ReadAccountInfo(SDecodedPacket& packet);
 
 	//    
 	// Read request
-	SRequestPacket ReadRequest(SPacket packet);
+	SRequestPacket ReadRequest(SDecodedPacket& packet);
 
 	//       
 	// Read game server info
-	SGameServer ReadGameServerInfo(SPacket packet);
+	SGameServer ReadGameServerInfo(SDecodedPacket& packet);
 
-	void ReadGameServers(SPacket packet);
+	void ReadGameServers(SDecodedPacket& packet);
 
 	// Read master server info
-	SMasterServerInfo ReadMasterServerInfo(SPacket packet);
+	SMasterServerInfo ReadMasterServerInfo(SDecodedPacket& packet);
+
+private:
+	// Old packets end with end block, protocol v2 relies on transport checksum
+	bool ReadEndBlock(SDecodedPacket& packet);
 };
 
 #endif
\ No newline at end of file
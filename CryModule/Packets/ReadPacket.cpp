@@ -13,55 +13,179 @@ History:
 
 #include "Packets.h"
 #include "PacketDebugger.h"
+#include "../../Common/PacketOpcode.h"
+#include "KeyExchange.h"
 #include "RSP.h"
 
 
-EPacketType CReadSendPacket::GetPacketType (SPacket packet)
+bool CReadSendPacket::DecodePacket(SPacket packet, SDecodedPacket& decoded)
 {
-	gEnv->pLog->Log( TITLE "Read a packet type...");
+	gEnv->pLog->Log( TITLE "Decode packet...");
+
+	decoded.pPacket = new Packet((const unsigned char*)packet.data, packet.size);
+
+	if(gClientEnv->pAeadKey != NULL)
+	{
+		if(!gClientEnv->pAeadKey->Open(decoded.pPacket))
+		{
+			gEnv->pLog->LogWarning(TITLE "Packet authentication failed! Ignoring...");
+			FreePacket(decoded);
+			return false;
+		}
+	}
+	else
+	{
+		// Checksum is made from encoded bytes
+		if(!decoded.pPacket->verifyChecksum())
+		{
+			gEnv->pLog->LogWarning(TITLE "Packet checksum failed! Ignoring...");
+			FreePacket(decoded);
+			return false;
+		}
+
+		decoded.pPacket->setDynamicBFKey(gClientEnv->pSessionKey);
+		decoded.pPacket->decodeBlowfish(gClientEnv->bBlowFish);
+	}
+
+	return DecodeHeader(decoded);
+}
 
-	Packet* p = new Packet((const unsigned char*)packet.data, packet.size);
-	p->decodeBlowfish(gClientEnv->bBlowFish);
+bool CReadSendPacket::DecodeHeader(SDecodedPacket& decoded)
+{
+	decoded.bLegacy = true;
+
+	// Protocol v2 header. Version was checked by identification packets
+	if(gClientEnv->bProtocolV2)
+	{
+		if(!decoded.pPacket->canReadBytes(1))
+		{
+			FreePacket(decoded);
+			return false;
+		}
 
-	/**************************** ************************************/
-	EPacketType type = (EPacketType)p->readInt();             // Packet type
-	const char* version        = p->readString();             // Packet version
-	/*********************************************************************************/
+		unsigned char opcode = decoded.pPacket->readUChar();
+
+		if(opcode != PACKET_OPCODE_LEGACY)
+		{
+			decoded.type = (EPacketType)opcode;
+			decoded.bLegacy = false;
+			return true;
+		}
+	}
+
+	// Packet header
+	decoded.type = (EPacketType)decoded.pPacket->readInt();   // Packet type
+	char* version = decoded.pPacket->readString();            // Packet version
+	//
 
 	if(version != NULL)
 	{
 		if(!strcmp(version , gClientEnv->clientVersion))
-			return type;
+		{
+			free(version);
+			return true;
+		}
 		else
 		{
 			gEnv->pLog->LogWarning(TITLE "Different packet versions! Ignoring...");
 			gEnv->pLog->Log(TITLE "Packet version = %s", version);
 			gEnv->pLog->Log(TITLE "Curent version = %s", gClientEnv->clientVersion);
 		}
+
+		free(version);
 	}
 
-	delete p;
-	return (EPacketType)-1;
+	FreePacket(decoded);
+	return false;
+}
+
+bool CReadSendPacket::ReadEndBlock(SDecodedPacket& packet)
+{
+	if(!packet.bLegacy)
+		return true;
+
+	char* endBlock = packet.pPacket->readString();            // End block
+	bool result = endBlock != NULL && !strcmp(endBlock, EndBlock);
+
+	free(endBlock);
+	return result;
+}
+
+void CReadSendPacket::FreePacket(SDecodedPacket& decoded)
+{
+	delete decoded.pPacket;
+	decoded.pPacket = NULL;
+}
+
+EPacketType CReadSendPacket::GetPacketType (SPacket packet)
+{
+	gEnv->pLog->Log( TITLE "Read a packet type...");
+
+	SDecodedPacket decoded;
+
+	if(!DecodePacket(packet, decoded))
+		return (EPacketType)-1;
+
+	EPacketType type = decoded.type;
+	FreePacket(decoded);
+
+	return type;
 }
 
-void CReadSendPacket::ReadIdentificationPacket (SPacket packet)
+ESessionCrypto CReadSendPacket::ReadIdentificationPacket (SDecodedPacket& packet, unsigned char* sessionKey, char* publicKey, bool& bProtocolV2, bool& bLz4)
 {
 	gEnv->pLog->Log(TITLE "Read identification packet...");
 
-	Packet* p = new Packet((const unsigned char*)packet.data, packet.size);
+	Packet* p = packet.pPacket;
+	ESessionCrypto crypto = SESSION_CRYPTO_NONE;
+	bProtocolV2 = false;
+	bLz4 = false;
+
+	char serverKey[KEY_EXCHANGE_HEX_SIZE];
 
-	p->decodeBlowfish(gClientEnv->bBlowFish);
+	// Old master servers send only end block
+	char* block = p->readString();                            // Public key, AES-GCM, protocol v2, LZ4 or end block
 
-	/**************************** ************************************/
-	EPacketType type = (EPacketType)p->readInt();             // Packet type
-	const char* version        = p->readString();             // Packet version
-	/*********************************************************************************/
+	while(block != NULL && strcmp(block,EndBlock))
+	{
+		if(!strcmp(block,AeadBlock))
+		{
+			if(crypto == SESSION_CRYPTO_BLOWFISH)
+				crypto = SESSION_CRYPTO_AES_GCM;
+		}
+		else if(!strcmp(block,ProtocolV2Block))
+			bProtocolV2 = true;
+		else if(!strcmp(block,Lz4Block))
+			bLz4 = true;
+		else if(crypto == SESSION_CRYPTO_NONE && CKeyExchange::IsPublicKey(block))
+		{
+			strcpy(serverKey, block);
+			crypto = SESSION_CRYPTO_BLOWFISH;
+		}
 
-	const char* endBlock = p->readString();                   //  
+		free(block);
+		block = p->readString();
+	}
 
-	if(strcmp(endBlock,EndBlock))
+	if(block == NULL)
 		gEnv->pLog->LogWarning(TITLE "Identification packet damaged!");
 
+	free(block);
+
+	// Own key pair is made for every connection
+	if(crypto != SESSION_CRYPTO_NONE)
+	{
+		CKeyExchange keyExchange;
+		const char* label = crypto == SESSION_CRYPTO_AES_GCM ? KEY_LABEL_AES_GCM : KEY_LABEL_BLOWFISH;
+
+		if(!keyExchange.Generate() || !keyExchange.GetPublicKey(publicKey) ||
+			!keyExchange.DeriveKey(serverKey, label, sessionKey))
+		{
+			gEnv->pLog->LogWarning(TITLE "Can't make session key, default key is used");
+			crypto = SESSION_CRYPTO_NONE;
+		}
+	}
+
 	if(gClientEnv->bDebugMode)
 	{
 		int size = p->getPacketSize();
@@ -71,30 +195,21 @@ void CReadSendPacket::ReadIdentificationPacket (SPacket packet)
 		
 		PacketDebugger::Debug(Packet, size, "ReceivedPacketsDebugg.txt");
 	}
-	delete p;
+
+	return crypto;
 }
 
-SMessage CReadSendPacket::ReadMsg(SPacket packet)
+SMessage CReadSendPacket::ReadMsg(SDecodedPacket& packet)
 {
 	SMessage message;
 
 	gEnv->pLog->Log(TITLE "Read message packet...");
 
-	Packet* p = new Packet((const unsigned char*)packet.data, packet.size);
-
-	p->decodeBlowfish(gClientEnv->bBlowFish);
-
-	/**************************** ************************************/
-	EPacketType type = (EPacketType)p->readInt();             // Packet type
-	const char* version        = p->readString();             // Packet version
-	/*********************************************************************************/
+	Packet* p = packet.pPacket;
 
-	message.message    = p->readString();              
-	message.area       = (EChatMessageArea)p->readInt();                      
+	SchemaRead<SMessageSchema>(p, message, !packet.bLegacy);
 
-	const char* endBlock = p->readString();
-
-	if(strcmp(endBlock,EndBlock))
+	if(!ReadEndBlock(packet))
 	{
 		gEnv->pLog->LogWarning(TITLE "Message packet damaged!");
 
@@ -116,37 +231,36 @@ SMessage CReadSendPacket::ReadMsg(SPacket packet)
 		PacketDebugger::Debug(Packet, size, "ReceivedPacketsDebugg.txt");
 	}
 
-	delete p;
 	return message;
 }
 
-SRequestPacket CReadSendPacket::ReadRequest(SPacket packet)
+SRequestPacket CReadSendPacket::ReadRequest(SDecodedPacket& packet)
 {
 	SRequestPacket request;
 
 	gEnv->pLog->Log(TITLE "Read request packet...");
 
-	Packet* p = new Packet((const unsigned char*)packet.data, packet.size);
-
-	p->decodeBlowfish(gClientEnv->bBlowFish);
+	Packet* p = packet.pPacket;
 
-	/**************************** ************************************/
-	EPacketType type = (EPacketType)p->readInt();             // Packet type
-	const char* version        = p->readString();             // Packet version
-	/*********************************************************************************/
 
+	if(packet.bLegacy)
+	{
+		SchemaRead<SRequestSchema>(p, request);
+		request.id = GetRequestId(request.request);
+		free((void*)request.request);
+	}
+	else
+		SchemaVarRead<SRequestIdSchema>(p, request);
 
-	request.request = p->readString();
-	request.sParam = p->readString();
-	request.iParam = p->readInt();
+	request.request = GetRequestName(request.id);
 
 
-	const char* endBlock = p->readString(); 
-	if(strcmp(endBlock, EndBlock))
+	if(!ReadEndBlock(packet))
 	{
 		gEnv->pLog->LogWarning(TITLE "Request packet damaged!");
 
-		request.request = "";
+		request.id = REQUEST_UNKNOWN;
+		request.request = NULL;
 		return request;
 	}
 
@@ -163,37 +277,20 @@ SRequestPacket CReadSendPacket::ReadRequest(SPacket packet)
 		PacketDebugger::Debug(Packet, size, "ReceivedPacketsDebugg.txt");
 	}
 
-	delete p;
 	return request;
 }
 
-SGameServer CReadSendPacket::ReadGameServerInfo(SPacket packet)
+SGameServer CReadSendPacket::ReadGameServerInfo(SDecodedPacket& packet)
 {
 	gEnv->pLog->Log(TITLE "Read game server info packet...");
 
 	SGameServer Server;
 
-	Packet* p = new Packet((const unsigned char*)packet.data, packet.size);
-
-	p->decodeBlowfish(gClientEnv->bBlowFish);
-
-	/**************************** ************************************/
-	EPacketType type = (EPacketType)p->readInt();             // Packet type
-	const char* version        = p->readString();             // Packet version
-	/*********************************************************************************/
-
-	Server.id              = p->readInt();                  // id 
-	Server.ip              = p->readString();               // ip           
-	Server.port            = p->readInt();                  //  
-	Server.serverName      = p->readString();               //  
-	Server.currentPlayers  = p->readInt();                  //   
-	Server.maxPlayers      = p->readInt();                  //  - 
-	Server.mapName         = p->readString();               //  
-	Server.gameRules       = p->readString();               //  
+	Packet* p = packet.pPacket;
 
-	const char* endBlock = p->readString();                 //  
+	SchemaRead<SGameServerSchema>(p, Server, !packet.bLegacy);
 
-	if(strcmp(endBlock,EndBlock))
+	if(!ReadEndBlock(packet))                               //  
 	{
 		gEnv->pLog->LogWarning(TITLE "Game server info packet damaged!");
 
@@ -219,37 +316,22 @@ SGameServer CReadSendPacket::ReadGameServerInfo(SPacket packet)
 		PacketDebugger::Debug(Packet, size, "ReceivedPacketsDebugg.txt");
 	}
 
-	delete p;
 	return Server;
 }
 
-void CReadSendPacket::ReadGameServers(SPacket packet)
+void CReadSendPacket::ReadGameServers(SDecodedPacket& packet)
 {
 	gEnv->pLog->Log(TITLE "Read game server info packet...");
 
-	Packet* p = new Packet((const unsigned char*)packet.data, packet.size);
+	Packet* p = packet.pPacket;
 
-	p->decodeBlowfish(gClientEnv->bBlowFish);
-
-	/**************************** ************************************/
-	EPacketType type = (EPacketType)p->readInt();             // Packet type
-	const char* version        = p->readString();             // Packet version
-	/*********************************************************************************/
-
-	int serversCount = p->readInt();
+	int serversCount = packet.bLegacy ? p->readInt() : (int)p->readVarUInt();
 
 	for (int i = 0 ; i != serversCount; i++)
 	{
 		SGameServer Server; SUIArguments args;
 
-		Server.id              = p->readInt();                  // id 
-		Server.ip              = p->readString();               // ip           
-		Server.port            = p->readInt();                  //  
-		Server.serverName      = p->readString();               //  
-		Server.currentPlayers  = p->readInt();                  //   
-		Server.maxPlayers      = p->readInt();                  //  - 
-		Server.mapName         = p->readString();               //  
-		Server.gameRules       = p->readString();               //  
+		SchemaRead<SGameServerSchema>(p, Server, !packet.bLegacy);
 
 		if(Server.port)
 		{
@@ -272,39 +354,32 @@ void CReadSendPacket::ReadGameServers(SPacket packet)
 	}
 	
 
-	const char* endBlock = p->readString();                    //  
-
-	if(strcmp(endBlock,EndBlock))
+	if(!ReadEndBlock(packet))                                  //  
 	{
 		gEnv->pLog->LogWarning(TITLE "Game servers packet damaged!");
 	}
-
-	delete p;
 }
 
-SPlayer CReadSendPacket::ReadAccountInfo(SPacket packet)
+SPlayer CReadSendPacket::ReadAccountInfo(SDecodedPacket& packet)
 {
 	gEnv->pLog->Log(TITLE "Read account info packet...");
 
 	SPlayer Player;
-	Packet* p = new Packet((const unsigned char*)packet.data, packet.size);
-	p->decodeBlowfish(gClientEnv->bBlowFish);
+	SAccountInfo info;
+	Packet* p = packet.pPacket;
 
-	/**************************** ************************************/
-	EPacketType type = (EPacketType)p->readInt();             // Packet type
-	const char* version        = p->readString();             // Packet version
-	/*********************************************************************************/
+	SchemaRead<SAccountSchema>(p, info, !packet.bLegacy);
 
-	Player.playerId  = p->readInt();
-	Player.nickname  = p->readString();
-	Player.xp        = p->readInt();
-	Player.level     = p->readInt();
-	Player.money     = p->readInt();
-	Player.banStatus = !!p->readInt();
+	Player.playerId  = info.playerId;
+	Player.nickname  = info.nickname ? info.nickname : "";
+	Player.xp        = info.xp;
+	Player.level     = info.level;
+	Player.money     = info.money;
+	Player.banStatus = !!info.banStatus;
 
-	const char* endBlock = p->readString();                   //  
+	free((void*)info.nickname);
 
-	if(strcmp(endBlock,EndBlock))
+	if(!ReadEndBlock(packet))                                 //  
 	{
 		gEnv->pLog->LogWarning(TITLE "Game server info packet damaged!");
 
@@ -328,29 +403,19 @@ SPlayer CReadSendPacket::ReadAccountInfo(SPacket packet)
 		PacketDebugger::Debug(Packet, size, "ReceivedPacketsDebugg.txt");
 	}
 
-	delete p;
 	return Player;
 }
 
-SMasterServerInfo CReadSendPacket::ReadMasterServerInfo(SPacket packet)
+SMasterServerInfo CReadSendPacket::ReadMasterServerInfo(SDecodedPacket& packet)
 {
 	gEnv->pLog->Log(TITLE "Read master server info packet...");
 
 	SMasterServerInfo Info;
-	Packet* p = new Packet((const unsigned char*)packet.data, packet.size);
-	p->decodeBlowfish(gClientEnv->bBlowFish);
-
-	/**************************** ************************************/
-	EPacketType type = (EPacketType)p->readInt();             // Packet type
-	const char* version        = p->readString();             // Packet version
-	/*********************************************************************************/
+	Packet* p = packet.pPacket;
 
-	Info.playersOnline = p->readInt();
-	Info.gameServersOnline = p->readInt();
+	SchemaRead<SMasterServerInfoSchema>(p, Info, !packet.bLegacy);
 
-	const char* endBlock = p->readString();                   //  
-
-	if(strcmp(endBlock,EndBlock))
+	if(!ReadEndBlock(packet))                                 //  
 	{
 		gEnv->pLog->LogWarning(TITLE "Game server info packet damaged!");
 
@@ -371,30 +436,20 @@ SMasterServerInfo CReadSendPacket::ReadMasterServerInfo(SPacket packet)
 		PacketDebugger::Debug(Packet, size, "ReceivedPacketsDebugg.txt");
 	}
 
-	delete p;
 	return Info;
 }
 
 
-void CReadSendPacket::ReadConsoleCommandPacket(SPacket packet)
+void CReadSendPacket::ReadConsoleCommandPacket(SDecodedPacket& packet)
 {
 	gEnv->pLog->Log(TITLE "Read console command packet...");
 
-	Packet* p = new Packet((const unsigned char*)packet.data, packet.size);
-
-	p->decodeBlowfish(gClientEnv->bBlowFish);
-
-	/**************************** ************************************/
-	EPacketType type = (EPacketType)p->readInt();             // Packet type
-	const char* version        = p->readString();             // Packet version
-	/*********************************************************************************/
+	Packet* p = packet.pPacket;
 
 	const char* command = p->readString();
 	gEnv->pConsole->ExecuteString(command);
 
-	const char* endBlock = p->readString();                   //  
-
-	if(strcmp(endBlock,EndBlock))
+	if(!ReadEndBlock(packet))                                 //  
 		gEnv->pLog->LogWarning(TITLE "Identification packet damaged!");
 
 	if(gClientEnv->bDebugMode)
@@ -407,5 +462,4 @@ void CReadSendPacket::ReadConsoleCommandPacket(SPacket packet)
 		PacketDebugger::Debug(Packet, size, "ReceivedPacketsDebugg.txt");
 	}
 
-	delete p;
 }
\ No newline at end of file
@@ -13,6 +13,7 @@ History:
 
 #include "../System/Global.h"
 #include "Packets.h"
+#include "PacketBuilder.h"
 #include "PacketDebugger.h"
 #include "RSP.h"
 
@@ -22,32 +23,39 @@ void CReadSendPacket::SendIdentificationPacket(SOCKET Socket)
 
 	SPacket SPacket;
 	Packet* p = new Packet();
-	p->create();
+	CPacketBuilder pb(p);
 
 
 	/**************************** ************************************/
 
-	p->writeInt(PACKET_IDENTIFICATION);                          //  
-	p->writeString(gClientEnv->clientVersion);           //  
+	pb.WriteInt(PACKET_IDENTIFICATION);                          //  
+	pb.WriteString(gClientEnv->clientVersion);           //  
 
 	/******************************* ****************************************/
 
-	p->writeString(EndBlock);                                    //  
+	if(gClientEnv->offeredCrypto == SESSION_CRYPTO_AES_GCM)
+		pb.WriteString(AeadKeyBlock);                            // AES-GCM session key accepted
+	else if(gClientEnv->offeredCrypto == SESSION_CRYPTO_BLOWFISH)
+		pb.WriteString(SessionKeyBlock);                         // Session key accepted
 
-	p->padPacketTo8ByteLen();
-	p->encodeBlowfish(gClientEnv->bBlowFish);
-	p->appendChecksum(false);
-	p->appendMore8Bytes();
+	if(gClientEnv->offeredCrypto != SESSION_CRYPTO_NONE)
+		pb.WriteString(gClientEnv->publicKey);                   // Public key of session key exchange
 
+	if(gClientEnv->offeredProtocolV2)
+		pb.WriteString(ProtocolV2Block);                         // Protocol v2 accepted
 
-	int size = p->getPacketSize();
-	char* packet = (char*)p->getBytesPtr();
+	if(gClientEnv->offeredLz4)
+		pb.WriteString(Lz4Block);                                // LZ4 compression accepted
 
-	SPacket.addr = Socket;
-	SPacket.data = packet;
-	SPacket.size = size;
+	pb.WriteString(EndBlock);                                    //  
 
-	gClientEnv->pPacketQueue->InsertPacket(SPacket);
+	pb.Finish();
+
+	// Send queue encodes packet, session packets must be sealed in sending order
+	SPacket = gClientEnv->pPacketQueue->InsertPacket(Socket, p);
+
+	int size = SPacket.size;
+	char* packet = SPacket.data;
 
 	if(gClientEnv->bDebugMode)
 	{
@@ -63,34 +71,19 @@ void CReadSendPacket::SendMsg(SOCKET Socket, SMessage message)
 
 	SPacket SPacket;
 	Packet* p = new Packet();
-	p->create();
-
-	/**************************** ************************************/
-
-	p->writeInt(PACKET_MESSAGE);                                 //  
-	p->writeString(gClientEnv->clientVersion);           //  
+	// Protocol v2 packet is written directly, send queue only encodes it
+	bool bProtocolV2 = gClientEnv->bProtocolV2;
+	CPacketBuilder pb(p, SchemaPacketSize<SMessageSchema>(gClientEnv->clientVersion, message, bProtocolV2));
 
-	/******************************* ****************************************/
+	SchemaWritePacket<SMessageSchema>(pb, PACKET_MESSAGE, gClientEnv->clientVersion, message, bProtocolV2); // Header, fields, end block
 
-	p->writeString(message.message);
-	p->writeInt(message.area);                            
+	pb.Finish();
 
-	p->writeString(EndBlock);                                    //   
+	// Send queue encodes packet, session packets must be sealed in sending order
+	SPacket = gClientEnv->pPacketQueue->InsertPacket(Socket, p);
 
-	p->padPacketTo8ByteLen();
-	p->encodeBlowfish(gClientEnv->bBlowFish);
-	p->appendChecksum(false);
-	p->appendMore8Bytes();
-
-
-	int size = p->getPacketSize();
-	char* packet = (char*)p->getBytesPtr();
-
-	SPacket.addr = Socket;
-	SPacket.data = packet;
-	SPacket.size = size;
-
-	gClientEnv->pPacketQueue->InsertPacket(SPacket);
+	int size = SPacket.size;
+	char* packet = SPacket.data;
 
 
 	if(gClientEnv->bDebugMode)
@@ -111,41 +104,19 @@ void CReadSendPacket::SendGameServerInfo (SOCKET Socket, SGameServer server)
 
 	Packet* p = new Packet();
 
-	p->create();
-
+	// Protocol v2 packet is written directly, send queue only encodes it
+	bool bProtocolV2 = gClientEnv->bProtocolV2;
+	CPacketBuilder pb(p, SchemaPacketSize<SGameServerSchema>(gClientEnv->clientVersion, server, bProtocolV2));
 
-	/**************************** ************************************/
-
-	p->writeInt(PACKET_GAME_SERVER);                     //  
-	p->writeString(gClientEnv->clientVersion);           //  
-
-	/******************************* ****************************************/
-              
-	p->writeInt(0);
-	p->writeString(server.ip);                                
-	p->writeInt(server.port);                               
-	p->writeString(server.serverName);                       
-	p->writeInt(server.currentPlayers);                   
-	p->writeInt(server.maxPlayers);                     
-	p->writeString(server.mapName);                          
-	p->writeString(server.gameRules);                     
-
-	p->writeString(EndBlock);                                    //  
-
-	p->padPacketTo8ByteLen();
-	p->encodeBlowfish(gClientEnv->bBlowFish);
-	p->appendChecksum(false);
-	p->appendMore8Bytes();
+	SchemaWritePacket<SGameServerSchema>(pb, PACKET_GAME_SERVER, gClientEnv->clientVersion, server, bProtocolV2); // Header, fields, end block
 
+	pb.Finish();
 
-	int size = p->getPacketSize();
-	char* packet = (char*)p->getBytesPtr();
+	// Send queue encodes packet, session packets must be sealed in sending order
+	SPacket = gClientEnv->pPacketQueue->InsertPacket(Socket, p);
 
-	SPacket.addr = Socket;
-	SPacket.data = packet;
-	SPacket.size = size;
-
-	gClientEnv->pPacketQueue->InsertPacket(SPacket);
+	int size = SPacket.size;
+	char* packet = SPacket.data;
 
 	if(gClientEnv->bDebugMode)
 	{
@@ -172,36 +143,34 @@ void CReadSendPacket::SendRequest(SOCKET Socket, SRequestPacket request)
 
 	Packet* p = new Packet();
 
-	p->create();
-
+	// Protocol v2 packet is written directly, send queue only encodes it.
+	// Known request goes by id, unknown request goes as old packet with name
+	bool bProtocolV2 = gClientEnv->bProtocolV2;
+	request.id = GetRequestId(request.request);
+	bool bVarFields = bProtocolV2 && request.id != REQUEST_UNKNOWN && SchemaVarFits<SRequestIdSchema>(request);
 
-	/**************************** ************************************/
+	CPacketBuilder pb(p, bVarFields ? SchemaPacketSize<SRequestIdSchema>(gClientEnv->clientVersion, request, true) :
+		1 + SchemaPacketSize<SRequestSchema>(gClientEnv->clientVersion, request));
 
-	p->writeInt(PACKET_REQUEST);                                 //  
-	p->writeString(gClientEnv->clientVersion);           //  
-
-	/******************************* ****************************************/
+	if(bProtocolV2 && !bVarFields)
+		pb.WriteUChar(PACKET_OPCODE_LEGACY);                     // Old packet follows
 
-	p->writeString(request.request);
-	p->writeString(request.sParam);
-	p->writeInt(request.iParam);
+	SchemaWriteHeader(pb, PACKET_REQUEST, gClientEnv->clientVersion, bVarFields); // Packet type and version or opcode
 
-	p->writeString(EndBlock);                                    //   
+	if(bVarFields)
+		SchemaVarWrite<SRequestIdSchema>(pb, request);           // Request id
+	else
+		SchemaWrite<SRequestSchema>(pb, request);                // Request
 
-	p->padPacketTo8ByteLen();
-	p->encodeBlowfish(gClientEnv->bBlowFish);
-	p->appendChecksum(false);
-	p->appendMore8Bytes();
+	SchemaWriteEnd(pb, bVarFields);                              // End block
 
+	pb.Finish();
 
-	int size = p->getPacketSize();
-	char* packet = (char*)p->getBytesPtr();
+	// Send queue encodes packet, session packets must be sealed in sending order
+	SPacket = gClientEnv->pPacketQueue->InsertPacket(Socket, p);
 
-	SPacket.addr = Socket;
-	SPacket.data = packet;
-	SPacket.size = size;
-
-	gClientEnv->pPacketQueue->InsertPacket(SPacket);
+	int size = SPacket.size;
+	char* packet = SPacket.data;
 
 	if(gClientEnv->bDebugMode)
 	{
@@ -220,35 +189,19 @@ void CReadSendPacket::SendLoginPacket(SOCKET Socket, SLoginPacket packet)
 
 	SPacket SPacket;
 	Packet* p = new Packet();
-	p->create();
-
-
-	/**************************** ************************************/
-
-	p->writeInt(PACKET_LOGIN);                                   //  
-	p->writeString(gClientEnv->clientVersion);           //  
+	// Protocol v2 packet is written directly, send queue only encodes it
+	bool bProtocolV2 = gClientEnv->bProtocolV2;
+	CPacketBuilder pb(p, SchemaPacketSize<SLoginSchema>(gClientEnv->clientVersion, packet, bProtocolV2));
 
-	/******************************* ****************************************/
+	SchemaWritePacket<SLoginSchema>(pb, PACKET_LOGIN, gClientEnv->clientVersion, packet, bProtocolV2); // Header, fields, end block
 
-	p->writeString(packet.login);
-	p->writeString(packet.password);
+	pb.Finish();
 
-	p->writeString(EndBlock);                                    //  
+	// Send queue encodes packet, session packets must be sealed in sending order
+	SPacket = gClientEnv->pPacketQueue->InsertPacket(Socket, p);
 
-	p->padPacketTo8ByteLen();
-	p->encodeBlowfish(gClientEnv->bBlowFish);
-	p->appendChecksum(false);
-	p->appendMore8Bytes();
-
-
-	int size = p->getPacketSize();
-	char* Packet = (char*)p->getBytesPtr();
-
-	SPacket.addr = Socket;
-	SPacket.data = Packet;
-	SPacket.size = size;
-
-	gClientEnv->pPacketQueue->InsertPacket(SPacket);
+	int size = SPacket.size;
+	char* Packet = SPacket.data;
 
 	if(gClientEnv->bDebugMode)
 	{
@@ -264,36 +217,19 @@ void CReadSendPacket::SendRegisterPacket(SOCKET Socket, SLoginPacket packet)
 
 	SPacket SPacket;
 	Packet* p = new Packet();
-	p->create();
+	// Protocol v2 packet is written directly, send queue only encodes it
+	bool bProtocolV2 = gClientEnv->bProtocolV2;
+	CPacketBuilder pb(p, SchemaPacketSize<SRegistrationSchema>(gClientEnv->clientVersion, packet, bProtocolV2));
 
+	SchemaWritePacket<SRegistrationSchema>(pb, PACKET_REGISTER, gClientEnv->clientVersion, packet, bProtocolV2); // Header, fields, end block
 
-	/**************************** ************************************/
+	pb.Finish();
 
-	p->writeInt(PACKET_REGISTER);                                              //  
-	p->writeString(gClientEnv->clientVersion);                         //  
-
-	/******************************* ****************************************/
-
-	p->writeString(packet.login);
-	p->writeString(packet.password);
-	p->writeString(packet.nickname);
-
-	p->writeString(EndBlock);                                    //  
-
-	p->padPacketTo8ByteLen();
-	p->encodeBlowfish(gClientEnv->bBlowFish);
-	p->appendChecksum(false);
-	p->appendMore8Bytes();
+	// Send queue encodes packet, session packets must be sealed in sending order
+	SPacket = gClientEnv->pPacketQueue->InsertPacket(Socket, p);
 
-
-	int size = p->getPacketSize();
-	char* Packet = (char*)p->getBytesPtr();
-
-	SPacket.addr = Socket;
-	SPacket.data = Packet;
-	SPacket.size = size;
-
-	gClientEnv->pPacketQueue->InsertPacket(SPacket);
+	int size = SPacket.size;
+	char* Packet = SPacket.data;
 
 	if(gClientEnv->bDebugMode)
 	{
@@ -309,33 +245,27 @@ void CReadSendPacket::SendConsoleTextPacket(SOCKET Socket, int textType, const c
 
 	SPacket SPacket;
 	Packet* p = new Packet();
-	p->create();
+	CPacketBuilder pb(p);
 
 
 	/**************************** ************************************/
 
-	p->writeInt(PACKET_CONSOLE_TEXT);                    //  
-	p->writeString(gClientEnv->clientVersion);           //  
+	// Protocol v2 packet keeps old fields
+	bool bProtocolV2 = gClientEnv->bProtocolV2;
+	SchemaWriteHeader(pb, PACKET_CONSOLE_TEXT, gClientEnv->clientVersion, bProtocolV2); // Packet type and version or opcode
 
 	/******************************* ****************************************/
 
-	p->writeInt(textType);
-	p->writeString(text);
-
-	p->writeString(EndBlock);                            //  
-
-	p->padPacketTo8ByteLen();
-	p->encodeBlowfish(gClientEnv->bBlowFish);
-	p->appendChecksum(false);
-	p->appendMore8Bytes();
+	pb.WriteInt(textType);
+	pb.WriteString(text);
 
+	SchemaWriteEnd(pb, bProtocolV2);                             // End block
 
-	int size = p->getPacketSize();
-	char* Packet = (char*)p->getBytesPtr();
+	pb.Finish();
 
-	SPacket.addr = Socket;
-	SPacket.data = Packet;
-	SPacket.size = size;
+	// Send queue encodes packet, session packets must be sealed in sending order
+	SPacket = gClientEnv->pPacketQueue->InsertPacket(Socket, p);
 
-	gClientEnv->pPacketQueue->InsertPacket(SPacket);
+	int size = SPacket.size;
+	char* Packet = SPacket.data;
 }
\ No newline at end of file
@@ -12,6 +12,10 @@ History:
 #define _CryMasterGlobal_
 
 #include "../Packets/RSP.h"
+#include "../../Common/PacketFramer.h"
+#include "../Packets/BlowfishKey.h"
+#include "../Packets/AesGcmKey.h"
+#include "../Packets/KeyExchange.h"
 #include "../System/PacketQueue.h"
 #include "../MasterServer.h"
 #include "../Nodes/MsEvents.h"
@@ -35,6 +39,19 @@ struct SGlobalClient
 	const char* clientVersion;
 	string serverResult;
 
+	// Session key made with master server. Used after identification packet is sent
+	unsigned char offeredKey[SESSION_KEY_SIZE];
+	// Own public key of session key exchange, sent in identification packet
+	char publicKey[KEY_EXCHANGE_HEX_SIZE];
+	ESessionCrypto offeredCrypto;
+	CBlowfishKey* pSessionKey;
+	CAesGcmKey* pAeadKey;
+	// Protocol v2 offered by master server and used after identification packet is sent
+	bool offeredProtocolV2;
+	bool bProtocolV2;
+	// LZ4 compression offered by master server, accepted by identification packet
+	bool offeredLz4;
+
 	bool bDebugMode;
 	bool bBlowFish;
 	bool bConnected;
@@ -52,6 +69,13 @@ struct SGlobalClient
 		bConnected = false;
 		bConsoleHelperConnected = false;
 
+		offeredCrypto = SESSION_CRYPTO_NONE;
+		pSessionKey = NULL;
+		pAeadKey = NULL;
+		offeredProtocolV2 = false;
+		bProtocolV2 = false;
+		offeredLz4 = false;
+
 		pMasterServer = new CMasterServer;
 		pPacketQueue  = new CPacketQueue;
 		pRsp          = new CReadSendPacket;
@@ -68,6 +92,7 @@ struct SGlobalClient
 		serverInfo.playersOnline = 0;
 		serverInfo.gameServersOnline = 0;
 		//
+		gameServer.id = 0;
 		gameServer.currentPlayers = 0;
 		gameServer.gameRules = "";
 		gameServer.ip = "";
@@ -14,6 +14,8 @@ History:
 #include <winsock.h>
 
 #include "../System/Global.h"
+#include "../Packets/Packets.h"
+#include "../../Common/PacketCompression.h"
 #include "PacketQueue.h"
 
 CPacketQueue::CPacketQueue()
@@ -30,14 +32,47 @@ void CPacketQueue::Init()
 	Thread.detach();
 }
 
-void CPacketQueue::InsertPacket(SPacket packet)
+SPacket CPacketQueue::InsertPacket(SOCKET Socket, Packet* p)
 {
+	SPacket packet;
+	packet.addr = Socket;
+	packet.data = NULL;
+	packet.size = 0;
+
 	send_mutex.lock();
-	SendPackets.push_back(packet);
-	packetsInSendQueue++;
+
+	// Sealed under send lock, so AES-GCM sequence follows sending order.
+	// Protocol v2 packets are written by senders, they are only encoded here
+	bool bEncoded = true;
+
+	if(gClientEnv->pAeadKey != NULL)
+		bEncoded = gClientEnv->pAeadKey->Seal(p);
+	else
+	{
+		p->padPacketTo8ByteLen();
+		p->setDynamicBFKey(gClientEnv->pSessionKey);
+		p->encodeBlowfish(gClientEnv->bBlowFish);
+		p->appendChecksum(false);
+		p->appendMore8Bytes();
+	}
+
+	if(bEncoded)
+	{
+		packet.data = (char*)p->getBytesPtr();
+		packet.size = p->getPacketSize();
+
+		SendPackets.push_back(packet);
+		packetsInSendQueue++;
+	}
+
 	send_mutex.unlock();
 
+	if(!bEncoded)
+		gEnv->pLog->LogWarning(TITLE "Can't encode packet!");
+
 	//gEnv->pLog->Log("[CryMasterServer] CPacketQueue::New packet added to send queue");
+
+	return packet;
 }
 
 void CPacketQueue::InsertPacketToRead(SPacket packet)
@@ -103,9 +138,37 @@ void CPacketQueue::Thread()
 			Packet.data = (*it).data;
 			Packet.size = (*it).size;
 
-			EPacketType packetType = gClientEnv->pRsp->GetPacketType(Packet);
+			// Packet is decrypted only here, readers get decoded packet
+			SDecodedPacket Decoded;
+			if(!gClientEnv->pRsp->DecodePacket(Packet, Decoded))
+				Decoded.type = (EPacketType)-1;
 
-			switch (packetType)
+			// Chunk of big message. Message is read when last chunk comes
+			if(Decoded.type == PACKET_CHUNK)
+			{
+				::Packet* pMessage = chunks.Add(Decoded.pPacket);
+				gClientEnv->pRsp->FreePacket(Decoded);
+
+				Decoded.pPacket = pMessage;
+				if(pMessage == NULL || !gClientEnv->pRsp->DecodeHeader(Decoded))
+					Decoded.type = PACKET_CHUNK;
+			}
+
+			// Compressed big message (game servers list). Readers get it decompressed
+			if(Decoded.type == PACKET_COMPRESSED)
+			{
+				::Packet* pMessage = CPacketCompression::Decompress(Decoded.pPacket);
+				gClientEnv->pRsp->FreePacket(Decoded);
+
+				Decoded.pPacket = pMessage;
+				if(pMessage == NULL)
+					gEnv->pLog->LogWarning(TITLE "Compressed packet damaged!");
+
+				if(pMessage == NULL || !gClientEnv->pRsp->DecodeHeader(Decoded))
+					Decoded.type = PACKET_COMPRESSED;
+			}
+
+			switch (Decoded.type)
 			{
 			case PACKET_IDENTIFICATION:
 				gEnv->pLog->Log(TITLE "Identification packet recived");
@@ -114,7 +177,7 @@ void CPacketQueue::Thread()
 				{
 					gEnv->pLog->Log(TITLE "Account info packet recived");
 
-					gClientEnv->masterPlayer = gClientEnv->pRsp->ReadAccountInfo(Packet);
+					gClientEnv->masterPlayer = gClientEnv->pRsp->ReadAccountInfo(Decoded);
 
 					SPlayer Player;
 					SUIArguments args;
@@ -135,7 +198,7 @@ void CPacketQueue::Thread()
 				}
 			case PACKET_MESSAGE:
 				{
-					SMessage Message = gClientEnv->pRsp->ReadMsg(Packet);
+					SMessage Message = gClientEnv->pRsp->ReadMsg(Decoded);
 
 					if(strcmp(Message.message,""))
 					{
@@ -170,9 +233,9 @@ void CPacketQueue::Thread()
 			case PACKET_REQUEST:
 				{
 					gEnv->pLog->Log(TITLE "Request packet recived");
-					SRequestPacket svRequest = gClientEnv->pRsp->ReadRequest(Packet);
+					SRequestPacket svRequest = gClientEnv->pRsp->ReadRequest(Decoded);
 
-					if(!strcmp(svRequest.request,"RemoveGameServer"))
+					if(svRequest.id == REQUEST_REMOVE_GAME_SERVER)
 					{
 						SUIArguments args;
 						args.AddArgument(svRequest.iParam);
@@ -198,7 +261,7 @@ void CPacketQueue::Thread()
 			case PACKET_MS_INFO:
 				{
 					gEnv->pLog->Log(TITLE "Master server info packet recived");
-					gClientEnv->serverInfo = gClientEnv->pRsp->ReadMasterServerInfo(Packet);
+					gClientEnv->serverInfo = gClientEnv->pRsp->ReadMasterServerInfo(Decoded);
 
 					if(gClientEnv->serverInfo.playersOnline)
 					{
@@ -213,21 +276,26 @@ void CPacketQueue::Thread()
 			case PACKET_GAME_SERVERS:
 				{
 					gEnv->pLog->Log( TITLE "Game servers packet recived");
-					gClientEnv->pRsp->ReadGameServers(Packet);
+					gClientEnv->pRsp->ReadGameServers(Decoded);
 
 					break;
 				}
 			case PACKET_CONSOLE_COMMAND:
 				{
 					gEnv->pLog->Log(TITLE "Console command packet recieved");
-					gClientEnv->pRsp->ReadConsoleCommandPacket(Packet);
+					gClientEnv->pRsp->ReadConsoleCommandPacket(Decoded);
 					break;
 				}
+			case PACKET_CHUNK:
+			case PACKET_COMPRESSED:
+				break;
 			default:
 				gEnv->pLog->Log( TITLE "Unknown packet recived...");
 				break;
 			}
 
+			gClientEnv->pRsp->FreePacket(Decoded);
+			delete[] Packet.data;
 			ReadPackets.erase(it);
 			packetsInReadQueue--;
 		}		
@@ -14,6 +14,7 @@ History:
 
 #include <mutex>
 typedef UINT_PTR SOCKET;
+#include "../Packets/PacketChunks.h"
 
 class CPacketQueue
 {
@@ -22,8 +23,8 @@ public:
 	~CPacketQueue(){}
 
 	void Init();
-	// Insert packet to send queue
-	void InsertPacket(SPacket packet);
+	// Encode packet by session key and insert it to send queue
+	SPacket InsertPacket(SOCKET Socket, Packet* p);
 	// Inser packet to read queue
 	void InsertPacketToRead(SPacket packet);
 
@@ -37,5 +38,7 @@ private:
 	std::mutex read_mutex;
 	int packetsInReadQueue;
 	std::vector <SPacket> ReadPackets;
+	// Big message from master server being put together
+	CPacketChunks chunks;
 };
 #endif
\ No newline at end of file
@@ -0,0 +1,550 @@
+/*************************************************************************
+Copyright (C), chernecoff@gmail.com, 2014-2015
+--------------------------------------------------------------------------
+History:
+
+- 16.10.2026   23:51 : Created by agent
+-------------------------------------------------------------------------
+
+*************************************************************************/
+
+#include "StdAfx.h"
+#include "BinaryDatabase.h"
+#include "System\md5.h"
+
+#include <io.h>
+
+CBinaryDatabase::CBinaryDatabase()
+{
+	hFile = INVALID_HANDLE_VALUE;
+	hMapping = NULL;
+	pView = NULL;
+
+	pHeader = NULL;
+	pRecords = NULL;
+	pLoginIndex = NULL;
+	pNicknameIndex = NULL;
+
+	recordsCount = 0;
+	InitializeSRWLock(&lock);
+}
+
+CBinaryDatabase::~CBinaryDatabase()
+{
+	Close();
+}
+
+void CBinaryDatabase::Init()
+{
+	Log(LOG_DEBUG,"CBinaryDatabase::Init()");
+
+	if(_access("Accounts.dat", 0) == -1)
+	{
+		// File is made under other name, so import broken by crash is made again
+		if(!Create("Accounts.dat.tmp"))
+			return;
+
+		// Accounts.dat without all accounts is not made, Database.xml is used again on next start
+		if(_access("Database.xml", 0) != -1 && !Import())
+		{
+			Close();
+
+			DeleteFile("Accounts.dat.tmp");
+			return;
+		}
+
+		FlushViewOfFile(pView, 0);
+		FlushFileBuffers(hFile);
+
+		Close();
+
+		if(!MoveFileEx("Accounts.dat.tmp", "Accounts.dat", MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH))
+		{
+			Log(LOG_ERROR,"Can't create Accounts.dat!");
+			return;
+		}
+	}
+
+	if(!Open("Accounts.dat"))
+		return;
+
+	Log(LOG_INFO,"Opened Accounts.dat with %d accounts", pHeader->recordsCount);
+}
+
+const char* CBinaryDatabase::Register(std::string login, std::string password, std::string nickName)
+{
+	Log(LOG_DEBUG,"CBinaryDatabase::Register()");
+
+	if(login.size() >= BINARY_DB_STRING_SIZE || password.size() >= BINARY_DB_STRING_SIZE || nickName.size() >= BINARY_DB_STRING_SIZE)
+	{
+		Log(LOG_WARNING,"CBinaryDatabase::Register user <%s> failed! Login, password or nickname is too long!", login.c_str());
+		return "RegFailed";
+	}
+
+	unsigned char loginKey[16];
+	unsigned char nicknameKey[16];
+	GetKey(login.c_str(), loginKey);
+	GetKey(nickName.c_str(), nicknameKey);
+
+	std::lock_guard<std::mutex> writeLock(writeMutex);
+
+	if(!pView)
+		return "RegFailed";
+
+	if(Find(pLoginIndex, false, loginKey))
+	{
+		Log(LOG_WARNING,"CBinaryDatabase::Register user <%s> failed! This login alredy registered!", login.c_str());
+		return "LoginAlReg";
+	}
+
+	if(Find(pNicknameIndex, true, nicknameKey))
+	{
+		Log(LOG_WARNING,"CBinaryDatabase::Register user <%s> failed! Nickname <%s> alredy used!", login.c_str(), nickName.c_str());
+		return "RegFailed";
+	}
+
+	unsigned int record = pHeader->recordsCount;
+
+	if(!AddAccount(login, password, nickName, pHeader->lastPlayerId + 1, 0, 0, 0, false))
+	{
+		Log(LOG_ERROR,"CBinaryDatabase::Register user <%s> failed!", login.c_str());
+		return "RegFailed";
+	}
+
+	Commit(record);
+
+	Log(LOG_DEBUG,"CBinaryDatabase::Register user <%s> success!", login.c_str());
+
+	gEnv->rClients++;
+
+	return "RegSuccess";
+}
+
+const char* CBinaryDatabase::Login(std::string login, std::string password)
+{
+	Log(LOG_DEBUG,"CBinaryDatabase::Login()");
+
+	SBinaryAccount account;
+	if(!ReadAccount(login, account))
+	{
+		Log(LOG_WARNING,"CBinaryDatabase::Login user <%s> failed! Login not found!",login.c_str());
+		return "LoginNotFound";
+	}
+
+	if(strncmp(account.password, password.c_str(), BINARY_DB_STRING_SIZE))
+	{
+		Log(LOG_WARNING,"CBinaryDatabase::Login user <%s> failed! Incorrect password!",login.c_str());
+		return "PasswordIncorrect";
+	}
+
+	if(account.ban)
+	{
+		Log(LOG_WARNING,"CBinaryDatabase::Login user <%s> failed! Account banned!",login.c_str());
+		return "AccountBlocked";
+	}
+
+	Log(LOG_DEBUG,"CBinaryDatabase::Login user <%s> success!",login.c_str());
+	gEnv->aClients++;
+	return "PasswordCorrect";
+}
+
+SClient CBinaryDatabase::GetUserInfo(std::string login)
+{
+	Log(LOG_DEBUG,"CBinaryDatabase::GetUserInfo()");
+
+	SClient player;
+
+	SBinaryAccount account;
+	if(ReadAccount(login, account))
+	{
+		player.playerId = account.id;
+		player.nickname = account.nickname;
+		player.xp = account.xp;
+		player.level = account.level;
+		player.money = account.money;
+		player.banStatus = !!account.ban;
+	}
+	else
+		Log(LOG_WARNING,"CBinaryDatabase::GetUserInfo::User not found!");
+
+	return player;
+}
+
+bool CBinaryDatabase::ReadAccount(const std::string& login, SBinaryAccount& account)
+{
+	unsigned char key[16];
+	GetKey(login.c_str(), key);
+
+	// Lock
+	AcquireSRWLockShared(&lock);
+
+	SBinaryAccount* pAccount = pView ? Find(pLoginIndex, false, key) : NULL;
+	if(pAccount)
+		memcpy(&account, pAccount, sizeof(SBinaryAccount));
+
+	ReleaseSRWLockShared(&lock);
+	// Unlock
+
+	return pAccount != NULL;
+}
+
+bool CBinaryDatabase::Open(const char* fileName)
+{
+	hFile = CreateFile(fileName, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if(hFile == INVALID_HANDLE_VALUE)
+	{
+		Log(LOG_ERROR,"Can't open <%s>!", fileName);
+		return false;
+	}
+
+	LARGE_INTEGER size;
+	if(!GetFileSizeEx(hFile, &size) || size.QuadPart < (LONGLONG)sizeof(SBinaryHeader))
+	{
+		Log(LOG_ERROR,"<%s> is damaged!", fileName);
+		Close();
+		return false;
+	}
+
+	if(!Map())
+	{
+		Close();
+		return false;
+	}
+
+	// File is not changed if it is not ours. Index capacity is power of two
+	unsigned int capacity = pHeader->recordsCapacity;
+	if(pHeader->magic != BINARY_DB_MAGIC || pHeader->version != BINARY_DB_VERSION ||
+		pHeader->recordSize != sizeof(SBinaryAccount) || pHeader->recordsCount > capacity ||
+		capacity < BINARY_DB_MIN_RECORDS || capacity > BINARY_DB_MAX_RECORDS || (capacity & (capacity - 1)) != 0 ||
+		pHeader->indexCapacity != capacity * 2 || size.QuadPart < GetFileSize(capacity))
+	{
+		Log(LOG_ERROR,"<%s> is damaged or has other version!", fileName);
+		Close();
+		return false;
+	}
+
+	// Grow stopped by crash : file is longer, but header has old capacity and old indexes.
+	// Part after them is not used and is cut
+	if(size.QuadPart > GetFileSize(capacity))
+	{
+		Log(LOG_WARNING,"<%s> was not grown completely, new part is removed", fileName);
+
+		size.QuadPart = GetFileSize(capacity);
+		Unmap();
+
+		if(!SetFilePointerEx(hFile, size, NULL, FILE_BEGIN) || !SetEndOfFile(hFile) || !Map())
+		{
+			Log(LOG_ERROR,"Can't restore <%s>!", fileName);
+			Close();
+			return false;
+		}
+	}
+
+	SetPointers();
+	recordsCount = pHeader->recordsCount;
+	return true;
+}
+
+bool CBinaryDatabase::Create(const char* fileName)
+{
+	hFile = CreateFile(fileName, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if(hFile == INVALID_HANDLE_VALUE)
+	{
+		Log(LOG_ERROR,"Can't create <%s>!", fileName);
+		return false;
+	}
+
+	// New file is filled by zeros, so indexes are empty
+	LARGE_INTEGER size;
+	size.QuadPart = GetFileSize(BINARY_DB_MIN_RECORDS);
+	if(!SetFilePointerEx(hFile, size, NULL, FILE_BEGIN) || !SetEndOfFile(hFile))
+	{
+		Log(LOG_ERROR,"Can't set size of <%s>!", fileName);
+		Close();
+		return false;
+	}
+
+	if(!Map())
+	{
+		Close();
+		return false;
+	}
+
+	pHeader->magic = BINARY_DB_MAGIC;
+	pHeader->version = BINARY_DB_VERSION;
+	pHeader->recordSize = sizeof(SBinaryAccount);
+	pHeader->recordsCount = 0;
+	pHeader->recordsCapacity = BINARY_DB_MIN_RECORDS;
+	pHeader->indexCapacity = BINARY_DB_MIN_RECORDS * 2;
+	pHeader->lastPlayerId = 10000000;
+
+	SetPointers();
+	return true;
+}
+
+bool CBinaryDatabase::Import()
+{
+	Log(LOG_INFO,"Importing accounts from Database.xml...");
+
+	// Log of xml database stays closed, it is not changed by import
+	if(!gEnv->pXml->Load())
+	{
+		Log(LOG_ERROR,"Import failed! Can't load Database.xml");
+		return false;
+	}
+
+	std::vector <SXmlAccount> accounts;
+	gEnv->pXml->GetAccounts(accounts);
+
+	std::lock_guard<std::mutex> writeLock(writeMutex);
+
+	for(auto it = accounts.begin(); it != accounts.end(); ++it)
+	{
+		if(it->login.size() >= BINARY_DB_STRING_SIZE || it->password.size() >= BINARY_DB_STRING_SIZE || it->nickname.size() >= BINARY_DB_STRING_SIZE)
+		{
+			Log(LOG_WARNING,"Account <%s> is not imported, login, password or nickname is too long", it->login.c_str());
+			continue;
+		}
+
+		if(!AddAccount(it->login, it->password, it->nickname, it->id, it->level, it->money, it->xp, it->ban))
+		{
+			Log(LOG_ERROR,"Import failed!");
+			return false;
+		}
+
+		// Whole file is flushed after import
+		pHeader->recordsCount++;
+	}
+
+	Log(LOG_INFO,"Imported %d accounts", pHeader->recordsCount);
+	return true;
+}
+
+bool CBinaryDatabase::AddAccount(const std::string& login, const std::string& password, const std::string& nickname, int id, int level, int money, int xp, bool ban)
+{
+	if(pHeader->recordsCount == pHeader->recordsCapacity && !Grow())
+		return false;
+
+	unsigned int record = pHeader->recordsCount;
+	SBinaryAccount* pAccount = &pRecords[record];
+
+	memset(pAccount, 0, sizeof(SBinaryAccount));
+	GetKey(login.c_str(), pAccount->loginKey);
+	GetKey(nickname.c_str(), pAccount->nicknameKey);
+	pAccount->id = id;
+	pAccount->level = level;
+	pAccount->money = money;
+	pAccount->xp = xp;
+	pAccount->ban = ban;
+	strncpy(pAccount->password, password.c_str(), BINARY_DB_STRING_SIZE - 1);
+	strncpy(pAccount->nickname, nickname.c_str(), BINARY_DB_STRING_SIZE - 1);
+	strncpy(pAccount->login, login.c_str(), BINARY_DB_STRING_SIZE - 1);
+
+	Insert(pLoginIndex, pHeader->indexCapacity, pAccount->loginKey, record, pHeader->recordsCount);
+	Insert(pNicknameIndex, pHeader->indexCapacity, pAccount->nicknameKey, record, pHeader->recordsCount);
+
+	if(id > pHeader->lastPlayerId)
+		pHeader->lastPlayerId = id;
+
+	return true;
+}
+
+void CBinaryDatabase::Commit(unsigned int record)
+{
+	SBinaryAccount* pAccount = &pRecords[record];
+
+	FlushViewOfFile(pAccount, sizeof(SBinaryAccount));
+	FlushSlot(pLoginIndex, pAccount->loginKey, record);
+	FlushSlot(pNicknameIndex, pAccount->nicknameKey, record);
+	FlushFileBuffers(hFile);
+
+	pHeader->recordsCount++;
+	FlushViewOfFile(pHeader, sizeof(SBinaryHeader));
+	FlushFileBuffers(hFile);
+
+	// Record is used from here, readers see it after its writes
+	recordsCount.store(pHeader->recordsCount, std::memory_order_release);
+}
+
+void CBinaryDatabase::FlushSlot(SBinarySlot* index, const unsigned char* key, unsigned int record)
+{
+	unsigned int tag;
+	memcpy(&tag, key, 4);
+
+	unsigned int mask = pHeader->indexCapacity - 1;
+
+	for(unsigned int slot = tag & mask; index[slot].record != 0; slot = (slot + 1) & mask)
+	{
+		if(index[slot].record == record + 1)
+		{
+			FlushViewOfFile(&index[slot], sizeof(SBinarySlot));
+			return;
+		}
+	}
+}
+
+bool CBinaryDatabase::Map()
+{
+	hMapping = CreateFileMapping(hFile, NULL, PAGE_READWRITE, 0, 0, NULL);
+	if(hMapping == NULL)
+	{
+		Log(LOG_ERROR,"Can't map account file!");
+		return false;
+	}
+
+	pView = (unsigned char*)MapViewOfFile(hMapping, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+	if(pView == NULL)
+	{
+		Log(LOG_ERROR,"Can't map account file!");
+		CloseHandle(hMapping);
+		hMapping = NULL;
+		return false;
+	}
+
+	pHeader = (SBinaryHeader*)pView;
+	return true;
+}
+
+void CBinaryDatabase::Unmap()
+{
+	if(pView)
+		UnmapViewOfFile(pView);
+
+	if(hMapping)
+		CloseHandle(hMapping);
+
+	pView = NULL;
+	hMapping = NULL;
+	pHeader = NULL;
+	pRecords = NULL;
+	pLoginIndex = NULL;
+	pNicknameIndex = NULL;
+}
+
+void CBinaryDatabase::Close()
+{
+	Unmap();
+
+	if(hFile != INVALID_HANDLE_VALUE)
+		CloseHandle(hFile);
+	hFile = INVALID_HANDLE_VALUE;
+}
+
+void CBinaryDatabase::SetPointers()
+{
+	pRecords = (SBinaryAccount*)(pView + sizeof(SBinaryHeader));
+	pLoginIndex = (SBinarySlot*)(pRecords + pHeader->recordsCapacity);
+	pNicknameIndex = pLoginIndex + pHeader->indexCapacity;
+}
+
+bool CBinaryDatabase::Grow()
+{
+	if(pHeader->recordsCapacity >= BINARY_DB_MAX_RECORDS)
+	{
+		Log(LOG_ERROR,"Accounts.dat has most accounts it can hold!");
+		return false;
+	}
+
+	unsigned int capacity = pHeader->recordsCapacity * 2;
+	unsigned int indexCapacity = capacity * 2;
+	unsigned int count = pHeader->recordsCount;
+
+	Log(LOG_INFO,"Growing Accounts.dat to %d accounts", capacity);
+
+	// Lock. Readers wait while file is remapped
+	AcquireSRWLockExclusive(&lock);
+
+	Unmap();
+
+	LARGE_INTEGER size;
+	size.QuadPart = GetFileSize(capacity);
+	if(!SetFilePointerEx(hFile, size, NULL, FILE_BEGIN) || !SetEndOfFile(hFile) || !Map())
+	{
+		Log(LOG_ERROR,"Can't grow Accounts.dat!");
+		if(!pView)
+			Map();
+		if(pView)
+			SetPointers();
+
+		ReleaseSRWLockExclusive(&lock);
+		// Unlock
+		return false;
+	}
+
+	// Records stay in place. New indexes are after old ones, header still
+	// has old capacity until they are on disk. If crash comes before header,
+	// Open cuts file back to old capacity
+	SBinaryAccount* records = (SBinaryAccount*)(pView + sizeof(SBinaryHeader));
+	SBinarySlot* loginIndex = (SBinarySlot*)(records + capacity);
+	SBinarySlot* nicknameIndex = loginIndex + indexCapacity;
+
+	for(unsigned int i = 0; i < count; i++)
+	{
+		Insert(loginIndex, indexCapacity, records[i].loginKey, i, count);
+		Insert(nicknameIndex, indexCapacity, records[i].nicknameKey, i, count);
+	}
+
+	FlushViewOfFile(loginIndex, indexCapacity * 2 * sizeof(SBinarySlot));
+	FlushFileBuffers(hFile);
+
+	pHeader->recordsCapacity = capacity;
+	pHeader->indexCapacity = indexCapacity;
+	FlushViewOfFile(pHeader, sizeof(SBinaryHeader));
+	FlushFileBuffers(hFile);
+
+	SetPointers();
+
+	ReleaseSRWLockExclusive(&lock);
+	// Unlock
+	return true;
+}
+
+LONGLONG CBinaryDatabase::GetFileSize(unsigned int recordsCapacity)
+{
+	return (LONGLONG)sizeof(SBinaryHeader) + (LONGLONG)recordsCapacity * (sizeof(SBinaryAccount) + 2 * 2 * sizeof(SBinarySlot));
+}
+
+void CBinaryDatabase::GetKey(const char* value, unsigned char* key)
+{
+	MD5 md5;
+	md5.digestString((char*)value);
+	memcpy(key, md5.digestRaw, 16);
+}
+
+SBinaryAccount* CBinaryDatabase::Find(SBinarySlot* index, bool bNickname, const unsigned char* key)
+{
+	unsigned int tag;
+	memcpy(&tag, key, 4);
+
+	unsigned int mask = pHeader->indexCapacity - 1;
+	unsigned int count = recordsCount.load(std::memory_order_acquire);
+
+	// Table is at most half full, so empty slot always ends probing
+	for(unsigned int slot = tag & mask; index[slot].record != 0; slot = (slot + 1) & mask)
+	{
+		// Slots of records after count are left by crash or written by register now
+		if(index[slot].tag != tag || index[slot].record > count)
+			continue;
+
+		SBinaryAccount* pAccount = &pRecords[index[slot].record - 1];
+		if(!memcmp(bNickname ? pAccount->nicknameKey : pAccount->loginKey, key, 16))
+			return pAccount;
+	}
+
+	return NULL;
+}
+
+void CBinaryDatabase::Insert(SBinarySlot* index, unsigned int capacity, const unsigned char* key, unsigned int record, unsigned int recordsCount)
+{
+	unsigned int tag;
+	memcpy(&tag, key, 4);
+
+	unsigned int mask = capacity - 1;
+	unsigned int slot = tag & mask;
+
+	while(index[slot].record != 0 && index[slot].record <= recordsCount)
+		slot = (slot + 1) & mask;
+
+	index[slot].tag = tag;
+	index[slot].record = record + 1;
+}
@@ -0,0 +1,129 @@
+/*************************************************************************
+Copyright (C), chernecoff@gmail.com, 2014-2015
+--------------------------------------------------------------------------
+History:
+
+- 16.10.2026   23:51 : Created by agent
+-------------------------------------------------------------------------
+Accounts.dat : accounts in fixed size records, mapped in memory, so it
+is opened without parsing.
+header | records[capacity] | login index[2 * capacity] |
+nickname index[2 * capacity]
+Indexes are open addressing tables with linear probing, keyed by MD5 of
+login (same key as Player_<md5> of Database.xml) and MD5 of nickname.
+Slot keeps first 4 bytes of key, so login needs one slot line and one
+record. Tables are at most half full, file is grown twice when records
+are full. Count in header is written last, records and slots after it
+are not used.
+Login and user info don't wait for flushes of register : register goes
+alone under write mutex and publishes count after its record is on disk,
+readers take shared lock, only growing file takes it exclusive.
+*************************************************************************/
+
+#ifndef _BinaryDatabase_
+#define _BinaryDatabase_
+
+#define BINARY_DB_MAGIC 0x43414E46          // FNAC
+#define BINARY_DB_VERSION 1
+#define BINARY_DB_STRING_SIZE 64
+#define BINARY_DB_MIN_RECORDS 1024
+// Index capacity is twice bigger and must fit unsigned int
+#define BINARY_DB_MAX_RECORDS 0x40000000
+
+#pragma pack(push, 1)
+// One cache line
+struct SBinaryHeader
+{
+	unsigned int magic;
+	unsigned int version;
+	unsigned int recordSize;
+	unsigned int recordsCount;
+	unsigned int recordsCapacity;
+	unsigned int indexCapacity;             // Power of two
+	int lastPlayerId;
+	unsigned char reserved[36];
+};
+
+// 8 slots in cache line
+struct SBinarySlot
+{
+	unsigned int tag;                       // First 4 bytes of key
+	unsigned int record;                    // Record number + 1, 0 - empty slot
+};
+
+// Fields used by login are in first 2 cache lines
+struct SBinaryAccount
+{
+	unsigned char loginKey[16];
+	unsigned char nicknameKey[16];
+	int id;
+	int level;
+	int money;
+	int xp;
+	int ban;
+	char password[BINARY_DB_STRING_SIZE];
+	char nickname[BINARY_DB_STRING_SIZE];
+	char login[BINARY_DB_STRING_SIZE];
+	unsigned char reserved[12];
+};
+#pragma pack(pop)
+
+class CBinaryDatabase : public IAccountStore
+{
+public:
+	CBinaryDatabase();
+	~CBinaryDatabase();
+
+	void Init();
+
+	const char* Register(std::string login, std::string password, std::string nickName);
+	const char* Login(std::string login, std::string password);
+	SClient GetUserInfo(std::string login);
+
+private:
+	bool Open(const char* fileName);
+	bool Create(const char* fileName);
+	// Accounts of Database.xml and its log, false if some are not imported
+	bool Import();
+
+	bool Map();
+	void Unmap();
+	// Unmap and close file
+	void Close();
+	void SetPointers();
+	bool Grow();
+	// Record and slots are on disk before count
+	void Commit(unsigned int record);
+	void FlushSlot(SBinarySlot* index, const unsigned char* key, unsigned int record);
+
+	// 64 bit, file passes 4 GB at about 14.9 millions of records
+	static LONGLONG GetFileSize(unsigned int recordsCapacity);
+	static void GetKey(const char* value, unsigned char* key);
+
+	// Copy of account under shared lock, false if login is not found
+	bool ReadAccount(const std::string& login, SBinaryAccount& account);
+	// Record of key, NULL if it is not found
+	SBinaryAccount* Find(SBinarySlot* index, bool bNickname, const unsigned char* key);
+	static void Insert(SBinarySlot* index, unsigned int capacity, const unsigned char* key, unsigned int record, unsigned int recordsCount);
+
+	// Record and slots, count is not changed. False if file can't grow
+	bool AddAccount(const std::string& login, const std::string& password, const std::string& nickname, int id, int level, int money, int xp, bool ban);
+
+	HANDLE hFile;
+	HANDLE hMapping;
+	unsigned char* pView;
+
+	SBinaryHeader* pHeader;
+	SBinaryAccount* pRecords;
+	SBinarySlot* pLoginIndex;
+	SBinarySlot* pNicknameIndex;
+
+	// Registers one by one
+	std::mutex writeMutex;
+	// Readers share it, file remap takes it exclusive
+	SRWLOCK lock;
+	// Count of records on disk, readers don't see records after it
+	std::atomic<unsigned int> recordsCount;
+};
+
+#endif
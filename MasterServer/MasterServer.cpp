@@ -35,8 +35,22 @@ int MasterServerInit()
 	gEnv->maxPlayers = atoi(gEnv->pSettings->GetConfigValue("Server","max_players"));
 	gEnv->maxGameServers = atoi(gEnv->pSettings->GetConfigValue("Server","max_gameservers"));
 	gEnv->bUseXml = !!atoi(gEnv->pSettings->GetConfigValue("Server","use_xml"));
+	gEnv->bUseBinary = !!atoi(gEnv->pSettings->GetConfigValue("Server","use_binary"));
+	// Session key or AES-GCM costs one encode pass of every broadcast per client,
+	// compaction, compression and chunk split are still done once per broadcast
+	gEnv->bSessionKeys = !!atoi(gEnv->pSettings->GetConfigValue("Server","session_keys"));
+	gEnv->bAead = !!atoi(gEnv->pSettings->GetConfigValue("Server","aead"));
+	gEnv->bProtocolV2 = !!atoi(gEnv->pSettings->GetConfigValue("Server","protocol_v2"));
+	// Checksum stays on for config written before it was added
+	gEnv->bVerifyChecksum = !!gEnv->pSettings->GetConfigInt("Server","verify_checksum",1);
+	gEnv->compressionThreshold = atoi(gEnv->pSettings->GetConfigValue("Server","compression_threshold"));
 	gEnv->serverVersion = PACKET_VERSION;
 
+	// Blowfish key schedules are built once for all packets
+	CBlowfishKey::InitStaticKeys(gEnv->pSettings->GetConfigValue("Server","securityKey"));
+	// Outbound frame buffers, size in kb cached by each size class
+	CFramePool::Init(atoi(gEnv->pSettings->GetConfigValue("Server","frame_pool_size")) * 1024);
+
 
 
 	Log(LOG_INFO,"FireNET - MasterServer v.%s started!", gEnv->serverVersion);
@@ -45,14 +59,26 @@ int MasterServerInit()
 		Log(LOG_WARNING,"************ THIS'S DEBUG MODE ************");
 
 
-	if(gEnv->bUseXml)
+	if(gEnv->bUseBinary)
+	{
+		Log(LOG_INFO,"Using binary account file instead of MySql...");
+		gEnv->pAccounts = gEnv->pBinary;
+		gEnv->pAccounts->Init();
+		gEnv->pServer->Start();
+	}
+	else if(gEnv->bUseXml)
 	{
 		Log(LOG_INFO,"Using XML instead of MySql...");
-		gEnv->pXml->Init();
+		gEnv->pAccounts = gEnv->pXml;
+		gEnv->pAccounts->Init();
 		gEnv->pServer->Start();
 	}
 	else
 	{
+		// MySql has no account store, accounts are kept by xml database as before
+		gEnv->pAccounts = gEnv->pXml;
+		gEnv->pAccounts->Init();
+
 		if(gEnv->pMySql->MySqlConnect())
 			gEnv->pServer->Start();
 		else
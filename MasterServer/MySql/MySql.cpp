@@ -115,7 +115,9 @@ SClient CMySql::Logining(SOCKET ClientSocket, const char *login,  const char *pa
 					Log(LOG_DEBUG, "Password correct!");
 
 					// Block dual autorization
-					for (auto it = gEnv->pServer->vClients.begin(); it != gEnv->pServer->vClients.end(); ++it)
+					CSessionSnapshot snapshot;
+					gEnv->pServer->clients.GetSnapshot(snapshot);
+					for (auto it = snapshot.sessions.begin(); it != snapshot.sessions.end(); ++it)
 					{
 						/*
 						if(pId == block)
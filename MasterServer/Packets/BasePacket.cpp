@@ -11,6 +11,7 @@ History:
 #include "StdAfx.h"
 #include "BasePacket.h"
 #include <memory>
+#include "..\..\Common\Varint.h"
 
 BasePacket::BasePacket()
 {
@@ -97,112 +98,91 @@ bool BasePacket::ensureCanWriteBytes( unsigned int nBytes )
 	return true;
 }
 
-void BasePacket::writeChar( char c )
+void BasePacket::_writeRaw( const void *bytes, unsigned int len )
 {
-	if( !this->ensureCanWriteBytes( 1 ) ) return;
-	this->b.setByteAt( this->write_ptr, (unsigned char)c );
-	this->write_ptr++;
-	this->real_size++;
-	this->datasize++;
+	if( !this->ensureCanWriteBytes( len ) ) return;
+	memcpy( b.getBytesPtr() + this->write_ptr, bytes, len );
+	this->write_ptr += len;
+	this->real_size += len;
+	this->datasize  += len;
 
 	unsigned short psize = (unsigned short)real_size;
-	unsigned char *psaddr = (unsigned char *)&psize;
-	b.setByteAt( 0, psaddr[0] );
-	b.setByteAt( 1, psaddr[1] );
+	b.setByteAt( 0, (unsigned char)((psize)      & 0xff) );
+	b.setByteAt( 1, (unsigned char)((psize >> 8) & 0xff) );
 }
 
-void BasePacket::writeUChar( unsigned char c )
+void BasePacket::writeChar( char c )
 {
-	if( !this->ensureCanWriteBytes( 1 ) ) return;
-	this->b.setByteAt( this->write_ptr, c );
-	this->write_ptr++;
-	this->real_size++;
-	this->datasize++;
+	this->_writeRaw( &c, 1 );
+}
 
-	unsigned short psize = (unsigned short)real_size;
-	unsigned char *psaddr = (unsigned char *)&psize;
-	b.setByteAt( 0, psaddr[0] );
-	b.setByteAt( 1, psaddr[1] );
+void BasePacket::writeUChar( unsigned char c )
+{
+	this->_writeRaw( &c, 1 );
 }
 
 void BasePacket::writeBytes( const unsigned char *bytes, unsigned int len )
 {
 	if( !bytes || (len<1) ) return;
-	unsigned int i;
-	for( i=0; i<len; i++ ) this->writeUChar( bytes[i] );
+	this->_writeRaw( bytes, len );
 }
 
 void BasePacket::writeShort( short int s )
 {
-	char leftByte = (char)(s & 0x00FF);
-	char rightByte = (char)( (s & 0xFF00) >> 8 );
-	this->writeChar( leftByte );
-	this->writeChar( rightByte );
+	char sb[2];
+	sb[0] = (char)(s & 0x00FF);
+	sb[1] = (char)( (s & 0xFF00) >> 8 );
+	this->_writeRaw( sb, 2 );
 }
 
 void BasePacket::writeUShort( unsigned short int s )
 {
-	unsigned char leftByte  = (unsigned char)(  s & (unsigned short)0x00FF);
-	unsigned char rightByte = (unsigned char)( (s & (unsigned short)0xFF00) >> 8 );
-	this->writeUChar( leftByte );
-	this->writeUChar( rightByte );
+	unsigned char sb[2];
+	sb[0] = (unsigned char)(  s & (unsigned short)0x00FF);
+	sb[1] = (unsigned char)( (s & (unsigned short)0xFF00) >> 8 );
+	this->_writeRaw( sb, 2 );
 }
 
 void BasePacket::writeInt( int i )
 {
-	char b1 = (char)(  i & (int)0x000000FF);
-	char b2 = (char)( (i & (int)0x0000FF00) >> 8 );
-	char b3 = (char)( (i & (int)0x00FF0000) >> 16 );
-	char b4 = (char)( (i & (int)0xFF000000) >> 24 );
-	this->writeChar( b1 );
-	this->writeChar( b2 );
-	this->writeChar( b3 );
-	this->writeChar( b4 );
+	char ib[4];
+	ib[0] = (char)(  i & (int)0x000000FF);
+	ib[1] = (char)( (i & (int)0x0000FF00) >> 8 );
+	ib[2] = (char)( (i & (int)0x00FF0000) >> 16 );
+	ib[3] = (char)( (i & (int)0xFF000000) >> 24 );
+	this->_writeRaw( ib, 4 );
 }
 
 void BasePacket::writeUInt( unsigned int i )
 {
-	unsigned char b1 = (unsigned char)(  i & (unsigned int)0x000000FF);
-	unsigned char b2 = (unsigned char)( (i & (unsigned int)0x0000FF00) >> 8 );
-	unsigned char b3 = (unsigned char)( (i & (unsigned int)0x00FF0000) >> 16 );
-	unsigned char b4 = (unsigned char)( (i & (unsigned int)0xFF000000) >> 24 );
-	this->writeUChar( b1 );
-	this->writeUChar( b2 );
-	this->writeUChar( b3 );
-	this->writeUChar( b4 );
+	unsigned char ib[4];
+	ib[0] = (unsigned char)(  i & (unsigned int)0x000000FF);
+	ib[1] = (unsigned char)( (i & (unsigned int)0x0000FF00) >> 8 );
+	ib[2] = (unsigned char)( (i & (unsigned int)0x00FF0000) >> 16 );
+	ib[3] = (unsigned char)( (i & (unsigned int)0xFF000000) >> 24 );
+	this->_writeRaw( ib, 4 );
 }
 
 void BasePacket::writeInt64( long long int i64 )
 {
-	char *i64b = (char *)(&i64);
-	unsigned int i;
-	for( i=0; i<sizeof(long long int); i++ ) this->writeChar( i64b[i] );
+	this->_writeRaw( &i64, sizeof(long long int) );
 }
 
 void BasePacket::writeUInt64( unsigned long long int i64 )
 {
-	unsigned char *i64b = (unsigned char *)(&i64);
-	unsigned int i;
-	for( i=0; i<sizeof(unsigned long long int); i++ ) this->writeUChar( i64b[i] );
+	this->_writeRaw( &i64, sizeof(unsigned long long int) );
 }
 
 void BasePacket::writeDouble( double d )
 {
-	char *pd = (char *)(&d);
-	unsigned int i;
-	for( i=0; i<sizeof(double); i++ ) this->writeChar( pd[i] );
+	this->_writeRaw( &d, sizeof(double) );
 }
 
 void BasePacket::writeString( const char *str )
 {
 	if( !str ) return;
-	char *p = (char *)str;
-	while( (*p) )
-	{
-		this->writeChar( (*p) );
-		p++;
-	}
-	this->writeChar( 0 );
+	// With terminating zero
+	this->_writeRaw( str, (unsigned int)strlen( str ) + 1 );
 }
 
 void BasePacket::writeUnicodeString( const wchar_t *ustr )
@@ -390,6 +370,44 @@ char *BasePacket::readString()
 	return NULL;
 }
 
+unsigned int BasePacket::readVarUInt()
+{
+	unsigned int ret = 0;
+	unsigned int count = 0;
+	if( read_ptr < real_size )
+		count = VarintRead( b.getBytesPtr() + read_ptr, real_size - read_ptr, ret );
+	if( count == 0 )
+	{
+		// Broken field ends reading
+		read_ptr = real_size;
+		return 0;
+	}
+	read_ptr += count;
+	return ret;
+}
+
+int BasePacket::readVarInt()
+{
+	return ZigZagDecode( readVarUInt() );
+}
+
+char *BasePacket::readLString()
+{
+	// Broken length leaves nothing to read
+	unsigned int str_len = readVarUInt();
+	if( str_len > VARINT_MAX_STRING || !canReadBytes( str_len + 1 ) ||
+		b.getByteAt( read_ptr + str_len ) != 0 )
+	{
+		this->read_ptr = real_size;
+		return NULL;
+	}
+	char *str = (char *)malloc( str_len+1 );
+	if( !str ) return NULL;
+	memcpy( str, b.getBytesPtr() + read_ptr, str_len+1 );
+	this->read_ptr += str_len+1;
+	return str;
+}
+
 wchar_t *BasePacket::readUnicodeString()
 {
 	unsigned int save_read_ptr = this->read_ptr;
@@ -16,6 +16,9 @@ History:
 
 class BasePacket
 {
+	// Writes body directly to buffer
+	friend class CPacketBuilder;
+
 public:
 	BasePacket();
 	BasePacket( const unsigned char *bytes, unsigned int length );
@@ -32,6 +35,8 @@ public:
 	virtual unsigned char  getPacketType() { readReset(); return readUChar(); }
 	virtual unsigned short getPacketSize() const { return (unsigned short)(this->real_size); }
 	virtual unsigned short getDataSize() const { return (unsigned short)(this->datasize); }
+	// Full size, message can be bigger than 2-byte length header
+	virtual unsigned int   getMessageSize() const { return this->real_size; }
 
 public: 
 	virtual bool           ensureCanWriteBytes( unsigned int nBytes );
@@ -61,6 +66,10 @@ public:
 	virtual unsigned long long int readUInt64();
 	virtual double         readDouble();
 	virtual char          *readString();
+	// Protocol v2 fields, see Varint.h. Broken field gives 0 or NULL
+	virtual unsigned int   readVarUInt();
+	virtual int            readVarInt();
+	virtual char          *readLString();
 	virtual wchar_t       *readUnicodeString();
 	virtual const wchar_t *readUnicodeStringPtr();
 	virtual bool           readBytes( unsigned char *bytes, unsigned int num );
@@ -85,6 +94,9 @@ public:
 	
 public:
 	virtual const unsigned char *getBytesPtr() const;
+protected:
+	// Copy bytes, grow buffer once and update length header once
+	void _writeRaw( const void *bytes, unsigned int len );
 protected:
 	virtual void _initNull();
 	virtual bool _preAllocateBuffer();
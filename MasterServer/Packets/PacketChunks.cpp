@@ -0,0 +1,151 @@
+/*************************************************************************
+Copyright (C), chernecoff@gmail.com, 2014-2015
+--------------------------------------------------------------------------
+History:
+
+- 16.10.2026   22:58 : Created by agent
+-------------------------------------------------------------------------
+
+*************************************************************************/
+#include "StdAfx.h"
+#include <memory>
+#include "PacketChunks.h"
+#include "Packets.h"
+#include "PacketBuilder.h"
+#include "..\..\Common\PacketView.h"
+#include "RSP.h"
+
+CPacketChunks::CPacketChunks(unsigned int maxSize)
+{
+	buffer = NULL;
+	maxMessageSize = maxSize;
+	messageSize = 0;
+	received = 0;
+}
+
+CPacketChunks::~CPacketChunks()
+{
+	Reset();
+}
+
+void CPacketChunks::Reset()
+{
+	delete[] buffer;
+	buffer = NULL;
+	messageSize = 0;
+	received = 0;
+}
+
+void CPacketChunks::Split(const unsigned char* message, unsigned int size, const char* version, bool bProtocolV2, std::vector <Packet*>& chunks)
+{
+	// Length header of message is not sent, receiver makes new one
+	for(unsigned int offset = 2; offset < size; offset += PACKET_CHUNK_SIZE)
+	{
+		unsigned int chunkSize = size - offset;
+		if(chunkSize > PACKET_CHUNK_SIZE)
+			chunkSize = PACKET_CHUNK_SIZE;
+
+		Packet* p = new Packet();
+		CPacketBuilder pb(p, chunkSize + 64);
+
+		SchemaWriteHeader(pb, PACKET_CHUNK, version, bProtocolV2); // Packet type and version or opcode
+
+		pb.WriteUInt(size);                                      // Message size
+		pb.WriteUInt(offset);                                    // Chunk offset
+		pb.WriteUInt(chunkSize);                                 // Chunk size
+		pb.WriteBytes(message + offset, chunkSize);              // Chunk
+
+		SchemaWriteEnd(pb, bProtocolV2);                         // End block
+
+		pb.Finish();
+
+		chunks.push_back(p);
+	}
+}
+
+bool CPacketChunks::Accept(unsigned int size, unsigned int offset, unsigned int chunkSize)
+{
+	// First chunk starts new message, chunk after lost chunk drops message
+	if(offset == 2)
+	{
+		Reset();
+
+		if(size <= 2 || size > maxMessageSize)
+			return false;
+
+		buffer = new unsigned char [size];
+		messageSize = size;
+		received = 2;
+	}
+
+	if(buffer == NULL || size != messageSize || offset != received ||
+		chunkSize == 0 || chunkSize > messageSize - received)
+	{
+		Reset();
+		return false;
+	}
+
+	return true;
+}
+
+Packet* CPacketChunks::Add(Packet* pChunk)
+{
+	unsigned int size = pChunk->readUInt();                      // Message size
+	unsigned int offset = pChunk->readUInt();                    // Chunk offset
+	unsigned int chunkSize = pChunk->readUInt();                 // Chunk size
+
+	if(!Accept(size, offset, chunkSize))
+		return NULL;
+
+	if(!pChunk->canReadBytes(chunkSize))
+	{
+		Reset();
+		return NULL;
+	}
+
+	pChunk->readBytes(buffer + offset, chunkSize);
+	received += chunkSize;
+
+	if(received < messageSize)
+		return NULL;
+
+	Packet* pMessage = new Packet(buffer, messageSize);
+	Reset();
+
+	return pMessage;
+}
+
+unsigned char* CPacketChunks::Add(CPacketView& chunk, unsigned int& size)
+{
+	unsigned int offset = 0;
+	unsigned int chunkSize = 0;
+
+	if(!chunk.ReadUInt(size) ||                                  // Message size
+		!chunk.ReadUInt(offset) ||                               // Chunk offset
+		!chunk.ReadUInt(chunkSize))                              // Chunk size
+	{
+		Reset();
+		return NULL;
+	}
+
+	if(!Accept(size, offset, chunkSize))
+		return NULL;
+
+	if(!chunk.ReadBytes(buffer + offset, chunkSize))
+	{
+		Reset();
+		return NULL;
+	}
+
+	received += chunkSize;
+
+	if(received < messageSize)
+		return NULL;
+
+	// Buffer goes to caller without copy
+	unsigned char* pMessage = buffer;
+	buffer = NULL;
+	Reset();
+
+	return pMessage;
+}
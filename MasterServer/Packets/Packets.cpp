@@ -13,20 +13,17 @@ History:
 #include <memory>
 #include <openssl\blowfish.h>
 #include "PacketDebugger.h"
+#include "..\..\Common\Checksum.h"
 
 
 Packet::Packet()
 {
 	_initNull();
-	NEW_BLOWFISH_KEY_LEN = 0;
-	memset( (void *)NEW_BLOWFISH_KEY, 0, sizeof(NEW_BLOWFISH_KEY) );
 }
 
 Packet::Packet( const unsigned char *bytes, unsigned int length )
 {
 	_initNull();
-	NEW_BLOWFISH_KEY_LEN = 0;
-	memset( (void *)NEW_BLOWFISH_KEY, 0, sizeof(NEW_BLOWFISH_KEY) );
 	this->setBytes( bytes, length );
 }
 
@@ -39,120 +36,49 @@ void Packet::_initNull()
 {
 	BasePacket::_initNull();
 
-	// You super strong key here
-	static const unsigned char* statickey = (const unsigned char*)gEnv->pSettings->GetConfigValue("Server","securityKey");
-	memcpy(STATIC_BLOWFISH_KEY, statickey, 64);
-
-	/*STATIC_BLOWFISH_KEY[0]  = 0x6B;
-	STATIC_BLOWFISH_KEY[1]  = 0x60;
-	STATIC_BLOWFISH_KEY[2]  = 0xCB;
-	STATIC_BLOWFISH_KEY[3]  = 0x5B;
-	STATIC_BLOWFISH_KEY[4]  = 0x82;
-	STATIC_BLOWFISH_KEY[5]  = 0xCE;
-	STATIC_BLOWFISH_KEY[6]  = 0x90;
-	STATIC_BLOWFISH_KEY[7]  = 0xB1;
-	STATIC_BLOWFISH_KEY[8]  = 0xCC;
-	STATIC_BLOWFISH_KEY[9]  = 0x2B;
-	STATIC_BLOWFISH_KEY[10] = 0x6C;
-	STATIC_BLOWFISH_KEY[11] = 0x55;
-	STATIC_BLOWFISH_KEY[12] = 0x6C;
-	STATIC_BLOWFISH_KEY[13] = 0x6C;
-	STATIC_BLOWFISH_KEY[14] = 0x6C;
-	STATIC_BLOWFISH_KEY[15] = 0x6C;*/
-	STATIC_BLOWFISH_KEY_LEN = 64;
+	// Key schedules are prepared once by CBlowfishKey::InitStaticKeys
+	pDynamicKey = NULL;
 	xor_key = 0;
 }
 
 bool Packet::decodeBlowfish( bool bUseStaticBFKey )
+{
+	if( bUseStaticBFKey )
+		return decodeBlowfish( CBlowfishKey::GetStaticKey() );
+
+	return decodeBlowfish( pDynamicKey ? pDynamicKey : CBlowfishKey::GetDefaultKey() );
+}
+
+bool Packet::decodeBlowfish( const CBlowfishKey *pKey )
 {
 	int blen = (int)getPacketSize();
-	int datalen = blen - 2;
-	int n8bc = datalen / 8;
-	int rest = datalen - n8bc*8;
-	if( rest > 0 ) rest = 8;    
-	int newdatalen = datalen + rest;
-	int newbuflen = newdatalen + 2;
-	if( blen < 1 ) return false;
+	if( blen < 1 || !pKey ) return false;
 	
 	unsigned char *buf = b.getBytesPtr();
 	if( !buf ) return false;
-	
-	BF_KEY bfkey;
-	if( bUseStaticBFKey )
-		BF_set_key( &bfkey, (int)this->STATIC_BLOWFISH_KEY_LEN,
-			this->STATIC_BLOWFISH_KEY );
-	else
-		BF_set_key( &bfkey, (int)this->NEW_BLOWFISH_KEY_LEN,
-			this->NEW_BLOWFISH_KEY );
-	
-	int offset = 0;
-	int nPasses = 0;
-
-	unsigned char outbuf [1024];
-
-/*	if( !outbuf )
-	{
-		return false;
-	}
-*/
-	memset( outbuf, 0, newbuflen );
-	outbuf[0] = buf[0];
-	outbuf[1] = buf[1];
 
-	nPasses = 0;
-	for( offset=2; offset<newdatalen; offset+=8 )
-	{
-		unsigned char data[8] = {0,0,0,0,0,0,0,0};
-		memcpy( data, buf+offset, 8 );
-		BF_decrypt( (BF_LONG *)data, &bfkey );
-		memcpy( outbuf+offset, data, 8 );
-		nPasses++;
-	}	
-	this->setBytes( outbuf, blen );
+	// Decoded in place, only whole blocks. Tail is checksum and zero bytes
+	pKey->Decode( buf, (unsigned int)blen );
 	
 	return true;
 }
 
-bool Packet::setDynamicBFKey( unsigned char *newKey, unsigned int newKeyLen )
+bool Packet::setDynamicBFKey( const CBlowfishKey *pKey )
 {
-	if( !newKey ) return false;
-	if( newKeyLen < 1 ) return false;
-	memcpy( this->NEW_BLOWFISH_KEY, newKey, newKeyLen );
-	this->NEW_BLOWFISH_KEY_LEN = newKeyLen;
+	if( !pKey ) return false;
+	this->pDynamicKey = pKey;
 	return true;
 }
 
-bool Packet::decodeBlowfish( unsigned char *blowfishKey )
-{
-	setDynamicBFKey( blowfishKey, 16 );
-	return decodeBlowfish( false );
-}
-
 
 
 bool Packet::appendChecksum( bool append4bytes )
 {
 	unsigned char *raw = b.getBytesPtr();
-	int size = (int)this->real_size;
-	unsigned int chksum = 0;
-	int count = size;
-	unsigned int ecx = 0;
-	int i = 0;
-	int offset = 2;
-	for( i = offset; i<count; i+=4 )
-	{
-		ecx  = (raw[i])           & 0x000000ff;
-		ecx |= (raw[i+1] << 0x08) & 0x0000ff00;
-		ecx |= (raw[i+2] << 0x10) & 0x00ff0000;
-		ecx |= (raw[i+3] << 0x18) & 0xff000000;
+	if( !raw || real_size < 2 ) return false;
 
-		chksum ^= ecx;
-	}
-
-	ecx  = raw[i]           & 0x000000ff;
-	ecx |= raw[i+1] << 0x08 & 0x0000ff00;
-	ecx |= raw[i+2] << 0x10 & 0x00ff0000;
-	ecx |= raw[i+3] << 0x18 & 0xff000000;
+	// Words after length header, packet is already padded
+	unsigned int chksum = PacketChecksum( raw + 2, real_size - 2 );
 
 	writeUChar( (unsigned char)((chksum)         & 0xff) );
 	writeUChar( (unsigned char)((chksum >> 0x08) & 0xff) );
@@ -171,35 +97,27 @@ bool Packet::appendChecksum( bool append4bytes )
 
 bool Packet::verifyBytesChecksum( const unsigned char *bytes, unsigned int offset, unsigned int size )
 {
-	if( !bytes || (size<8) ) return false;
-	if( size % 4 != 0 ) return false;
-
-	unsigned int chksum = 0;
-	unsigned int count = size-4;
-	unsigned int check = 0xFFFFFFFF;
-	unsigned int i = 0;
-	//
-	for( i=offset; i<count; i+=4 )
-	{
-		check = bytes[i] & 0xFF;
-		check |= (bytes[i+1] << 8) & 0xFF00;
-		check |= (bytes[i+2] << 16) & 0xFF0000;
-		check |= (bytes[i+3] << 24) & 0xFF000000;
-		chksum ^= check;
-	}
-	check = bytes[i] & 0xFF;
-	check |= (bytes[i+1] << 8) & 0xFF00;
-	check |= (bytes[i+2] << 16) & 0xFF0000;
-	check |= (bytes[i+3] << 24) & 0xFF000000;
-	//
+	if( !bytes || (size<8) || (offset>size-4) ) return false;
+	if( (size-offset) % 4 != 0 ) return false;
+
+	unsigned int chksum = PacketChecksum( bytes+offset, size-4-offset );
+	unsigned int check = (unsigned int)bytes[size-4] | ((unsigned int)bytes[size-3] << 8) |
+		((unsigned int)bytes[size-2] << 16) | ((unsigned int)bytes[size-1] << 24);
+
 	return (check == chksum);
 }
 
+bool Packet::verifyEncodedChecksum( const unsigned char *bytes, unsigned int size )
+{
+	// Length header | encoded 8 byte blocks | checksum | 8 bytes
+	if( !bytes || (size<2+12) || ((size-2-12) % 8 != 0) ) return false;
+
+	return Packet::verifyBytesChecksum( bytes, 2, size-8 );
+}
+
 bool Packet::verifyChecksum() const
 {
-	const unsigned char *bytes = getBytesPtr();
-	unsigned int data_len = getDataSize();
-	return Packet::verifyBytesChecksum( bytes, 2, data_len );
+	return Packet::verifyEncodedChecksum( getBytesPtr(), getMessageSize() );
 }
 
 bool Packet::padPacketTo8ByteLen()
@@ -231,52 +149,37 @@ bool Packet::appendMore8Bytes()
 }
 
 bool Packet::encodeBlowfish( bool bUseStaticBFKey )
+{
+	if( bUseStaticBFKey )
+		return encodeBlowfish( CBlowfishKey::GetStaticKey() );
+
+	return encodeBlowfish( pDynamicKey ? pDynamicKey : CBlowfishKey::GetDefaultKey() );
+}
+
+bool Packet::encodeBlowfish( const CBlowfishKey *pKey )
 {
 	unsigned char *buf = this->b.getBytesPtr();
-	if( !buf ) return false;
+	if( !buf || !pKey ) return false;
 	unsigned int blen = getPacketSize();
 	if( blen < 1 ) return false;
 
-	BF_KEY bfkey;
-	if( bUseStaticBFKey )
-		BF_set_key( &bfkey, (int)this->STATIC_BLOWFISH_KEY_LEN,
-			this->STATIC_BLOWFISH_KEY );
-	else
-		BF_set_key( &bfkey, (int)this->NEW_BLOWFISH_KEY_LEN,
-			this->NEW_BLOWFISH_KEY );
-	
+	// Encoded in place, packet is already padded to 8 bytes
 	unsigned int offset = 0;
-	int nPasses = 0;
-
-	unsigned char outbuf [1024];
-
-/*	if( !outbuf )
+	for( offset=2; offset+8<=real_size; offset+=8 )
 	{
-		return false;
-	}
-*/
-	memset( outbuf, 0, blen );
-	outbuf[0] = buf[0];
-	outbuf[1] = buf[1];
-
-	for( offset=2; offset<real_size-2; offset+=8 )
-	{
-		unsigned char data[8] = {0,0,0,0,0,0,0,0};
+		unsigned char data[8];
 		memcpy( data, buf+offset, 8 );
-		BF_encrypt( (BF_LONG *)data, &bfkey );
-		memcpy( outbuf+offset, data, 8 );
-		nPasses++;
-	}	
-	this->setBytes( outbuf, blen );
+		BF_encrypt( (BF_LONG *)data, pKey->Get() );
+		memcpy( buf+offset, data, 8 );
+	}
 
 	return true;
 }
 
-bool Packet::encodeAndPrepareToSend( unsigned char *blowfishKey, unsigned int bfKeyLen /*= 16*/ )
+bool Packet::encodeAndPrepareToSend( const CBlowfishKey *pKey )
 {
-	if( !setDynamicBFKey( blowfishKey, bfKeyLen ) ) return false;
 	if( !padPacketTo8ByteLen() ) return false;
-	appendChecksum( true );
-	appendMore8Bytes();
-	return encodeBlowfish( false );
-}
\ No newline at end of file
+	if( !encodeBlowfish( pKey ) ) return false;
+	appendChecksum( false );
+	return appendMore8Bytes();
+}
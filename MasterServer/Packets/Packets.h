@@ -13,6 +13,7 @@ History:
 #define _Packets_
 
 #include "BasePacket.h"
+#include "BlowfishKey.h"
 
 class Packet: public BasePacket
 {
@@ -22,26 +23,28 @@ public:
 	virtual ~Packet();
 public:
 	virtual bool         decodeBlowfish( bool bUseStaticBFKey );
-	virtual bool         decodeBlowfish( unsigned char *blowfishKey );
+	virtual bool         decodeBlowfish( const CBlowfishKey *pKey );
 public:
 	virtual bool         appendChecksum( bool append4bytes = true );
+	// Checksum is last 4 bytes of [offset, size)
 	static bool          verifyBytesChecksum( const unsigned char *bytes, unsigned int offset, unsigned int size );
+	// Packet made by encodeAndPrepareToSend, checked before decoding
+	static bool          verifyEncodedChecksum( const unsigned char *bytes, unsigned int size );
 	virtual bool         verifyChecksum() const;
 	virtual bool         padPacketTo8ByteLen();
 	virtual bool         appendMore8Bytes();
-	virtual bool         setDynamicBFKey( unsigned char *newKey, unsigned int newKeyLen );
+	virtual bool         setDynamicBFKey( const CBlowfishKey *pKey );
 	virtual bool         encodeBlowfish( bool bUseStaticBFKey );
+	virtual bool         encodeBlowfish( const CBlowfishKey *pKey );
 
 public:
-	virtual bool encodeAndPrepareToSend( unsigned char *blowfishKey, unsigned int bfKeyLen = 16 );
+	virtual bool encodeAndPrepareToSend( const CBlowfishKey *pKey );
 
 protected:
 	virtual void _initNull();
 protected:
-	unsigned char STATIC_BLOWFISH_KEY[64];
-	unsigned int  STATIC_BLOWFISH_KEY_LEN;
-	unsigned char NEW_BLOWFISH_KEY[64];
-	unsigned int  NEW_BLOWFISH_KEY_LEN;
+	// Prepared schedule, NULL - default key
+	const CBlowfishKey *pDynamicKey;
 	unsigned int  xor_key;
 };
 
@@ -15,14 +15,30 @@ History:
 
 typedef UINT_PTR SOCKET;
 
+class CSendFrame;
+class CSession;
+class CBlowfishKey;
+class CAesGcmKey;
+class Packet;
+
 // This define need for checking packet integrity
 #define EndBlock "END_BLOCK"
+// Both sides of identification send public key of CKeyExchange as hex block.
+// Client accepts blowfish session key made from it by this block
+#define SessionKeyBlock "SESSION_KEY"
+// Master server can use session key for AES-GCM, client accepts it by second block
+#define AeadBlock "AES_GCM"
+#define AeadKeyBlock "SESSION_KEY_AES_GCM"
+// Both sides of identification send it to use protocol v2 packets
+#define ProtocolV2Block "PROTOCOL_V2"
+// Both sides of identification send it to get big messages compressed by LZ4
+#define Lz4Block "LZ4"
 
 // Client structure 
 struct SClient
 {
 	SOCKET socket;
-	const char* login;
+	std::string login;
 	const char*  ip;
 
 	int playerId;
@@ -52,60 +68,24 @@ enum EPacketType
 	PACKET_MS_INFO,
 	PACKET_GAME_SERVER,
 	PACKET_GAME_SERVERS,
-};
-
-// Chat message area. Global, private, system, etc. messages
-enum EChatMessageArea
-{
-	CHAT_MESSAGE_GLOBAL = 0,
-	CHAT_MESSAGE_PRIVATE,
-	CHAT_MESSAGE_SYSTEM,
-};
-
-
-// Chat message structure. Using for sending chat messages to client/master server
-struct SMessage
-{
-	const char* message;
-	EChatMessageArea area; // Global, private, system, etc.
-};
-
-// Request packet structure. Using for sending request to client/master server.
-struct SRequestPacket
-{
-	const char* request;
-	const char* sParam;
-	int iParam;
-};
 
-// Login packet structure. Using in login and register client!
-struct SLoginPacket
-{
-	const char* login;
-	const char* password;
-	const char* nickname;
+	// Part of big message. Same number in all modules
+	PACKET_CHUNK = 32,
+	// Big message compressed by LZ4
+	PACKET_COMPRESSED = 33,
 };
 
-// Game server structur. Using for sending game server info to client/master server.
-struct SGameServer
+// Session encryption chosen by client in identification packet
+enum ESessionCrypto
 {
-	SOCKET socket;
-	int id;
-	const char* ip;
-	int port;
-	char* serverName;
-	int currentPlayers;
-	int maxPlayers;
-	char* mapName;
-	char* gameRules;
+	SESSION_CRYPTO_NONE = 0,        // Default key
+	SESSION_CRYPTO_BLOWFISH,        // Blowfish with session key
+	SESSION_CRYPTO_AES_GCM,         // AES-GCM with session key
 };
 
-// Master server info structure
-struct SMasterServerInfo
-{
-	int playersOnline;
-	int gameServersOnline;
-};
+// Shared packet structures and schemas
+#include "..\..\Common\PacketSchema.h"
+#include "..\..\Common\PacketView.h"
 
 // Packet structurs
 struct SPacket
@@ -115,6 +95,16 @@ struct SPacket
 	SOCKET addr;
 };
 
+// Decoded inbound packet. Decrypted in place and header checked once, typed readers continue after header.
+// View reads receive buffer of packet or put together message, strings read from it live until FreePacket
+struct SDecodedPacket
+{
+	EPacketType type;
+	bool bLegacy;                  // Old packet with version and end block
+	CPacketView view;
+	unsigned char* pMessage;       // Own buffer of put together message, else NULL
+};
+
 // Read/send packet class. Using for sendind/reading packets
 class CReadSendPacket
 {
@@ -126,56 +116,82 @@ public:
 	// Gets packet type
 	EPacketType GetPacketType (SPacket packet);
 
+	// Decrypt packet in place and check header. Decoded packet must be freed by FreePacket,
+	// packet.data must live until then. Session key of connection is used if set,
+	// connection with protocol v2 sends opcode header
+	bool DecodePacket(SPacket packet, SDecodedPacket& decoded, const CBlowfishKey* pKey = NULL, CAesGcmKey* pAeadKey = NULL, bool bProtocolV2 = false);
+	// Check header of decrypted or put together packet, frees packet on error
+	bool DecodeHeader(SDecodedPacket& decoded, bool bProtocolV2 = false);
+	void FreePacket(SDecodedPacket& decoded);
+
 
 	//   
 	// Sends identification packet
-	void SendIdentificationPacket (SOCKET Socket);
+	// Public key of session key exchange is sent if not NULL, protocol v2 is offered if enabled
+	void SendIdentificationPacket (SOCKET Socket, const char* publicKey = NULL);
 
 	//   
 	// Sends message
-	void SendMsg(SOCKET Socket, SMessage message);
+	// Packets after identification go to connection of session
+	void SendMsg(CSession* pSession, SMessage message);
+	void SendMsg(const std::vector <CSession*>& Sessions, SMessage message);
 
 	//    
 	// Sends information about player
-	void SendAccountInfo(SOCKET Socket, SClient player);
+	void SendAccountInfo(CSession* pSession, SClient player);
 
 	//     
 	// Sends information about the master server
-	void SendMasterServerInfo (SOCKET Socket, SMasterServerInfo info);
+	void SendMasterServerInfo (CSession* pSession, SMasterServerInfo info);
+	void SendMasterServerInfo (const std::vector <CSession*>& Sessions, SMasterServerInfo info);
 
 	//     
 	// Sends information about the game server
-	void SendGameServerInfo (SOCKET Socket, SGameServer server);
+	void SendGameServerInfo (CSession* pSession, SGameServer server);
+	void SendGameServerInfo (const std::vector <CSession*>& Sessions, SGameServer server);
 
-	void SendGameServers (SOCKET Socket);
+	void SendGameServers (CSession* pSession);
 
 	//  
 	// Sends request
-	void SendRequest(SOCKET  Socket, SRequestPacket request);
+	void SendRequest(CSession* pSession, SRequestPacket request);
+	void SendRequest(const std::vector <CSession*>& Sessions, SRequestPacket request);
 
 	//   
-	// Read identification packet
-	void ReadIdentificationPacket (SPacket packet);
+	// Read identification packet. Returns session encryption accepted by client
+	// and if client accepted protocol v2. Public key of client is copied to peerKey
+	// of KEY_EXCHANGE_HEX_SIZE bytes
+	ESessionCrypto ReadIdentificationPacket (SDecodedPacket& packet, char* peerKey, bool& bProtocolV2, bool& bLz4);
 
 	//    
 	// Read login packet
-	SLoginPacket ReadLoginPacket (SPacket packet);
+	SLoginPacket ReadLoginPacket (SDecodedPacket& packet);
 
 	//    
 	// Read registration packet
-	SLoginPacket ReadRegistrationPacket (SPacket packet);
+	SLoginPacket ReadRegistrationPacket (SDecodedPacket& packet);
 
 	//    
 	// Read message packet
-	SMessage ReadMsg(SPacket packet);
+	SMessage ReadMsg(SDecodedPacket& packet);
 
 	//    
 	// Read request
-	SRequestPacket ReadRequest(SPacket packet);
+	SRequestPacket ReadRequest(SDecodedPacket& packet);
 
 	//       
 	// Read game server info
-	SGameServer ReadGameServerInfo(SPacket packet);
+	SGameServer ReadGameServerInfo(SDecodedPacket& packet);
+
+private:
+	// Old packets end with end block, protocol v2 relies on transport checksum
+	bool ReadEndBlock(SDecodedPacket& packet);
+
+	// Packet is encoded once, frame can be sent to many connections
+	CSendFrame* BuildMsg(SMessage message);
+	CSendFrame* BuildMasterServerInfo(SMasterServerInfo info);
+	CSendFrame* BuildGameServerInfo(SGameServer server);
+	CSendFrame* BuildRequest(SRequestPacket request);
 };
 
 #endif
\ No newline at end of file
@@ -10,100 +10,196 @@ History:
 *************************************************************************/
 
 #include "StdAfx.h"
-#include <winsock.h>
+#include <winsock2.h>
 
 #include "Packets\Packets.h"
 #include "Packets\PacketDebugger.h"
+#include "..\..\Common\PacketOpcode.h"
+#include "Packets\KeyExchange.h"
 #include "Packets\RSP.h"
 
 
-EPacketType CReadSendPacket::GetPacketType (SPacket packet)
+bool CReadSendPacket::DecodePacket(SPacket packet, SDecodedPacket& decoded, const CBlowfishKey* pKey, CAesGcmKey* pAeadKey, bool bProtocolV2)
 {
-	Log(LOG_DEBUG, "Read a packet type...");
+	Log(LOG_DEBUG, "Decode packet...");
 
-	Packet* p = new Packet((const unsigned char*)packet.data, packet.size);
-	p->decodeBlowfish(gEnv->bBlowFish);
+	unsigned char* bytes = (unsigned char*)packet.data;
+	unsigned int size = packet.size > 0 ? (unsigned int)packet.size : 0;
+	unsigned int plainSize = size;
 
-	// Packet header
-	EPacketType type = (EPacketType)p->readInt();             // Packet type
-	const char* version = p->readString();                    // Packet version
-	//
+	decoded.pMessage = NULL;
 
-	if(version != NULL)
+	// Decoded in place, view reads same buffer
+	if(pAeadKey != NULL)
 	{
-		if(!strcmp(version, gEnv->serverVersion))
-			return type;
-		else
+		if(!pAeadKey->Open(bytes, size, plainSize))
 		{
-			Log(LOG_WARNING,"Different packet versions! Ignoring...");
-			Log(LOG_DEBUG,"Packet version = %s", version);
-			Log(LOG_DEBUG,"Curent version = %s", gEnv->serverVersion);
+			Log(LOG_WARNING,"Packet authentication failed! Ignoring...");
+			return false;
 		}
 	}
+	else
+	{
+		// Checksum is made from encoded bytes
+		if(gEnv->bVerifyChecksum && !Packet::verifyEncodedChecksum(bytes, size))
+		{
+			Log(LOG_WARNING,"Packet checksum failed! Ignoring...");
+			return false;
+		}
 
-	delete p;
-	return (EPacketType)-1;
+		if(pKey != NULL)
+			pKey->Decode(bytes, size);
+		else if(gEnv->bBlowFish)
+			CBlowfishKey::GetStaticKey()->Decode(bytes, size);
+		else
+			CBlowfishKey::GetDefaultKey()->Decode(bytes, size);
+	}
+
+	decoded.view = CPacketView(bytes, plainSize);
+
+	return DecodeHeader(decoded, bProtocolV2);
 }
 
-void CReadSendPacket::ReadIdentificationPacket (SPacket packet)
+bool CReadSendPacket::DecodeHeader(SDecodedPacket& decoded, bool bProtocolV2)
 {
-	Log(LOG_DEBUG,"Read identification packet...");
+	decoded.bLegacy = true;
 
-	Packet* p = new Packet((const unsigned char*)packet.data, packet.size);
+	// Protocol v2 header. Version was checked by identification packets
+	if(bProtocolV2)
+	{
+		unsigned char opcode = 0;
+		if(!decoded.view.ReadUChar(opcode))
+		{
+			FreePacket(decoded);
+			return false;
+		}
 
-	p->decodeBlowfish(gEnv->bBlowFish);
+		if(opcode != PACKET_OPCODE_LEGACY)
+		{
+			decoded.type = (EPacketType)opcode;
+			decoded.bLegacy = false;
+			return true;
+		}
+	}
 
 	// Packet header
-	EPacketType type = (EPacketType)p->readInt();             // Packet type
-	const char* version        = p->readString();             // Packet version
+	decoded.type = (EPacketType)decoded.view.readInt();      // Packet type
+	const char* version = decoded.view.readString();         // Packet version
 	//
 
-	const char* endBlock = p->readString();                   // End block
+	if(version != NULL)
+	{
+		if(!strcmp(version, gEnv->serverVersion))
+			return true;
+
+		Log(LOG_WARNING,"Different packet versions! Ignoring...");
+		Log(LOG_DEBUG,"Packet version = %s", version);
+		Log(LOG_DEBUG,"Curent version = %s", gEnv->serverVersion);
+	}
+
+	FreePacket(decoded);
+	return false;
+}
+
+bool CReadSendPacket::ReadEndBlock(SDecodedPacket& packet)
+{
+	if(!packet.bLegacy)
+		return packet.view.IsValid();
+
+	const char* endBlock = packet.view.readString();         // End block
+
+	return endBlock != NULL && !strcmp(endBlock, EndBlock);
+}
+
+void CReadSendPacket::FreePacket(SDecodedPacket& decoded)
+{
+	delete[] decoded.pMessage;
+	decoded.pMessage = NULL;
+	decoded.view = CPacketView();
+}
+
+EPacketType CReadSendPacket::GetPacketType (SPacket packet)
+{
+	Log(LOG_DEBUG, "Read a packet type...");
+
+	SDecodedPacket decoded;
 
-	if(strcmp(endBlock,EndBlock))
+	if(!DecodePacket(packet, decoded))
+		return (EPacketType)-1;
+
+	EPacketType type = decoded.type;
+	FreePacket(decoded);
+
+	return type;
+}
+
+ESessionCrypto CReadSendPacket::ReadIdentificationPacket (SDecodedPacket& packet, char* peerKey, bool& bProtocolV2, bool& bLz4)
+{
+	Log(LOG_DEBUG,"Read identification packet...");
+
+	CPacketView* p = &packet.view;
+	ESessionCrypto crypto = SESSION_CRYPTO_NONE;
+	bProtocolV2 = false;
+	bLz4 = false;
+	peerKey[0] = '\0';
+
+	// Old clients don't know about session keys and protocol v2 and send only end block
+	const char* block = p->readString();                      // Public key, session key, protocol v2, LZ4 or end block
+
+	while(block != NULL && strcmp(block,EndBlock))
+	{
+		if(!strcmp(block,SessionKeyBlock))
+			crypto = SESSION_CRYPTO_BLOWFISH;
+		else if(!strcmp(block,AeadKeyBlock))
+			crypto = SESSION_CRYPTO_AES_GCM;
+		else if(!strcmp(block,ProtocolV2Block))
+			bProtocolV2 = true;
+		else if(!strcmp(block,Lz4Block))
+			bLz4 = true;
+		else if(CKeyExchange::IsPublicKey(block))
+			strcpy(peerKey, block);
+
+		block = p->readString();
+	}
+
+	if(block == NULL)
 		Log(LOG_WARNING,"Identification packet damaged!");
 
+	// Session key can't be made without public key
+	if(peerKey[0] == '\0')
+		crypto = SESSION_CRYPTO_NONE;
+
 	if(gEnv->bDebugMode)
 	{
-		int size = p->getPacketSize();
-		char* Packet = (char*)p->getBytesPtr();
+		int size = (int)p->GetSize();
+		char* Packet = (char*)p->GetData();
 
 		Log(LOG_DEBUG,"Identification packet size = %d", size);
 		
 		PacketDebugger::Debug(Packet, size, "ReceivedPacketsDebugg.txt");
 	}
 
-	delete p;
+	return crypto;
 }
 
-SLoginPacket CReadSendPacket::ReadLoginPacket (SPacket packet)
+SLoginPacket CReadSendPacket::ReadLoginPacket (SDecodedPacket& packet)
 {
 	SLoginPacket loginPacket;
 
 	Log(LOG_DEBUG,"Read login packet...");
 
-	Packet* p = new Packet((const unsigned char*)packet.data, packet.size);
-
-	p->decodeBlowfish(gEnv->bBlowFish);
-
-	// Packet header
-	EPacketType type = (EPacketType)p->readInt();             // Packet type
-	std::string version        = p->readString();             // Packet version
-	//
-
-	loginPacket.login    = p->readString();                   // Login
-	loginPacket.password = p->readString();                   // Password
+	CPacketView* p = &packet.view;
 
+	SchemaRead<SLoginSchema>(p, loginPacket, !packet.bLegacy); // Login and password
 
-	std::string endBlock     = p->readString();               // End block
 
-	if(strcmp(endBlock.c_str(),EndBlock))
+	if(!ReadEndBlock(packet))                                 // End block
 		Log(LOG_WARNING,"Login packet damaged!");
 
 	if(gEnv->bDebugMode)
 	{
-		int size = p->getPacketSize();
-		char* Packet = (char*)p->getBytesPtr();
+		int size = (int)p->GetSize();
+		char* Packet = (char*)p->GetData();
 
 		Log(LOG_DEBUG,"Login packet size = %d",size);
 		Log(LOG_DEBUG,"Login : %s",loginPacket.login);
@@ -115,34 +211,23 @@ SLoginPacket CReadSendPacket::ReadLoginPacket (SPacket packet)
 	return loginPacket;
 }
 
-SLoginPacket CReadSendPacket::ReadRegistrationPacket (SPacket packet)
+SLoginPacket CReadSendPacket::ReadRegistrationPacket (SDecodedPacket& packet)
 {
 	SLoginPacket registerPacket;
 
 	Log(LOG_DEBUG,"Read registration packet...");
 
-	Packet* p = new Packet((const unsigned char*)packet.data, packet.size);
-
-	p->decodeBlowfish(gEnv->bBlowFish);
-
-	// Packet header
-	EPacketType type = (EPacketType)p->readInt();             // Packet type
-	std::string version        = p->readString();             // Packet version
-	//
-
-	registerPacket.login    = p->readString();                // Login
-	registerPacket.password = p->readString();                // Password 
-	registerPacket.nickname = p->readString();                // Nickname    
+	CPacketView* p = &packet.view;
 
-	std::string endBlock     = p->readString();               // End block
+	SchemaRead<SRegistrationSchema>(p, registerPacket, !packet.bLegacy); // Login, password and nickname
 
-	if(strcmp(endBlock.c_str(), EndBlock))
+	if(!ReadEndBlock(packet))                                 // End block
 		Log(LOG_WARNING,"Registration packet damaged!");
 
 	if(gEnv->bDebugMode)
 	{
-		int size = p->getPacketSize();
-		char* Packet = (char*)p->getBytesPtr();
+		int size = (int)p->GetSize();
+		char* Packet = (char*)p->GetData();
 
 		Log(LOG_DEBUG,"Registration packet size = %d",size);
 		Log(LOG_DEBUG,"Login : %s",registerPacket.login);
@@ -155,72 +240,62 @@ SLoginPacket CReadSendPacket::ReadRegistrationPacket (SPacket packet)
 	return registerPacket;
 }
 
-SMessage CReadSendPacket::ReadMsg(SPacket packet)
+SMessage CReadSendPacket::ReadMsg(SDecodedPacket& packet)
 {
 	SMessage message;
 
 	Log(LOG_DEBUG,"Read MSG packet...");
 
-	Packet* p = new Packet((const unsigned char*)packet.data, packet.size);
-
-	p->decodeBlowfish(gEnv->bBlowFish);
-
-	// Packet header
-	EPacketType type = (EPacketType)p->readInt();             // Packet type
-	const char* version        = p->readString();             // Packet version
-	//
-
-	message.message    = p->readString();                     // Message
-	message.area       = (EChatMessageArea)p->readInt();      // Message area      
+	CPacketView* p = &packet.view;
 
-	const char* endBlock = p->readString();
+	SchemaRead<SMessageSchema>(p, message, !packet.bLegacy);  // Message and area
 
-	if(strcmp(endBlock,EndBlock))
+	if(!ReadEndBlock(packet))                                 // End block
 		Log(LOG_WARNING,"MSG packet damaged!");
 
 	if(gEnv->bDebugMode)
 	{
-		Log(LOG_DEBUG,"MSG packet size = %d",packet.size);
+		int size = (int)p->GetSize();
+		char* Packet = (char*)p->GetData();
+
+		Log(LOG_DEBUG,"MSG packet size = %d",size);
 		Log(LOG_DEBUG,"MSG packet data = %s", message.message);
 		Log(LOG_DEBUG,"MSG packet area = %d", message.area);
 
 
-		PacketDebugger::Debug(packet.data, packet.size, "ReceivedPacketsDebugg.txt");
+		PacketDebugger::Debug(Packet, size, "ReceivedPacketsDebugg.txt");
 	}
 
-	delete p;
 	return message;
 }
 
-SRequestPacket CReadSendPacket::ReadRequest(SPacket packet)
+SRequestPacket CReadSendPacket::ReadRequest(SDecodedPacket& packet)
 {
 	SRequestPacket request;
 
 	Log(LOG_DEBUG, "Read client request packet...");
 
-	Packet* p = new Packet((const unsigned char*)packet.data, packet.size);
+	CPacketView* p = &packet.view;
 
-	p->decodeBlowfish(gEnv->bBlowFish);
-
-	// Packet header
-	EPacketType type = (EPacketType)p->readInt();             // Packet type
-	const char* version        = p->readString();             // Packet version
-	//
 
+	if(packet.bLegacy)
+	{
+		SchemaRead<SRequestSchema>(p, request);               // Request name and params
+		request.id = GetRequestId(request.request);
+	}
+	else
+		SchemaVarRead<SRequestIdSchema>(p, request);          // Request id and params
 
-	request.request = p->readString();                        // Request
-	request.sParam = p->readString();                         // String param
-	request.iParam = p->readInt();                            // Int param
+	request.request = GetRequestName(request.id);
 
 
-	const char* endBlock = p->readString(); 
-	if(strcmp(endBlock, EndBlock))
+	if(!ReadEndBlock(packet))                                 // End block
 		Log(LOG_WARNING,"Client request packet damaged!");
 
 	if(gEnv->bDebugMode)
 	{
-		int size = p->getPacketSize();
-		char* Packet = (char*)p->getBytesPtr();
+		int size = (int)p->GetSize();
+		char* Packet = (char*)p->GetData();
 
 		Log(LOG_DEBUG,"Request size = %d", size);
 		Log(LOG_DEBUG,"Request = %s", request.request);
@@ -230,43 +305,26 @@ SRequestPacket CReadSendPacket::ReadRequest(SPacket packet)
 		PacketDebugger::Debug(Packet, size, "ReceivedPacketsDebugg.txt");
 	}
 
-	delete p;
 	return request;
 }
 
-SGameServer CReadSendPacket::ReadGameServerInfo(SPacket packet)
+SGameServer CReadSendPacket::ReadGameServerInfo(SDecodedPacket& packet)
 {
 	Log(LOG_DEBUG,"Read game server info packet...");
 
 	SGameServer Server;
 
-	Packet* p = new Packet((const unsigned char*)packet.data, packet.size);
-
-	p->decodeBlowfish(gEnv->bBlowFish);
-
-	// Packet header
-	EPacketType type = (EPacketType)p->readInt();           // Packet type
-	const char* version        = p->readString();           // Packet version
-	//
-
-	Server.id              = p->readInt();                  // id
-	Server.ip              = p->readString();               // ip          
-	Server.port            = p->readInt();                  // port
-	Server.serverName      = p->readString();               // name
-	Server.currentPlayers  = p->readInt();                  // players online
-	Server.maxPlayers      = p->readInt();                  // max players
-	Server.mapName         = p->readString();               // map name
-	Server.gameRules       = p->readString();               // game rules
+	CPacketView* p = &packet.view;
 
-	const char* endBlock = p->readString();                 // End block
+	SchemaRead<SGameServerSchema>(p, Server, !packet.bLegacy); // Game server
 
-	if(strcmp(endBlock,EndBlock))
+	if(!ReadEndBlock(packet))                               // End block
 		Log(LOG_WARNING,"Game server info packet damaged!");
 
 	if(gEnv->bDebugMode)
 	{
-		int size = p->getPacketSize();
-		char* Packet = (char*)p->getBytesPtr();
+		int size = (int)p->GetSize();
+		char* Packet = (char*)p->GetData();
 
 		Log(LOG_DEBUG,"Game Server info packet size = %d",size);
 		Log(LOG_DEBUG,"Game Server ip = %s",Server.ip);
@@ -281,6 +339,5 @@ SGameServer CReadSendPacket::ReadGameServerInfo(SPacket packet)
 		PacketDebugger::Debug(Packet, size, "ReceivedPacketsDebugg.txt");
 	}
 
-	delete p;
 	return Server;
 }
\ No newline at end of file
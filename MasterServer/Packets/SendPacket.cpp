@@ -9,41 +9,98 @@ History:
 
 *************************************************************************/
 #include "StdAfx.h"
-#include <winsock.h>
+#include <winsock2.h>
 
 #include "Packets\Packets.h"
+#include "Packets\PacketBuilder.h"
 #include "Packets\PacketDebugger.h"
 #include "Packets\RSP.h"
 
-void CReadSendPacket::SendIdentificationPacket(SOCKET Socket)
+// Old packet or protocol v2 packet with schema fields. Protocol v2 copy is written
+// from message, not transcoded from old packet
+template <class TSchema, class TMsg>
+static Packet* BuildSchemaPacket(int type, const TMsg& m, bool bProtocolV2)
+{
+	Packet* p = new Packet();
+	CPacketBuilder pb(p, SchemaPacketSize<TSchema>(gEnv->serverVersion, m, bProtocolV2));
+
+	SchemaWritePacket<TSchema>(pb, type, gEnv->serverVersion, m, bProtocolV2); // Header, fields, end block
+
+	pb.Finish();
+	return p;
+}
+
+// Protocol v2 sends known request by id, unknown request goes as old packet with name
+static Packet* BuildRequestPacket(SRequestPacket request, bool bProtocolV2)
+{
+	request.id = GetRequestId(request.request);
+	bool bVarFields = bProtocolV2 && request.id != REQUEST_UNKNOWN && SchemaVarFits<SRequestIdSchema>(request);
+
+	Packet* p = new Packet();
+	CPacketBuilder pb(p, bVarFields ? SchemaPacketSize<SRequestIdSchema>(gEnv->serverVersion, request, true) :
+		1 + SchemaPacketSize<SRequestSchema>(gEnv->serverVersion, request));
+
+	if(bProtocolV2 && !bVarFields)
+		pb.WriteUChar(PACKET_OPCODE_LEGACY);                     // Old packet follows
+
+	SchemaWriteHeader(pb, PACKET_REQUEST, gEnv->serverVersion, bVarFields); // Packet type and version or opcode
+
+	if(bVarFields)
+		SchemaVarWrite<SRequestIdSchema>(pb, request);           // Request id
+	else
+		SchemaWrite<SRequestSchema>(pb, request);                // Request
+
+	SchemaWriteEnd(pb, bVarFields);                              // End block
+
+	pb.Finish();
+	return p;
+}
+
+void CReadSendPacket::SendIdentificationPacket(SOCKET Socket, const char* publicKey)
 {
 	Log(LOG_DEBUG,"Send identification packet to client...");
 
-	SPacket SPacket;
 	Packet* p = new Packet();
-	p->create();
+	CPacketBuilder pb(p);
 
 	// Header
-	p->writeInt(PACKET_IDENTIFICATION);                          // Packet type
-	p->writeString(gEnv->serverVersion);                         // Packet version
+	pb.WriteInt(PACKET_IDENTIFICATION);                          // Packet type
+	pb.WriteString(gEnv->serverVersion);                         // Packet version
 	// 
 
-	p->writeString(EndBlock);                                    // End block
+	if(publicKey != NULL)
+	{
+		pb.WriteString(publicKey);                               // Public key of session key exchange
 
-	p->padPacketTo8ByteLen();
-	p->encodeBlowfish(gEnv->bBlowFish);
-	p->appendChecksum(false);
-	p->appendMore8Bytes();
+		if(gEnv->bAead)
+			pb.WriteString(AeadBlock);                           // AES-GCM supported
+	}
+
+	if(gEnv->bProtocolV2)
+		pb.WriteString(ProtocolV2Block);                         // Protocol v2 supported
 
+	if(gEnv->compressionThreshold > 0)
+		pb.WriteString(Lz4Block);                                // LZ4 compression supported
 
-	int size = p->getPacketSize();
-	char* packet = (char*)p->getBytesPtr();
+	pb.WriteString(EndBlock);                                    // End block
 
-	SPacket.addr = Socket;
-	SPacket.data = packet;
-	SPacket.size = size;
+	pb.Finish();
 
-	gEnv->pPacketQueue->InsertPacketToSend(SPacket);
+	CSendFrame* pFrame = new CSendFrame(p);
+
+	// Packet that can't be encoded is not sent
+	if(!pFrame->IsValid())
+	{
+		Log(LOG_ERROR,"Can't encode packet!");
+		delete p;
+		pFrame->Release();
+		return;
+	}
+
+	int size = pFrame->GetSize();
+	char* packet = pFrame->GetData();
+
+	gEnv->pIoEngine->Send(Socket, pFrame);
 
 	if(gEnv->bDebugMode)
 	{
@@ -52,41 +109,51 @@ void CReadSendPacket::SendIdentificationPacket(SOCKET Socket)
 		PacketDebugger::Debug(packet, size, "SendPacketsDebugg.txt");
 	}
 
-	gEnv->outPackets++;
+	delete p;
+	pFrame->Release();
 }
 
-void CReadSendPacket::SendMsg(SOCKET Socket, SMessage message)
+void CReadSendPacket::SendMsg(CSession* pSession, SMessage message)
 {
-	Log(LOG_DEBUG,"Send message packet to client...");
-
-	SPacket SPacket;
-	Packet* p = new Packet();
-	p->create();
+	CSendFrame* pFrame = BuildMsg(message);
+	if(pFrame == NULL)
+		return;
 
-	// Header
-	p->writeInt(PACKET_MESSAGE);                                 // Packet type
-	p->writeString(gEnv->serverVersion);                         // Version
-	//
+	gEnv->pIoEngine->Send(pSession, pFrame);
+	pFrame->Release();
+}
 
-	p->writeString(message.message);                             // Message
-	p->writeInt(message.area);                                   // Message area
+void CReadSendPacket::SendMsg(const std::vector <CSession*>& Sessions, SMessage message)
+{
+	CSendFrame* pFrame = BuildMsg(message);
+	if(pFrame == NULL)
+		return;
 
-	p->writeString(EndBlock);                                    // End block
+	gEnv->pIoEngine->Broadcast(Sessions, pFrame);
+	pFrame->Release();
+}
 
-	p->padPacketTo8ByteLen();
-	p->encodeBlowfish(gEnv->bBlowFish);
-	p->appendChecksum(false);
-	p->appendMore8Bytes();
+CSendFrame* CReadSendPacket::BuildMsg(SMessage message)
+{
+	Log(LOG_DEBUG,"Send message packet to client...");
 
+	Packet* p = BuildSchemaPacket<SMessageSchema>(PACKET_MESSAGE, message, false);
+	Packet* pV2 = gEnv->bProtocolV2 ? BuildSchemaPacket<SMessageSchema>(PACKET_MESSAGE, message, true) : NULL;
 
-	int size = p->getPacketSize();
-	char* packet = (char*)p->getBytesPtr();
+	CSendFrame* pFrame = new CSendFrame(p, pV2);
 
-	SPacket.addr = Socket;
-	SPacket.data = packet;
-	SPacket.size = size;
+	// Packet that can't be encoded is not sent
+	if(!pFrame->IsValid())
+	{
+		Log(LOG_ERROR,"Can't encode packet!");
+		delete p;
+		delete pV2;
+		pFrame->Release();
+		return NULL;
+	}
 
-	gEnv->pPacketQueue->InsertPacketToSend(SPacket);
+	int size = pFrame->GetSize();
+	char* packet = pFrame->GetData();
 
 
 	if(gEnv->bDebugMode)
@@ -98,44 +165,43 @@ void CReadSendPacket::SendMsg(SOCKET Socket, SMessage message)
 		PacketDebugger::Debug(packet, size, "SendPacketsDebugg.txt");
 	}
 
-	gEnv->outPackets++;
+	delete p;
+	delete pV2;
+
+	return pFrame;
 }
 
-void CReadSendPacket::SendAccountInfo (SOCKET Socket, SClient player)
+void CReadSendPacket::SendAccountInfo (CSession* pSession, SClient player)
 {
 	Log(LOG_DEBUG,"Send account info to client...");
-	SPacket SPacket;
-	Packet* p = new Packet();
-	p->create();
-
-	// Header
-	p->writeInt(PACKET_ACCOUNT);                                 // Packet type
-	p->writeString(gEnv->serverVersion);                         // Packet versions
-	//
-
-	p->writeInt(player.playerId);                                // Player id
-	p->writeString(player.nickname.c_str());                     // Player nickname
-	p->writeInt(player.xp);                                      // Player exp
-	p->writeInt(player.level);                                   // Player level
-	p->writeInt(player.money);                                   // Player money
-	p->writeInt(player.banStatus);                               // Player ban status...hm
-
-	p->writeString(EndBlock);                                    // End block
-
-	p->padPacketTo8ByteLen();
-	p->encodeBlowfish(gEnv->bBlowFish);
-	p->appendChecksum(false);
-	p->appendMore8Bytes();
-
-
-	int size = p->getPacketSize();
-	char* packet = (char*)p->getBytesPtr();
+	SAccountInfo info;
+	info.playerId  = player.playerId;
+	info.nickname  = player.nickname.c_str();
+	info.xp        = player.xp;
+	info.level     = player.level;
+	info.money     = player.money;
+	info.banStatus = player.banStatus;
+
+	// Player id, nickname, xp, level, money, ban status
+	Packet* p = BuildSchemaPacket<SAccountSchema>(PACKET_ACCOUNT, info, false);
+	Packet* pV2 = gEnv->bProtocolV2 ? BuildSchemaPacket<SAccountSchema>(PACKET_ACCOUNT, info, true) : NULL;
+
+	CSendFrame* pFrame = new CSendFrame(p, pV2);
+
+	// Packet that can't be encoded is not sent
+	if(!pFrame->IsValid())
+	{
+		Log(LOG_ERROR,"Can't encode packet!");
+		delete p;
+		delete pV2;
+		pFrame->Release();
+		return;
+	}
 
-	SPacket.addr = Socket;
-	SPacket.data = packet;
-	SPacket.size = size;
+	int size = pFrame->GetSize();
+	char* packet = pFrame->GetData();
 
-	gEnv->pPacketQueue->InsertPacketToSend(SPacket);
+	gEnv->pIoEngine->Send(pSession, pFrame);
 
 	if(gEnv->bDebugMode)
 	{
@@ -150,41 +216,52 @@ void CReadSendPacket::SendAccountInfo (SOCKET Socket, SClient player)
 		PacketDebugger::Debug(packet, size, "SendPacketsDebugg.txt");
 	}
 
-	gEnv->outPackets++;
+	delete p;
+	delete pV2;
+	pFrame->Release();
 }
 
-void CReadSendPacket::SendMasterServerInfo (SOCKET Socket, SMasterServerInfo info)
+void CReadSendPacket::SendMasterServerInfo(CSession* pSession, SMasterServerInfo info)
 {
-	Log(LOG_DEBUG,"Send master server info to client...");
+	CSendFrame* pFrame = BuildMasterServerInfo(info);
+	if(pFrame == NULL)
+		return;
 
-	SPacket SPacket;
-	Packet* p = new Packet();
-	p->create();
-
-	// Header
-	p->writeInt(PACKET_MS_INFO);                                 // Packet type
-	p->writeString(gEnv->serverVersion);                         // Packet version
-	//
+	gEnv->pIoEngine->Send(pSession, pFrame);
+	pFrame->Release();
+}
 
-	p->writeInt(info.playersOnline);                             // Player online
-	p->writeInt(info.gameServersOnline);                         // Game servers online
+void CReadSendPacket::SendMasterServerInfo(const std::vector <CSession*>& Sessions, SMasterServerInfo info)
+{
+	CSendFrame* pFrame = BuildMasterServerInfo(info);
+	if(pFrame == NULL)
+		return;
 
-	p->writeString(EndBlock);                                    // End block
+	gEnv->pIoEngine->Broadcast(Sessions, pFrame);
+	pFrame->Release();
+}
 
-	p->padPacketTo8ByteLen();
-	p->encodeBlowfish(gEnv->bBlowFish);
-	p->appendChecksum(false);
-	p->appendMore8Bytes();
+CSendFrame* CReadSendPacket::BuildMasterServerInfo(SMasterServerInfo info)
+{
+	Log(LOG_DEBUG,"Send master server info to client...");
 
+	Packet* p = BuildSchemaPacket<SMasterServerInfoSchema>(PACKET_MS_INFO, info, false);
+	Packet* pV2 = gEnv->bProtocolV2 ? BuildSchemaPacket<SMasterServerInfoSchema>(PACKET_MS_INFO, info, true) : NULL;
 
-	int size = p->getPacketSize();
-	char* packet = (char*)p->getBytesPtr();
+	CSendFrame* pFrame = new CSendFrame(p, pV2);
 
-	SPacket.addr = Socket;
-	SPacket.data = packet;
-	SPacket.size = size;
+	// Packet that can't be encoded is not sent
+	if(!pFrame->IsValid())
+	{
+		Log(LOG_ERROR,"Can't encode packet!");
+		delete p;
+		delete pV2;
+		pFrame->Release();
+		return NULL;
+	}
 
-	gEnv->pPacketQueue->InsertPacketToSend(SPacket);
+	int size = pFrame->GetSize();
+	char* packet = pFrame->GetData();
 
 	if(gEnv->bDebugMode)
 	{
@@ -194,49 +271,54 @@ void CReadSendPacket::SendMasterServerInfo (SOCKET Socket, SMasterServerInfo inf
 
 		PacketDebugger::Debug(packet, size, "SendPacketsDebugg.txt");
 	}
-	gEnv->outPackets++;
-}
 
-void CReadSendPacket::SendGameServerInfo (SOCKET Socket, SGameServer server)
-{
-	SPacket SPacket;
+	delete p;
+	delete pV2;
 
-	Log(LOG_DEBUG,"Send game server info to client...");
+	return pFrame;
+}
 
-	Packet* p = new Packet();
+void CReadSendPacket::SendGameServerInfo(CSession* pSession, SGameServer server)
+{
+	CSendFrame* pFrame = BuildGameServerInfo(server);
+	if(pFrame == NULL)
+		return;
 
-	p->create();
+	gEnv->pIoEngine->Send(pSession, pFrame);
+	pFrame->Release();
+}
 
-	// Header
-	p->writeInt(PACKET_GAME_SERVER);                             // Packet type
-	p->writeString(gEnv->serverVersion);                         // Packet version
-	//
-        
-	p->writeInt(server.id);                                      // id
-	p->writeString(server.ip);                                   // ip
-	p->writeInt(server.port);                                    // port
-	p->writeString(server.serverName);                           // server name
-	p->writeInt(server.currentPlayers);                          // players online
-	p->writeInt(server.maxPlayers);                              // max players
-	p->writeString(server.mapName);                              // map name
-	p->writeString(server.gameRules);                            // game rules
+void CReadSendPacket::SendGameServerInfo(const std::vector <CSession*>& Sessions, SGameServer server)
+{
+	CSendFrame* pFrame = BuildGameServerInfo(server);
+	if(pFrame == NULL)
+		return;
 
-	p->writeString(EndBlock);                                    // End block
+	gEnv->pIoEngine->Broadcast(Sessions, pFrame);
+	pFrame->Release();
+}
 
-	p->padPacketTo8ByteLen();
-	p->encodeBlowfish(gEnv->bBlowFish);
-	p->appendChecksum(false);
-	p->appendMore8Bytes();
+CSendFrame* CReadSendPacket::BuildGameServerInfo(SGameServer server)
+{
+	Log(LOG_DEBUG,"Send game server info to client...");
 
+	Packet* p = BuildSchemaPacket<SGameServerSchema>(PACKET_GAME_SERVER, server, false);
+	Packet* pV2 = gEnv->bProtocolV2 ? BuildSchemaPacket<SGameServerSchema>(PACKET_GAME_SERVER, server, true) : NULL;
 
-	int size = p->getPacketSize();
-	char* packet = (char*)p->getBytesPtr();
+	CSendFrame* pFrame = new CSendFrame(p, pV2);
 
-	SPacket.addr = Socket;
-	SPacket.data = packet;
-	SPacket.size = size;
+	// Packet that can't be encoded is not sent
+	if(!pFrame->IsValid())
+	{
+		Log(LOG_ERROR,"Can't encode packet!");
+		delete p;
+		delete pV2;
+		pFrame->Release();
+		return NULL;
+	}
 
-	gEnv->pPacketQueue->InsertPacketToSend(SPacket);
+	int size = pFrame->GetSize();
+	char* packet = pFrame->GetData();
 
 	if(gEnv->bDebugMode)
 	{
@@ -253,94 +335,128 @@ void CReadSendPacket::SendGameServerInfo (SOCKET Socket, SGameServer server)
 		PacketDebugger::Debug(packet, size, "SendPacketsDebugg.txt");
 
 	}
-	gEnv->outPackets++;
+
+	delete p;
+	delete pV2;
+
+	return pFrame;
 }
 
-void CReadSendPacket::SendGameServers( SOCKET Socket)
+void CReadSendPacket::SendGameServers(CSession* pSession)
 {
-	SPacket SPacket;
-
 	Log(LOG_DEBUG,"Send all game servers to client...");
 
 	Packet* p = new Packet();
+	Packet* pV2 = new Packet();
 
-	p->create();
+	CPacketBuilder pb(p);
+	// Protocol v2 copy is written in same pass. It is dropped if some field is too long
+	// for v2 readers, then frame sends old packet under opcode 0
+	CPacketBuilder pbV2(pV2);
+	bool bVarFields = gEnv->bProtocolV2;
 
 	// Header
-	p->writeInt(PACKET_GAME_SERVERS);                            // Packet type
-	p->writeString(gEnv->serverVersion);                         // Packet version
+	pb.WriteInt(PACKET_GAME_SERVERS);                            // Packet type
+	pb.WriteString(gEnv->serverVersion);                         // Packet version
 	//
 
+	pbV2.WriteUChar(PACKET_GAME_SERVERS);                        // Opcode
+
+	// List can be big, it is sent as chunks. Snapshot is written without blocking connects,
+	// only server being written is locked
+	CSessionSnapshot snapshot;
+	gEnv->pServer->servers.GetSnapshot(snapshot);
+
+	pb.WriteInt (snapshot.GetCount());                           // size servers vector
+	pbV2.WriteVarUInt(snapshot.GetCount());
 	
-	p->writeInt ((int)gEnv->pServer->vServers.size());           // size servers vector
-	
-	
-	for( auto it = gEnv->pServer->vServers.begin(); it != gEnv->pServer->vServers.end(); ++it)
+	for( auto it = snapshot.sessions.begin(); it != snapshot.sessions.end(); ++it)
 	{
-		p->writeInt(it->id); 
-		p->writeString(it->ip);                                
-		p->writeInt(it->port);                               
-		p->writeString(it->serverName);                       
-		p->writeInt(it->currentPlayers);                   
-		p->writeInt(it->maxPlayers);                     
-		p->writeString(it->mapName);                          
-		p->writeString(it->gameRules);
+		(*it)->Lock();
+		pb.Reserve(SchemaSize<SGameServerSchema>((*it)->server));
+		SchemaWrite<SGameServerSchema>(pb, (*it)->server);       // Game server
+
+		if(bVarFields && SchemaVarFits<SGameServerSchema>((*it)->server))
+			SchemaVarWrite<SGameServerSchema>(pbV2, (*it)->server);
+		else
+			bVarFields = false;
+		(*it)->Unlock();
 	}
 
-	p->writeString(EndBlock);                                    // End block
+	pb.WriteString(EndBlock);                                    // End block
 
-	p->padPacketTo8ByteLen();
-	p->encodeBlowfish(gEnv->bBlowFish);
-	p->appendChecksum(false);
-	p->appendMore8Bytes();
+	pb.Finish();
+	pbV2.Finish();
 
+	if(!bVarFields)
+	{
+		delete pV2;
+		pV2 = NULL;
+	}
 
-	int size = p->getPacketSize();
-	char* packet = (char*)p->getBytesPtr();
-
-	SPacket.addr = Socket;
-	SPacket.data = packet;
-	SPacket.size = size;
+	CSendFrame* pFrame = new CSendFrame(p, pV2);
 
-	gEnv->pPacketQueue->InsertPacketToSend(SPacket);
-	gEnv->outPackets++;
-}
+	// Packet that can't be encoded is not sent
+	if(!pFrame->IsValid())
+	{
+		Log(LOG_ERROR,"Can't encode packet!");
+		delete p;
+		delete pV2;
+		pFrame->Release();
+		return;
+	}
 
-void CReadSendPacket::SendRequest(SOCKET Socket, SRequestPacket request)
-{
-	SPacket SPacket;
+	int size = pFrame->GetSize();
+	char* packet = pFrame->GetData();
 
-	Log(LOG_DEBUG,"Send request to client...");
+	gEnv->pIoEngine->Send(pSession, pFrame);
 
-	Packet* p = new Packet();
+	delete p;
+	delete pV2;
+	pFrame->Release();
+}
 
-	p->create();
+void CReadSendPacket::SendRequest(CSession* pSession, SRequestPacket request)
+{
+	CSendFrame* pFrame = BuildRequest(request);
+	if(pFrame == NULL)
+		return;
 
-	// Header
-	p->writeInt(PACKET_REQUEST);                                 // Packet type
-	p->writeString(gEnv->serverVersion);                         // Packet version
-	//
+	gEnv->pIoEngine->Send(pSession, pFrame);
+	pFrame->Release();
+}
 
-	p->writeString(request.request);                             // Request
-	p->writeString(request.sParam);                              // String param
-	p->writeInt(request.iParam);                                 // Int param
+void CReadSendPacket::SendRequest(const std::vector <CSession*>& Sessions, SRequestPacket request)
+{
+	CSendFrame* pFrame = BuildRequest(request);
+	if(pFrame == NULL)
+		return;
 
-	p->writeString(EndBlock);                                    // End block
+	gEnv->pIoEngine->Broadcast(Sessions, pFrame);
+	pFrame->Release();
+}
 
-	p->padPacketTo8ByteLen();
-	p->encodeBlowfish(gEnv->bBlowFish);
-	p->appendChecksum(false);
-	p->appendMore8Bytes();
+CSendFrame* CReadSendPacket::BuildRequest(SRequestPacket request)
+{
+	Log(LOG_DEBUG,"Send request to client...");
 
+	Packet* p = BuildRequestPacket(request, false);
+	Packet* pV2 = gEnv->bProtocolV2 ? BuildRequestPacket(request, true) : NULL;
 
-	int size = p->getPacketSize();
-	char* packet = (char*)p->getBytesPtr();
+	CSendFrame* pFrame = new CSendFrame(p, pV2);
 
-	SPacket.addr = Socket;
-	SPacket.data = packet;
-	SPacket.size = size;
+	// Packet that can't be encoded is not sent
+	if(!pFrame->IsValid())
+	{
+		Log(LOG_ERROR,"Can't encode packet!");
+		delete p;
+		delete pV2;
+		pFrame->Release();
+		return NULL;
+	}
 
-	gEnv->pPacketQueue->InsertPacketToSend(SPacket);
+	int size = pFrame->GetSize();
+	char* packet = pFrame->GetData();
 
 	if(gEnv->bDebugMode)
 	{
@@ -351,5 +467,9 @@ void CReadSendPacket::SendRequest(SOCKET Socket, SRequestPacket request)
 
 		PacketDebugger::Debug(packet, size, "SendPacketsDebugg.txt");
 	}
-	gEnv->outPackets++;
+
+	delete p;
+	delete pV2;
+
+	return pFrame;
 }
\ No newline at end of file
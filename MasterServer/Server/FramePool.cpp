@@ -0,0 +1,128 @@
+/*************************************************************************
+Copyright (C), chernecoff@gmail.com, 2014-2015
+--------------------------------------------------------------------------
+History:
+
+- 16.10.2026   23:10 : Created by agent
+-------------------------------------------------------------------------
+
+*************************************************************************/
+#include "StdAfx.h"
+#include "FramePool.h"
+
+CFramePool::SClass CFramePool::classes[FRAME_POOL_CLASSES + 1];
+
+void CFramePool::Init(int cacheSize)
+{
+	if(cacheSize <= 0)
+		cacheSize = FRAME_POOL_DEFAULT_CACHE;
+
+	for(int i = 0; i <= FRAME_POOL_CLASSES; i++)
+	{
+		SClass& c = classes[i];
+		c.pFree = NULL;
+		c.cached = 0;
+		c.maxCached = i < FRAME_POOL_CLASSES ? cacheSize / GetClassSize(i) : 0;
+
+		c.inUse = 0;
+		c.peakInUse = 0;
+		c.allocations = 0;
+		c.misses = 0;
+	}
+}
+
+int CFramePool::GetClass(int size)
+{
+	for(int i = 0; i < FRAME_POOL_CLASSES; i++)
+	{
+		if(size <= GetClassSize(i))
+			return i;
+	}
+
+	return FRAME_POOL_CLASSES;
+}
+
+void CFramePool::Take(SClass& c)
+{
+	c.allocations++;
+
+	int inUse = ++c.inUse;
+	int peak = c.peakInUse;
+	while(inUse > peak && !c.peakInUse.compare_exchange_weak(peak, inUse)) {}
+}
+
+char* CFramePool::Alloc(int size)
+{
+	int sizeClass = GetClass(size);
+	SClass& c = classes[sizeClass];
+	SBlock* pBlock = NULL;
+
+	if(sizeClass < FRAME_POOL_CLASSES)
+	{
+		c.mutex.lock();
+		pBlock = c.pFree;
+		if(pBlock != NULL)
+		{
+			c.pFree = pBlock->pNext;
+			c.cached--;
+		}
+		c.mutex.unlock();
+
+		size = GetClassSize(sizeClass);
+	}
+
+	// Block header keeps class, so buffer is freed without size
+	if(pBlock == NULL)
+	{
+		pBlock = (SBlock*)new char [sizeof(SBlock) + size];
+		pBlock->sizeClass = sizeClass;
+		c.misses++;
+	}
+
+	pBlock->pNext = NULL;
+	Take(c);
+
+	return (char*)(pBlock + 1);
+}
+
+void CFramePool::Free(char* buffer)
+{
+	if(buffer == NULL)
+		return;
+
+	SBlock* pBlock = (SBlock*)buffer - 1;
+	SClass& c = classes[pBlock->sizeClass];
+
+	c.inUse--;
+
+	if(pBlock->sizeClass < FRAME_POOL_CLASSES)
+	{
+		c.mutex.lock();
+		if(c.cached < c.maxCached)
+		{
+			pBlock->pNext = c.pFree;
+			c.pFree = pBlock;
+			c.cached++;
+			pBlock = NULL;
+		}
+		c.mutex.unlock();
+	}
+
+	delete[] (char*)pBlock;
+}
+
+void CFramePool::GetStats(int sizeClass, SFramePoolStats& stats)
+{
+	SClass& c = classes[sizeClass];
+
+	c.mutex.lock();
+	stats.cached = c.cached;
+	stats.maxCached = c.maxCached;
+	c.mutex.unlock();
+
+	stats.bufferSize = sizeClass < FRAME_POOL_CLASSES ? GetClassSize(sizeClass) : 0;
+	stats.inUse = c.inUse;
+	stats.peakInUse = c.peakInUse;
+	stats.allocations = c.allocations;
+	stats.misses = c.misses;
+}
@@ -0,0 +1,80 @@
+/*************************************************************************
+Copyright (C), chernecoff@gmail.com, 2014-2015
+--------------------------------------------------------------------------
+History:
+
+- 16.10.2026   23:10 : Created by agent
+-------------------------------------------------------------------------
+Pool of outbound frame buffers. Buffers are taken from few size classes
+and go back to free list of their class when last connection sent the
+frame, so steady traffic doesn't touch heap. Every class caches limited
+number of bytes, bigger buffers are allocated from heap.
+*************************************************************************/
+
+#ifndef _FramePool_
+#define _FramePool_
+
+#include <mutex>
+#include <atomic>
+
+// Size classes. Biggest one fits encoded chunk packet
+#define FRAME_POOL_CLASSES 5
+#define FRAME_POOL_MIN_SIZE 256
+// Default bytes cached by one class
+#define FRAME_POOL_DEFAULT_CACHE (4 * 1024 * 1024)
+
+// Occupancy of one size class
+struct SFramePoolStats
+{
+	int bufferSize;        // Buffer size of class, 0 for heap buffers
+	int inUse;             // Buffers held by frames
+	int peakInUse;         // Most buffers held at once
+	int cached;            // Free buffers waiting in pool
+	int maxCached;         // Free buffers limit
+	int allocations;       // Buffers taken by frames
+	int misses;            // Allocations not served from pool
+};
+
+class CFramePool
+{
+public:
+	// Bytes cached by one class, 0 - default. Called once on startup
+	static void Init(int cacheSize);
+
+	// Any thread
+	static char* Alloc(int size);
+	static void Free(char* buffer);
+
+	// Classes with heap buffers as last one
+	static int GetClassesCount() { return FRAME_POOL_CLASSES + 1; }
+	static void GetStats(int sizeClass, SFramePoolStats& stats);
+
+private:
+	struct SBlock
+	{
+		SBlock* pNext;
+		int sizeClass;
+	};
+
+	struct SClass
+	{
+		std::mutex mutex;
+		SBlock* pFree;
+		int cached;
+		int maxCached;
+
+		std::atomic<int> inUse;
+		std::atomic<int> peakInUse;
+		std::atomic<int> allocations;
+		std::atomic<int> misses;
+	};
+
+	static int GetClass(int size);
+	static int GetClassSize(int sizeClass) { return FRAME_POOL_MIN_SIZE << (sizeClass * 2); }
+	static void Take(SClass& c);
+
+	// Last class counts heap buffers
+	static SClass classes[FRAME_POOL_CLASSES + 1];
+};
+
+#endif
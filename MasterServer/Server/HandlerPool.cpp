@@ -0,0 +1,72 @@
+/*************************************************************************
+Copyright (C), chernecoff@gmail.com, 2014-2015
+--------------------------------------------------------------------------
+History:
+
+- 16.10.2026   23:25 : Created by agent
+-------------------------------------------------------------------------
+
+*************************************************************************/
+
+#include "StdAfx.h"
+#include "PacketQueue.h"
+
+CHandlerPool::CHandlerPool()
+{
+	workers = NULL;
+	workersCount = 0;
+	name = "";
+}
+
+void CHandlerPool::Init(const char* poolName, int threads)
+{
+	name = poolName;
+
+	if(threads <= 0)
+	{
+		Log(LOG_INFO,"%s pool is off, its handlers run on read workers", name);
+		return;
+	}
+
+	workersCount = threads;
+	workers = new SWorker[workersCount];
+
+	for(int i = 0; i < workersCount; i++)
+	{
+		std::thread WorkerThread(&CHandlerPool::WorkerThread, this, i);
+		WorkerThread.detach();
+	}
+
+	Log(LOG_INFO,"%s pool started with %d workers", name, workersCount);
+}
+
+void CHandlerPool::Push(SOCKET socket, SPacketJob* pJob)
+{
+	// Socket handles are multiples of 4
+	int worker = (int)((socket >> 2) % workersCount);
+
+	// Read worker pushing here must not wait for handlers, full pool keeps job in overflow list
+	workers[worker].queue.PushOrKeep(pJob);
+}
+
+int CHandlerPool::GetQueueDepth()
+{
+	int depth = 0;
+	for(int i = 0; i < workersCount; i++)
+		depth += workers[i].queue.Count();
+
+	return depth;
+}
+
+void CHandlerPool::WorkerThread(int worker)
+{
+	SWorker* pWorker = &workers[worker];
+
+	while(true)
+	{
+		SPacketJob* pJob = NULL;
+		pWorker->queue.PopWait(pJob);
+
+		gEnv->pPacketQueue->RunJob(pJob);
+	}
+}
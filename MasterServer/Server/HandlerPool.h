@@ -0,0 +1,51 @@
+/*************************************************************************
+Copyright (C), chernecoff@gmail.com, 2014-2015
+--------------------------------------------------------------------------
+History:
+
+- 16.10.2026   23:25 : Created by agent
+-------------------------------------------------------------------------
+Threads running packet handlers outside read workers. Jobs of one
+socket always go to same thread, so handlers of one connection keep
+order inside pool.
+*************************************************************************/
+
+#ifndef _HandlerPool_
+#define _HandlerPool_
+
+#include "MpscQueue.h"
+
+struct SPacketJob;
+
+class CHandlerPool
+{
+public:
+	CHandlerPool();
+
+	// Threads count 0 - pool is off
+	void Init(const char* name, int threads);
+
+	// Pool takes job and frees it after handler
+	void Push(SOCKET socket, SPacketJob* pJob);
+
+	bool IsStarted()        { return workersCount > 0; }
+	int GetWorkersCount()   { return workersCount; }
+	// Jobs waiting in all threads
+	int GetQueueDepth();
+
+private:
+	void WorkerThread(int worker);
+
+	struct SWorker
+	{
+		SWorker() : queue(PACKET_QUEUE_SIZE) {}
+
+		CMpscQueue <SPacketJob*> queue;
+	};
+
+	SWorker* workers;
+	int workersCount;
+	const char* name;
+};
+
+#endif
@@ -0,0 +1,682 @@
+/*************************************************************************
+Copyright (C), chernecoff@gmail.com, 2014-2015
+--------------------------------------------------------------------------
+History:
+
+- 16.10.2026   22:35 : Created by agent
+-------------------------------------------------------------------------
+
+*************************************************************************/
+
+#include "StdAfx.h"
+#include <winsock2.h>
+
+#include "IoEngine.h"
+
+CIoEngine::CIoEngine()
+{
+	hCompletionPort = NULL;
+	threadsCount = 0;
+	connectionsCount = 0;
+}
+
+CIoEngine::~CIoEngine()
+{
+	Stop();
+}
+
+bool CIoEngine::Init(int threads)
+{
+	Log(LOG_DEBUG,"CIoEngine::Init()");
+
+	if(threads <= 0)
+	{
+		SYSTEM_INFO info;
+		GetSystemInfo(&info);
+		threads = (int)info.dwNumberOfProcessors;
+	}
+
+	hCompletionPort = CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, threads);
+
+	if(hCompletionPort == NULL)
+	{
+		Log(LOG_ERROR,"CIoEngine::Can't create completion port! Error %d", GetLastError());
+		return false;
+	}
+
+	threadsCount = threads;
+
+	for(int i = 0; i < threadsCount; i++)
+		ioThreads.push_back(std::thread(&CIoEngine::IoThread, this));
+
+	Log(LOG_INFO,"Io engine started with %d threads", threadsCount);
+	return true;
+}
+
+void CIoEngine::Stop()
+{
+	if(hCompletionPort == NULL)
+		return;
+
+	// Null completion key stops io thread
+	for(int i = 0; i < threadsCount; i++)
+		PostQueuedCompletionStatus(hCompletionPort, 0, 0, NULL);
+
+	for(auto it = ioThreads.begin(); it != ioThreads.end(); ++it)
+		it->join();
+
+	ioThreads.clear();
+	threadsCount = 0;
+
+	// Nobody completes pending operations anymore, so connections are closed here without
+	// disconnect callbacks. Only map reference is released, pending receive and send keep theirs
+	std::vector <SConnection*> closed;
+
+	// Lock
+	mutex.lock();
+
+	for(auto it = connections.begin(); it != connections.end(); ++it)
+		closed.push_back(it->second);
+
+	connections.clear();
+
+	mutex.unlock();
+	// Unlock
+
+	for(auto it = closed.begin(); it != closed.end(); ++it)
+	{
+		SConnection* pConnection = *it;
+
+		if(pConnection->bClosed.exchange(true))
+			continue;
+
+		pConnection->mutex.lock();
+		closesocket(pConnection->socket);
+		pConnection->mutex.unlock();
+
+		connectionsCount--;
+
+		ReleaseConnection(pConnection);
+	}
+
+	CloseHandle(hCompletionPort);
+	hCompletionPort = NULL;
+}
+
+bool CIoEngine::AddConnection(SOCKET socket, const char* ip, CKeyExchange* pKeyExchange)
+{
+	// Engine is stopped, socket is closed by caller
+	if(hCompletionPort == NULL)
+	{
+		delete pKeyExchange;
+		return false;
+	}
+
+	SConnection* pConnection = new SConnection;
+	memset(&pConnection->recvContext, 0, sizeof(SIoContext));
+	memset(&pConnection->sendContext, 0, sizeof(SIoContext));
+	memset(pConnection->ip, 0, sizeof(pConnection->ip));
+
+	pConnection->socket = socket;
+	pConnection->type = CONNECTION_UNKNOWN;
+	strncpy(pConnection->ip, ip, sizeof(pConnection->ip) - 1);
+
+	pConnection->sendOffset = 0;
+	pConnection->bSending = false;
+	pConnection->bClosed = false;
+
+	// Session key is made only after client accepts it
+	pConnection->pKeyExchange = pKeyExchange;
+	pConnection->pSessionKey = NULL;
+	pConnection->pAeadKey = NULL;
+	pConnection->bProtocolV2 = false;
+	pConnection->bLz4 = false;
+	pConnection->pSession = NULL;
+
+	// Connections map and pending receive
+	pConnection->refCount = 2;
+
+	if(CreateIoCompletionPort((HANDLE)socket, hCompletionPort, (ULONG_PTR)pConnection, 0) == NULL)
+	{
+		Log(LOG_ERROR,"CIoEngine::Can't bind socket from '%s' to completion port! Error %d", ip, GetLastError());
+		delete pKeyExchange;
+		delete pConnection;
+		return false;
+	}
+
+	// Lock
+	mutex.lock();
+	connections[socket] = pConnection;
+	mutex.unlock();
+	// Unlock
+
+	connectionsCount++;
+
+	if(!PostRecv(pConnection))
+	{
+		CloseConnection(pConnection);
+		ReleaseConnection(pConnection);
+	}
+
+	return true;
+}
+
+bool CIoEngine::Send(SOCKET socket, const char* data, int size)
+{
+	CSendFrame* pFrame = new CSendFrame(data, size);
+	bool result = Send(socket, pFrame);
+	pFrame->Release();
+
+	return result;
+}
+
+bool CIoEngine::Send(SOCKET socket, CSendFrame* pFrame)
+{
+	SConnection* pConnection = AcquireConnection(socket);
+
+	if(pConnection == NULL)
+	{
+		Log(LOG_DEBUG,"CIoEngine::Send::Dead socket!");
+		return false;
+	}
+
+	bool bSent = Send(pConnection, pFrame);
+
+	ReleaseConnection(pConnection);
+	return bSent;
+}
+
+bool CIoEngine::Send(CSession* pSession, CSendFrame* pFrame)
+{
+	SConnection* pConnection = AcquireConnection(pSession->GetSocket());
+
+	if(pConnection == NULL)
+	{
+		Log(LOG_DEBUG,"CIoEngine::Send::Dead socket!");
+		return false;
+	}
+
+	// Caller holds session, so its address is not reused by session of new connection
+	bool bSent = false;
+	if(pConnection->pSession == pSession)
+		bSent = Send(pConnection, pFrame);
+	else
+		Log(LOG_DEBUG,"CIoEngine::Send::Socket of closed session is used by other connection");
+
+	ReleaseConnection(pConnection);
+	return bSent;
+}
+
+bool CIoEngine::Send(SConnection* pConnection, CSendFrame* pFrame)
+{
+	// Empty send would be completed as closed connection
+	if(!pFrame->IsValid())
+		return false;
+
+	bool bSent = false;
+
+	// Lock
+	pConnection->encodeMutex.lock();
+
+	pConnection->mutex.lock();
+	bool bClosed = pConnection->bClosed;
+	int flags = (pConnection->bProtocolV2 ? FRAME_PROTOCOL_V2 : 0) | (pConnection->bLz4 ? FRAME_LZ4 : 0);
+	CBlowfishKey* pSessionKey = pConnection->pSessionKey;
+	CAesGcmKey* pAeadKey = pConnection->pAeadKey;
+	pConnection->mutex.unlock();
+
+	// Session key connection gets own copy, shared frame is encoded by default key.
+	// Frame body is shared, only encode or seal pass is done per connection. It runs
+	// outside of connection mutex, encode mutex keeps AES-GCM sequence in sending order
+	CSendFrame* pSessionFrame = NULL;
+	if(!bClosed)
+	{
+		if(pAeadKey != NULL)
+			pSessionFrame = pFrame->Seal(pAeadKey, flags);
+		else if(pSessionKey != NULL)
+			pSessionFrame = pFrame->Encode(pSessionKey, flags);
+		else if(flags != 0)
+			pSessionFrame = pFrame->GetVariant(flags);
+	}
+
+	pConnection->mutex.lock();
+
+	if(!pConnection->bClosed)
+	{
+		if(pSessionFrame != NULL)
+			pConnection->sendQueue.push_back(pSessionFrame);
+		else
+		{
+			pFrame->AddRef();
+			pConnection->sendQueue.push_back(pFrame);
+		}
+
+		pSessionFrame = NULL;
+		bSent = true;
+
+		// Start new send only if no send is pending, else packet goes with next batch
+		if(!pConnection->bSending)
+		{
+			pConnection->bSending = true;
+			pConnection->refCount++;
+
+			PostSend(pConnection);
+		}
+	}
+
+	pConnection->mutex.unlock();
+
+	pConnection->encodeMutex.unlock();
+	// Unlock
+
+	// Connection closed while frame was encoded
+	if(pSessionFrame != NULL)
+		pSessionFrame->Release();
+
+	if(bSent)
+		gEnv->outPackets++;
+
+	return bSent;
+}
+
+bool CIoEngine::EnableSessionKey(SConnection* pConnection, ESessionCrypto crypto, const char* peerKey)
+{
+	if(pConnection->pKeyExchange == NULL || crypto == SESSION_CRYPTO_NONE)
+		return false;
+
+	if(crypto == SESSION_CRYPTO_AES_GCM && !gEnv->bAead)
+		return false;
+
+	// Key pair is needed only once
+	unsigned char key[SESSION_KEY_SIZE];
+	const char* label = crypto == SESSION_CRYPTO_AES_GCM ? KEY_LABEL_AES_GCM : KEY_LABEL_BLOWFISH;
+	bool bDerived = pConnection->pKeyExchange->DeriveKey(peerKey, label, key);
+
+	delete pConnection->pKeyExchange;
+	pConnection->pKeyExchange = NULL;
+
+	if(!bDerived)
+	{
+		Log(LOG_WARNING,"Client '%s' sent bad public key, session key is not used", pConnection->ip);
+		return false;
+	}
+
+	// Lock
+	pConnection->mutex.lock();
+
+	if(pConnection->pSessionKey == NULL && pConnection->pAeadKey == NULL)
+	{
+		if(crypto == SESSION_CRYPTO_AES_GCM)
+			pConnection->pAeadKey = new CAesGcmKey(key, true);
+		else
+			pConnection->pSessionKey = new CBlowfishKey(key, SESSION_KEY_SIZE);
+	}
+
+	pConnection->mutex.unlock();
+	// Unlock
+
+	return true;
+}
+
+void CIoEngine::EnableProtocolV2(SConnection* pConnection)
+{
+	// Lock
+	pConnection->mutex.lock();
+	pConnection->bProtocolV2 = true;
+	pConnection->mutex.unlock();
+	// Unlock
+}
+
+void CIoEngine::EnableLz4(SConnection* pConnection)
+{
+	// Lock
+	pConnection->mutex.lock();
+	pConnection->bLz4 = true;
+	pConnection->mutex.unlock();
+	// Unlock
+}
+
+void CIoEngine::Broadcast(const std::vector <CSession*>& sessions, CSendFrame* pFrame)
+{
+	int count = (int)sessions.size();
+
+	if(count <= IO_BROADCAST_CHUNK)
+	{
+		for(int i = 0; i < count; i++)
+			Send(sessions[i], pFrame);
+
+		return;
+	}
+
+	// Many recipients - every io thread takes part of them
+	for(int i = 0; i < count; i += IO_BROADCAST_CHUNK)
+	{
+		int end = i + IO_BROADCAST_CHUNK;
+		if(end > count)
+			end = count;
+
+		SBroadcastJob* pJob = new SBroadcastJob;
+		memset(&pJob->overlapped, 0, sizeof(OVERLAPPED));
+		pJob->sessions.assign(sessions.begin() + i, sessions.begin() + end);
+		for(auto it = pJob->sessions.begin(); it != pJob->sessions.end(); ++it)
+			(*it)->AddRef();
+		pJob->pFrame = pFrame;
+		pFrame->AddRef();
+
+		PostQueuedCompletionStatus(hCompletionPort, 0, IO_BROADCAST_KEY, &pJob->overlapped);
+	}
+}
+
+void CIoEngine::OnBroadcast(SBroadcastJob* pJob)
+{
+	for(auto it = pJob->sessions.begin(); it != pJob->sessions.end(); ++it)
+	{
+		Send(*it, pJob->pFrame);
+		(*it)->Release();
+	}
+
+	pJob->pFrame->Release();
+	delete pJob;
+}
+
+bool CIoEngine::PostRecv(SConnection* pConnection)
+{
+	SIoContext* pContext = &pConnection->recvContext;
+
+	memset(&pContext->overlapped, 0, sizeof(OVERLAPPED));
+	pContext->operation = IO_RECV;
+	pContext->buffer.buf = pConnection->framer.GetWritePtr();
+	pContext->buffer.len = pConnection->framer.GetWriteSize();
+
+	DWORD flags = 0;
+	bool result = true;
+
+	// Lock
+	pConnection->mutex.lock();
+
+	if(pConnection->bClosed)
+		result = false;
+	else if(WSARecv(pConnection->socket, &pContext->buffer, 1, NULL, &flags, &pContext->overlapped, NULL) == SOCKET_ERROR)
+	{
+		if(WSAGetLastError() != WSA_IO_PENDING)
+			result = false;
+	}
+
+	pConnection->mutex.unlock();
+	// Unlock
+
+	return result;
+}
+
+// Connection mutex must be locked. Send can be posted under server lock,
+// so errors are passed to io thread instead of closing connection here
+void CIoEngine::PostSend(SConnection* pConnection)
+{
+	if(pConnection->bClosed)
+	{
+		pConnection->bSending = false;
+		return;
+	}
+
+	// Take waiting packets to batch
+	int count = (int)pConnection->sending.size();
+	int waiting = (int)pConnection->sendQueue.size();
+	int take = IO_MAX_SEND_BUFFERS - count;
+
+	if(take > waiting)
+		take = waiting;
+
+	if(take > 0)
+	{
+		pConnection->sending.insert(pConnection->sending.end(), pConnection->sendQueue.begin(), pConnection->sendQueue.begin() + take);
+		pConnection->sendQueue.erase(pConnection->sendQueue.begin(), pConnection->sendQueue.begin() + take);
+		count += take;
+	}
+
+	if(count == 0)
+	{
+		pConnection->bSending = false;
+		return;
+	}
+
+	for(int i = 0; i < count; i++)
+	{
+		pConnection->sendBuffers[i].buf = pConnection->sending[i]->GetData();
+		pConnection->sendBuffers[i].len = pConnection->sending[i]->GetSize();
+	}
+
+	// Rest of partially sent packet
+	pConnection->sendBuffers[0].buf += pConnection->sendOffset;
+	pConnection->sendBuffers[0].len -= pConnection->sendOffset;
+
+	SIoContext* pContext = &pConnection->sendContext;
+	memset(&pContext->overlapped, 0, sizeof(OVERLAPPED));
+	pContext->operation = IO_SEND;
+
+	if(WSASend(pConnection->socket, pConnection->sendBuffers, count, NULL, 0, &pContext->overlapped, NULL) == SOCKET_ERROR)
+	{
+		if(WSAGetLastError() != WSA_IO_PENDING)
+			PostQueuedCompletionStatus(hCompletionPort, 0, (ULONG_PTR)pConnection, &pContext->overlapped);
+	}
+}
+
+void CIoEngine::IoThread()
+{
+	while(true)
+	{
+		DWORD size = 0;
+		ULONG_PTR key = 0;
+		LPOVERLAPPED pOverlapped = NULL;
+
+		BOOL result = GetQueuedCompletionStatus(hCompletionPort, &size, &key, &pOverlapped, INFINITE);
+
+		SConnection* pConnection = (SConnection*)key;
+
+		if(pConnection == NULL)
+			break;
+
+		if(pOverlapped == NULL)
+			continue;
+
+		if(key == IO_BROADCAST_KEY)
+		{
+			OnBroadcast((SBroadcastJob*)pOverlapped);
+			continue;
+		}
+
+		SIoContext* pContext = (SIoContext*)pOverlapped;
+
+		// Error or graceful close
+		if(!result || size == 0)
+		{
+			OnIoError(pConnection, pContext);
+			continue;
+		}
+
+		switch (pContext->operation)
+		{
+		case IO_RECV:
+			OnRecv(pConnection, (int)size);
+			break;
+		case IO_SEND:
+			OnSend(pConnection, (int)size);
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+void CIoEngine::OnRecv(SConnection* pConnection, int size)
+{
+	pConnection->framer.Commit(size);
+
+	// One recv can hold many packets or only part of one
+	SPacket packet;
+	while(pConnection->framer.NextPacket(packet.data, packet.size))
+	{
+		if(!OnPacket(pConnection, packet))
+		{
+			CloseConnection(pConnection);
+			ReleaseConnection(pConnection);
+			return;
+		}
+	}
+
+	if(!pConnection->framer.Compact())
+	{
+		Log(LOG_WARNING,"CIoEngine::Broken packet stream from '%s'", pConnection->ip);
+		CloseConnection(pConnection);
+		ReleaseConnection(pConnection);
+		return;
+	}
+
+	// Only one receive is pending per connection, so packets of one connection come in order
+	if(!PostRecv(pConnection))
+	{
+		CloseConnection(pConnection);
+		ReleaseConnection(pConnection);
+	}
+}
+
+void CIoEngine::OnSend(SConnection* pConnection, int size)
+{
+	// Lock
+	pConnection->mutex.lock();
+
+	// Free sent packets. Completion can be partial, rest goes with next send
+	int sent = pConnection->sendOffset + size;
+	int done = 0;
+
+	while(done < (int)pConnection->sending.size() && sent >= pConnection->sending[done]->GetSize())
+	{
+		sent -= pConnection->sending[done]->GetSize();
+		pConnection->sending[done]->Release();
+		done++;
+	}
+
+	pConnection->sending.erase(pConnection->sending.begin(), pConnection->sending.begin() + done);
+	pConnection->sendOffset = sent;
+
+	// Everything queued while previous send was pending goes out now
+	PostSend(pConnection);
+	bool bSending = pConnection->bSending;
+
+	pConnection->mutex.unlock();
+	// Unlock
+
+	// Nothing more to send, pending send reference is released
+	if(!bSending)
+		ReleaseConnection(pConnection);
+}
+
+void CIoEngine::OnIoError(SConnection* pConnection, SIoContext* pContext)
+{
+	if(pContext->operation == IO_SEND)
+	{
+		// Lock
+		pConnection->mutex.lock();
+		pConnection->bSending = false;
+		pConnection->mutex.unlock();
+		// Unlock
+	}
+
+	CloseConnection(pConnection);
+	ReleaseConnection(pConnection);
+}
+
+bool CIoEngine::OnPacket(SConnection* pConnection, SPacket packet)
+{
+	gEnv->inPackets++;
+
+	packet.addr = pConnection->socket;
+
+	switch (pConnection->type)
+	{
+	case CONNECTION_UNKNOWN:
+		return gEnv->pServer->OnNewConnection(pConnection, packet);
+	case CONNECTION_CLIENT:
+		gEnv->pServer->OnClientPacket(pConnection, packet);
+		break;
+	case CONNECTION_GAME_SERVER:
+		gEnv->pServer->OnGameServerPacket(pConnection, packet);
+		break;
+	default:
+		break;
+	}
+
+	return true;
+}
+
+void CIoEngine::CloseConnection(SConnection* pConnection)
+{
+	if(pConnection->bClosed.exchange(true))
+		return;
+
+	// Lock
+	mutex.lock();
+	connections.erase(pConnection->socket);
+	mutex.unlock();
+	// Unlock
+
+	if(pConnection->type != CONNECTION_UNKNOWN)
+		gEnv->pServer->OnDisconnect(pConnection);
+
+	// Pending operations complete with error and release their references
+	pConnection->mutex.lock();
+	closesocket(pConnection->socket);
+	pConnection->mutex.unlock();
+
+	connectionsCount--;
+
+	ReleaseConnection(pConnection);
+}
+
+SConnection* CIoEngine::AcquireConnection(SOCKET socket)
+{
+	SConnection* pConnection = NULL;
+
+	// Lock
+	mutex.lock();
+
+	auto it = connections.find(socket);
+	if(it != connections.end())
+	{
+		pConnection = it->second;
+		pConnection->refCount++;
+	}
+
+	mutex.unlock();
+	// Unlock
+
+	return pConnection;
+}
+
+void CIoEngine::ReleaseConnection(SConnection* pConnection)
+{
+	if(--pConnection->refCount > 0)
+		return;
+
+	for(auto it = pConnection->sending.begin(); it != pConnection->sending.end(); ++it)
+		(*it)->Release();
+
+	for(auto it = pConnection->sendQueue.begin(); it != pConnection->sendQueue.end(); ++it)
+		(*it)->Release();
+
+	if(pConnection->pSessionKey != NULL)
+		pConnection->pSessionKey->Release();
+
+	if(pConnection->pAeadKey != NULL)
+		pConnection->pAeadKey->Release();
+
+	delete pConnection->pKeyExchange;
+
+	// No receive is pending now, so marker is last in read queue after packets of session
+	if(pConnection->pSession != NULL)
+	{
+		gEnv->pPacketQueue->InsertCloseMarker(pConnection->pSession);
+		pConnection->pSession->Release();
+	}
+
+	delete pConnection;
+}
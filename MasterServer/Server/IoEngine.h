@@ -0,0 +1,168 @@
+/*************************************************************************
+Copyright (C), chernecoff@gmail.com, 2014-2015
+--------------------------------------------------------------------------
+History:
+
+- 16.10.2026   22:35 : Created by agent
+-------------------------------------------------------------------------
+Completion port based connection engine. All client and game server
+sockets are served by small fixed pool of io threads instead of
+one thread per connection.
+*************************************************************************/
+
+#ifndef _IO_ENGINE_
+#define _IO_ENGINE_
+
+#include <winsock2.h>
+#include <unordered_map>
+#include "Packets\RSP.h"
+#include "..\..\Common\PacketFramer.h"
+#include "Packets\BlowfishKey.h"
+#include "Packets\AesGcmKey.h"
+#include "Packets\KeyExchange.h"
+#include "SendFrame.h"
+#include "Session.h"
+
+// Connection types. Connection is unknown until first packet
+enum EConnectionType
+{
+	CONNECTION_UNKNOWN = 0,
+	CONNECTION_CLIENT,
+	CONNECTION_GAME_SERVER,
+};
+
+// Overlapped operations
+enum EIoOperation
+{
+	IO_RECV = 0,
+	IO_SEND,
+};
+
+// Max packets flushed by one WSASend
+#define IO_MAX_SEND_BUFFERS 64
+// Broadcast to more connections is split between io threads
+#define IO_BROADCAST_CHUNK 256
+// Completion key of broadcast jobs
+#define IO_BROADCAST_KEY ((ULONG_PTR)1)
+
+// Overlapped context. OVERLAPPED must be first, completion port returns pointer to it
+struct SIoContext
+{
+	OVERLAPPED overlapped;
+	EIoOperation operation;
+	WSABUF buffer;
+};
+
+// Accepted socket. Deleted when last reference is released:
+// one for connections map, one for pending receive, one for pending send
+struct SConnection
+{
+	SOCKET socket;
+	EConnectionType type;
+	char ip[16];
+
+	SIoContext recvContext;
+	CPacketFramer framer;
+
+	// Outbound queue. Waiting packets go out by one WSASend when previous send completes
+	SIoContext sendContext;
+	WSABUF sendBuffers[IO_MAX_SEND_BUFFERS];
+	std::vector <CSendFrame*> sendQueue;
+	std::vector <CSendFrame*> sending;
+	int sendOffset;
+	bool bSending;
+
+	// Key pair of session key exchange, public key is sent in identification packet.
+	// Blowfish or AES-GCM key is made by it when client accepted it and sent own public key.
+	// Set once by io thread of connection, read by senders under mutex
+	CKeyExchange* pKeyExchange;
+	CBlowfishKey* pSessionKey;
+	CAesGcmKey* pAeadKey;
+	// Client accepted protocol v2 and LZ4. Set and read like session key
+	bool bProtocolV2;
+	bool bLz4;
+
+	// Client or game server of connection, set by first packet. Connection holds reference
+	CSession* pSession;
+
+	// Guards socket against close while posting receive or send
+	std::mutex mutex;
+	// Held by sender from reading session key till frame is queued, so packets are
+	// encoded and sealed in sending order while io thread doesn't wait for encoding
+	std::mutex encodeMutex;
+	std::atomic<bool> bClosed;
+	std::atomic<int> refCount;
+};
+
+// Part of big broadcast, done by io thread
+struct SBroadcastJob
+{
+	OVERLAPPED overlapped;
+	CSendFrame* pFrame;
+	// Job holds reference of every session
+	std::vector <CSession*> sessions;
+};
+
+class CIoEngine
+{
+public:
+	CIoEngine();
+	~CIoEngine();
+
+	// Create completion port and io threads. 0 - one thread per cpu core
+	bool Init(int threads);
+	// Stop io threads, close accepted sockets and completion port
+	void Stop();
+
+	// Register accepted socket and start receiving. Socket and key exchange are owned by engine
+	bool AddConnection(SOCKET socket, const char* ip, CKeyExchange* pKeyExchange = NULL);
+	// Client accepted session key and sent own public key. Next packets of connection are encoded by key
+	bool EnableSessionKey(SConnection* pConnection, ESessionCrypto crypto, const char* peerKey);
+	// Client accepted protocol v2. Next packets of connection have opcode header
+	void EnableProtocolV2(SConnection* pConnection);
+	// Client accepted LZ4. Next big messages of connection are compressed
+	void EnableLz4(SConnection* pConnection);
+
+	// Queue packet copy to connection outbound queue. Any thread
+	bool Send(SOCKET socket, const char* data, int size);
+	// Queue shared frame. Connection takes own reference. Only for connection without session,
+	// socket handle can be reused by new connection after close
+	bool Send(SOCKET socket, CSendFrame* pFrame);
+	// Queue shared frame to connection of session. Nothing is sent if connection is closed,
+	// new connection with same socket handle has other session
+	bool Send(CSession* pSession, CSendFrame* pFrame);
+	// Queue one frame to connections of many sessions
+	void Broadcast(const std::vector <CSession*>& sessions, CSendFrame* pFrame);
+
+	int GetConnectionsCount() { return connectionsCount; }
+
+private:
+	void IoThread();
+	bool PostRecv(SConnection* pConnection);
+	void PostSend(SConnection* pConnection);
+	void OnRecv(SConnection* pConnection, int size);
+	void OnSend(SConnection* pConnection, int size);
+	void OnIoError(SConnection* pConnection, SIoContext* pContext);
+	void OnBroadcast(SBroadcastJob* pJob);
+	bool OnPacket(SConnection* pConnection, SPacket packet);
+	void CloseConnection(SConnection* pConnection);
+
+	// Connection must be acquired
+	bool Send(SConnection* pConnection, CSendFrame* pFrame);
+
+	SConnection* AcquireConnection(SOCKET socket);
+	void ReleaseConnection(SConnection* pConnection);
+
+private:
+	HANDLE hCompletionPort;
+	int threadsCount;
+	// Joined by Stop before sockets and completion port are closed
+	std::vector <std::thread> ioThreads;
+
+	std::mutex mutex;
+	std::unordered_map <SOCKET, SConnection*> connections;
+
+	std::atomic<int> connectionsCount;
+};
+
+#endif
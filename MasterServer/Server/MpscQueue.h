@@ -0,0 +1,218 @@
+/*************************************************************************
+Copyright (C), chernecoff@gmail.com, 2014-2015
+--------------------------------------------------------------------------
+History:
+
+- 16.10.2026   23:40 : Created by agent
+-------------------------------------------------------------------------
+Bounded lock-free queue for many producers and one consumer.
+Every cell has sequence number, so producers only compete on one
+atomic counter and consumer never locks. Consumer sleeps on event
+when queue is empty, producers signal it only if consumer is waiting.
+Threads which must not wait for consumer push to locked overflow list
+when queue is full, consumer takes it when queue is empty.
+*************************************************************************/
+
+#ifndef _MpscQueue_
+#define _MpscQueue_
+
+#include <atomic>
+#include <deque>
+
+// Cache line size, keeps producer and consumer counters apart
+#define MPSC_CACHE_LINE 64
+
+template <typename T>
+class CMpscQueue
+{
+public:
+	// Size is rounded up to power of two
+	CMpscQueue(size_t size)
+	{
+		capacity = 2;
+		while(capacity < size)
+			capacity <<= 1;
+
+		mask = capacity - 1;
+		cells = new SCell[capacity];
+
+		for(size_t i = 0; i < capacity; i++)
+			cells[i].sequence.store(i, std::memory_order_relaxed);
+
+		enqueuePos.store(0, std::memory_order_relaxed);
+		dequeuePos.store(0, std::memory_order_relaxed);
+		waiting.store(false);
+		overflowCount.store(0);
+
+		hEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+	}
+
+	~CMpscQueue()
+	{
+		CloseHandle(hEvent);
+		delete[] cells;
+	}
+
+	// Any thread. Returns false if queue is full
+	bool Push(const T& value)
+	{
+		SCell* pCell;
+		size_t pos = enqueuePos.load(std::memory_order_relaxed);
+
+		while(true)
+		{
+			pCell = &cells[pos & mask];
+			size_t seq = pCell->sequence.load(std::memory_order_acquire);
+			intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+
+			if(diff == 0)
+			{
+				if(enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+					break;
+			}
+			else if(diff < 0)
+				return false;
+			else
+				pos = enqueuePos.load(std::memory_order_relaxed);
+		}
+
+		pCell->data = value;
+
+		// Publish and waiting check are seq_cst : consumer sets waiting and
+		// checks cell again, so one of them sees the other
+		pCell->sequence.store(pos + 1, std::memory_order_seq_cst);
+
+		// Wake consumer only if it sleeps
+		if(waiting.exchange(false, std::memory_order_seq_cst))
+			SetEvent(hEvent);
+
+		return true;
+	}
+
+	// Any thread. Waits while queue is full. Can pass values of overflow list, so producer
+	// uses either this or PushOrKeep for values which must keep order
+	void PushWait(const T& value)
+	{
+		while(!Push(value))
+			SwitchToThread();
+	}
+
+	// Any thread, never waits. While overflow list has values, values of producer go there
+	// too, so values of one producer keep order
+	void PushOrKeep(const T& value)
+	{
+		if(overflowCount.load(std::memory_order_seq_cst) == 0 && Push(value))
+			return;
+
+		// Lock
+		overflowMutex.lock();
+		overflow.push_back(value);
+		overflowCount.fetch_add(1, std::memory_order_seq_cst);
+		overflowMutex.unlock();
+		// Unlock
+
+		if(waiting.exchange(false, std::memory_order_seq_cst))
+			SetEvent(hEvent);
+	}
+
+	// Consumer thread only
+	bool Pop(T& value)
+	{
+		// Taken overflow values are older than everything pushed to queue after them
+		if(!taken.empty())
+		{
+			value = taken.front();
+			taken.pop_front();
+			return true;
+		}
+
+		if(PopCell(value))
+			return true;
+
+		// Queue is empty, values kept while it was full are next
+		if(overflowCount.load(std::memory_order_seq_cst) == 0)
+			return false;
+
+		// Lock
+		overflowMutex.lock();
+		taken.swap(overflow);
+		overflowCount.store(0, std::memory_order_seq_cst);
+		overflowMutex.unlock();
+		// Unlock
+
+		value = taken.front();
+		taken.pop_front();
+		return true;
+	}
+
+	// Consumer thread only. Sleeps until something is pushed
+	void PopWait(T& value)
+	{
+		while(!Pop(value))
+		{
+			waiting.store(true, std::memory_order_seq_cst);
+
+			// Producer could push before it saw waiting flag
+			if(Pop(value))
+			{
+				waiting.store(false, std::memory_order_seq_cst);
+				return;
+			}
+
+			WaitForSingleObject(hEvent, INFINITE);
+		}
+	}
+
+	// Approximate count, for statistics only
+	int Count()
+	{
+		return (int)(enqueuePos.load(std::memory_order_relaxed) - dequeuePos.load(std::memory_order_relaxed)) + overflowCount.load(std::memory_order_relaxed);
+	}
+
+	int Capacity() { return (int)capacity; }
+
+private:
+	bool PopCell(T& value)
+	{
+		size_t pos = dequeuePos.load(std::memory_order_relaxed);
+		SCell* pCell = &cells[pos & mask];
+		size_t seq = pCell->sequence.load(std::memory_order_seq_cst);
+
+		if((intptr_t)seq - (intptr_t)(pos + 1) < 0)
+			return false;
+
+		value = pCell->data;
+		pCell->data = T();
+		pCell->sequence.store(pos + capacity, std::memory_order_release);
+
+		dequeuePos.store(pos + 1, std::memory_order_relaxed);
+		return true;
+	}
+
+	struct SCell
+	{
+		std::atomic<size_t> sequence;
+		T data;
+	};
+
+	SCell* cells;
+	size_t capacity;
+	size_t mask;
+	HANDLE hEvent;
+
+	char pad0[MPSC_CACHE_LINE];
+	std::atomic<size_t> enqueuePos;
+	std::atomic<bool> waiting;
+
+	char pad1[MPSC_CACHE_LINE];
+	std::atomic<size_t> dequeuePos;
+	// Consumer only
+	std::deque <T> taken;
+
+	char pad2[MPSC_CACHE_LINE];
+	std::atomic<int> overflowCount;
+	std::mutex overflowMutex;
+	std::deque <T> overflow;
+};
+
+#endif
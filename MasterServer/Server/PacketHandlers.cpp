@@ -0,0 +1,224 @@
+/*************************************************************************
+Copyright (C), chernecoff@gmail.com, 2014-2015
+--------------------------------------------------------------------------
+History:
+
+- 16.10.2026   23:25 : Created by agent
+-------------------------------------------------------------------------
+
+*************************************************************************/
+
+#include "StdAfx.h"
+#include "PacketHandlers.h"
+
+bool CPacketHandlers::bBlockDualPlayers = false;
+
+// Requests sent only by master server have no handler
+const CPacketHandlers::RequestHandler CPacketHandlers::requestHandlers[REQUEST_COUNT] =
+{
+	NULL,                                  // REQUEST_UNKNOWN
+	&CPacketHandlers::OnGetServers,        // REQUEST_GET_SERVERS
+	&CPacketHandlers::OnGetPlayer,         // REQUEST_GET_PLAYER
+	&CPacketHandlers::OnGetMasterInfo,     // REQUEST_GET_MASTER_INFO
+	NULL,                                  // REQUEST_REMOVE_GAME_SERVER
+};
+
+void CPacketHandlers::Init()
+{
+	bBlockDualPlayers = !!atoi(gEnv->pSettings->GetConfigValue("Server","block_dual_players"));
+}
+
+bool CPacketHandlers::OnLogin(SPacketContext& context)
+{
+	CSession* pSession = context.pSession;
+	SClient Client = pSession->GetClient();
+
+	Log(LOG_DEBUG,"Login packet recived");
+	Log(LOG_INFO,"Client <%s:%s> trying logining...", Client.nickname.c_str(), Client.ip);
+
+	SLoginPacket loginPacket = gEnv->pRsp->ReadLoginPacket(context.decoded);
+	if(loginPacket.login == NULL || loginPacket.password == NULL)
+		return false;
+
+	const char* result = gEnv->pAccounts->Login(loginPacket.login,loginPacket.password);
+
+	if(!strcmp("PasswordCorrect",result))
+	{
+		SClient Player = gEnv->pAccounts->GetUserInfo(loginPacket.login);
+
+		// Block dual autorization. Server lock makes check and login one step for
+		// other logins, connects and readers of clients snapshot are not blocked.
+		// Messages are sent after it is released
+		bool blockDual = false;
+
+		SERVER_LOCK
+		if(bBlockDualPlayers)
+		{
+			CSessionSnapshot snapshot;
+			gEnv->pServer->clients.GetSnapshot(snapshot);
+
+			for(auto it = snapshot.sessions.begin(); it != snapshot.sessions.end(); ++it)
+			{
+				if((*it)->GetPlayerId() == Player.playerId)
+				{
+					blockDual = true;
+					break;
+				}
+			}
+		}
+
+		if(!blockDual)
+			pSession->SetPlayer(loginPacket.login, Player);
+		SERVER_UNLOCK
+
+		if(blockDual)
+		{
+			Log(LOG_WARNING, "Block dual authorization from <%s, %s>", Client.nickname.c_str(), Client.ip);
+
+			SMessage Message;
+			Message.area = CHAT_MESSAGE_SYSTEM;
+			Message.message = "BlockDual";
+			gEnv->pRsp->SendMsg(pSession,Message);
+		}
+		else
+		{
+			gEnv->pRsp->SendAccountInfo(pSession,Player);
+
+			gEnv->pServer->SendClientStatus(Player.nickname, CLIENT_CONNECTED);
+
+			Log(LOG_INFO,"Client <%s:%s> has changed the status to <%s:%s>", Client.nickname.c_str(), Client.ip, Player.nickname.c_str(), Client.ip);
+		}
+	}
+
+	SMessage Message;
+	Message.area = CHAT_MESSAGE_SYSTEM;
+	Message.message = result;
+	gEnv->pRsp->SendMsg(pSession,Message);
+
+	return true;
+}
+
+bool CPacketHandlers::OnRegister(SPacketContext& context)
+{
+	Log(LOG_DEBUG,"Register packet recived");
+
+	SLoginPacket loginPacket = gEnv->pRsp->ReadRegistrationPacket(context.decoded);
+	if(loginPacket.login == NULL || loginPacket.password == NULL || loginPacket.nickname == NULL)
+		return false;
+
+	const char* result = gEnv->pAccounts->Register(loginPacket.login, loginPacket.password, loginPacket.nickname);
+
+	SMessage Message;
+	Message.area = CHAT_MESSAGE_SYSTEM;
+	Message.message = result;
+	gEnv->pRsp->SendMsg(context.pSession,Message);
+
+	return true;
+}
+
+bool CPacketHandlers::OnMessage(SPacketContext& context)
+{
+	Log(LOG_DEBUG,"Message packet recived");
+	SMessage clientMsg = gEnv->pRsp->ReadMsg(context.decoded);
+	if(clientMsg.message == NULL)
+		return false;
+
+	switch (clientMsg.area)
+	{
+	case CHAT_MESSAGE_GLOBAL:
+		{
+			char CompleteMsg[256];
+			_snprintf(CompleteMsg, sizeof(CompleteMsg) - 1, "%s : %s", context.pSession->GetNickname().c_str(), clientMsg.message);
+			CompleteMsg[sizeof(CompleteMsg) - 1] = 0;
+
+			CSessionSnapshot snapshot;
+			gEnv->pServer->clients.GetSnapshot(snapshot);
+
+			SMessage Message;
+			Message.area = CHAT_MESSAGE_GLOBAL;
+			Message.message = CompleteMsg;
+
+			gEnv->pRsp->SendMsg(snapshot.sessions,Message);
+
+			break;
+		}
+	default:
+		break;
+	}
+
+	return true;
+}
+
+bool CPacketHandlers::OnRequest(SPacketContext& context)
+{
+	Log(LOG_DEBUG,"Request packet recived");
+	SRequestPacket clientRequest = gEnv->pRsp->ReadRequest(context.decoded);
+
+	// Unknown id or name is dropped without touching handlers
+	RequestHandler handler = (unsigned int)clientRequest.id < REQUEST_COUNT ? requestHandlers[clientRequest.id] : NULL;
+	if(handler == NULL)
+	{
+		Log(LOG_DEBUG,"Unknown request %d from client <%s>", (int)clientRequest.id, context.pSession->GetIp());
+		return false;
+	}
+
+	handler(context.pSession, clientRequest);
+	return true;
+}
+
+bool CPacketHandlers::OnGameServer(SPacketContext& context)
+{
+	Log(LOG_DEBUG,"Game server info recived");
+	SGameServer Server = gEnv->pRsp->ReadGameServerInfo(context.decoded);
+	if(Server.ip == NULL || Server.serverName == NULL || Server.mapName == NULL || Server.gameRules == NULL)
+		return false;
+
+	SGameServer& info = context.pSession->server;
+	std::string oldName;
+	std::string oldIp;
+
+	context.pSession->Lock();
+	oldName = info.serverName;
+	oldIp = info.ip;
+
+	// Session keeps own copies, packet strings live only while packet is read
+	CTcpServer::CopyGameServerStrings(info, Server);
+	info.port = Server.port;
+	info.currentPlayers = Server.currentPlayers;
+	info.maxPlayers = Server.maxPlayers;
+
+	Server.id = info.id;
+	context.pSession->Unlock();
+
+	if(strcmp(oldName.c_str(),Server.serverName))
+		Log(LOG_INFO,"Game server <%s:%s> has changed the status to <%s:%s>", oldName.c_str(), oldIp.c_str(), Server.serverName, Server.ip);
+
+	CSessionSnapshot snapshot;
+	gEnv->pServer->clients.GetSnapshot(snapshot);
+
+	if(snapshot.GetCount()>0)
+		gEnv->pRsp->SendGameServerInfo(snapshot.sessions,Server);
+
+	return true;
+}
+
+void CPacketHandlers::OnGetServers(CSession* pSession, const SRequestPacket& request)
+{
+	if(gEnv->allServers)
+		gEnv->pRsp->SendGameServers(pSession);
+}
+
+void CPacketHandlers::OnGetPlayer(CSession* pSession, const SRequestPacket& request)
+{
+	SClient player = gEnv->pAccounts->GetUserInfo(pSession->GetLogin());
+	gEnv->pRsp->SendAccountInfo(pSession, player);
+}
+
+void CPacketHandlers::OnGetMasterInfo(CSession* pSession, const SRequestPacket& request)
+{
+	SMasterServerInfo info;
+	info.playersOnline = gEnv->pServer->clients.GetCount();
+	info.gameServersOnline = gEnv->pServer->servers.GetCount();
+
+	gEnv->pRsp->SendMasterServerInfo(pSession, info);
+}
@@ -0,0 +1,64 @@
+/*************************************************************************
+Copyright (C), chernecoff@gmail.com, 2014-2015
+--------------------------------------------------------------------------
+History:
+
+- 16.10.2026   23:25 : Created by agent
+-------------------------------------------------------------------------
+Handlers of client and game server packets. Every handler is registered
+in CPacketQueue by packet type together with policy telling where it
+runs : on read worker, on handler workers or on database workers.
+Handler gets decoded packet and session of sender. Decoded packet and
+session are valid only until handler returns.
+*************************************************************************/
+
+#ifndef _PacketHandlers_
+#define _PacketHandlers_
+
+#include "Packets\RSP.h"
+
+class CSession;
+
+// Where handler runs
+enum EHandlerPolicy
+{
+	HANDLER_INLINE = 0,       // Read worker of connection, packet is read in place
+	HANDLER_WORKER_POOL,      // Handler workers, for slow handlers
+	HANDLER_DB_POOL,          // Database workers, for handlers waiting on database
+};
+
+// Packet and its sender
+struct SPacketContext
+{
+	CSession* pSession;
+	SDecodedPacket decoded;
+};
+
+// False if packet is damaged or rejected, it is counted as handler error
+typedef bool (*PacketHandler)(SPacketContext& context);
+
+class CPacketHandlers
+{
+public:
+	// Reads settings used by handlers
+	static void Init();
+
+	static bool OnLogin(SPacketContext& context);
+	static bool OnRegister(SPacketContext& context);
+	static bool OnMessage(SPacketContext& context);
+	static bool OnRequest(SPacketContext& context);
+	static bool OnGameServer(SPacketContext& context);
+
+private:
+	// Client request handlers, indexed by ERequestId
+	typedef void (*RequestHandler)(CSession* pSession, const SRequestPacket& request);
+	static const RequestHandler requestHandlers[REQUEST_COUNT];
+
+	static void OnGetServers(CSession* pSession, const SRequestPacket& request);
+	static void OnGetPlayer(CSession* pSession, const SRequestPacket& request);
+	static void OnGetMasterInfo(CSession* pSession, const SRequestPacket& request);
+
+	static bool bBlockDualPlayers;
+};
+
+#endif
@@ -10,343 +10,345 @@ History:
 *************************************************************************/
 
 #include "StdAfx.h"
-#include <winsock.h>
+#include <winsock2.h>
 
 #include "PacketQueue.h"
 
 CPacketQueue::CPacketQueue()
 {
-	packetsInSendQueue = 0;
-	packetsInReadQueue = 0;
+	workers = NULL;
+	workersCount = 0;
+	timerFrequency = 1;
 }
 
 void CPacketQueue::Init()
 {
 	Log(LOG_DEBUG,"CPacketQueue::Init()");
 
-	std::thread SendThread(&CPacketQueue::SendThread, this);
-	std::thread ReadThread(&CPacketQueue::ReadThread, this);
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+	timerFrequency = frequency.QuadPart;
+
+	// Database handlers keep order of one client, game server updates and chat are cheap.
+	// Inline packet of client waiting for database job goes to same database thread
+	CPacketHandlers::Init();
+	RegisterHandler(PACKET_LOGIN,       "Login",       &CPacketHandlers::OnLogin,      HANDLER_DB_POOL);
+	RegisterHandler(PACKET_REGISTER,    "Register",    &CPacketHandlers::OnRegister,   HANDLER_DB_POOL);
+	RegisterHandler(PACKET_REQUEST,     "Request",     &CPacketHandlers::OnRequest,    HANDLER_DB_POOL);
+	RegisterHandler(PACKET_MESSAGE,     "Message",     &CPacketHandlers::OnMessage,    HANDLER_INLINE);
+	RegisterHandler(PACKET_GAME_SERVER, "Game server", &CPacketHandlers::OnGameServer, HANDLER_INLINE);
+
+	workerPool.Init("Handler", atoi(gEnv->pSettings->GetConfigValue("Server","handler_workers")));
+	dbPool.Init("Database", atoi(gEnv->pSettings->GetConfigValue("Server","db_workers")));
+
+	workersCount = atoi(gEnv->pSettings->GetConfigValue("Server","read_workers"));
+
+	if(workersCount <= 0)
+	{
+		SYSTEM_INFO info;
+		GetSystemInfo(&info);
+		workersCount = (int)info.dwNumberOfProcessors;
+	}
 
-	SendThread.detach();
-	ReadThread.detach();
-}
+	workers = new SReadWorker[workersCount];
 
-void CPacketQueue::InsertPacketToSend(SPacket packet)
-{
-	send_mutex.lock();
+	LARGE_INTEGER now;
+	QueryPerformanceCounter(&now);
 
-	SendPackets.push_back(packet);
-	packetsInSendQueue++;
+	for(int i = 0; i < workersCount; i++)
+		workers[i].lastTime = now.QuadPart;
 
-	send_mutex.unlock();
+	for(int i = 0; i < workersCount; i++)
+	{
+		std::thread ReadThread(&CPacketQueue::ReadThread, this, i);
+		ReadThread.detach();
+	}
 
-	Log(LOG_DEBUG,"CPacketQueue::New packet added to send queue");
+	Log(LOG_INFO,"Packet queue started with %d read workers", workersCount);
 }
 
 void CPacketQueue::InsertPacketToRead(SReadPacket packet)
 {
-	read_mutex.lock();
+	// Only io threads wait here, read workers never wait for them
+	workers[GetWorker(packet.pSession)].queue.PushWait(packet);
 
-	ReadPackets.push_back(packet);
-	packetsInReadQueue++;
+	Log(LOG_DEBUG,"CPacketQueue::New packet added to Read queue");
+}
 
-	read_mutex.unlock();
+void CPacketQueue::InsertCloseMarker(CSession* pSession)
+{
+	SReadPacket marker;
+	marker.pSession = pSession;
+	marker.pSession->AddRef();
+	marker.pKey = NULL;
+	marker.pAeadKey = NULL;
+	marker.bProtocolV2 = false;
+	marker.packet.data = NULL;
+	marker.packet.size = 0;
+
+	// Same worker as packets of session. Last release of connection can be on read or
+	// handler worker, so marker never waits for full queue
+	workers[GetWorker(pSession)].queue.PushOrKeep(marker);
+}
 
-	Log(LOG_DEBUG,"CPacketQueue::New packet added to Read queue");
+int CPacketQueue::GetWorker(CSession* pSession)
+{
+	// Socket handles are multiples of 4
+	return (int)((pSession->GetSocket() >> 2) % workersCount);
 }
 
-int CPacketQueue::CheckSocket(SOCKET Socket)
+int CPacketQueue::GetWorkerQueueDepth(int worker)
 {
-	SOCKET ERROR_SOCKET = send (Socket,"",0,0);
-	return (int)ERROR_SOCKET;
+	return workers[worker].queue.Count();
+}
+
+int CPacketQueue::GetWorkerPackets(int worker)
+{
+	return workers[worker].packets;
+}
+
+int CPacketQueue::GetWorkerLoad(int worker)
+{
+	SReadWorker* pWorker = &workers[worker];
+
+	LARGE_INTEGER now;
+	QueryPerformanceCounter(&now);
+
+	long long busyTime = pWorker->busyTime;
+	long long time = now.QuadPart - pWorker->lastTime;
+	long long busy = busyTime - pWorker->lastBusyTime;
+
+	pWorker->lastTime = now.QuadPart;
+	pWorker->lastBusyTime = busyTime;
+
+	if(time <= 0)
+		return 0;
+
+	return (int)(busy * 100 / time);
 }
 
-void CPacketQueue::SendThread()
+void CPacketQueue::ReadThread(int worker)
 {
+	SReadWorker* pWorker = &workers[worker];
+
+	LARGE_INTEGER start, end;
+
 	while(true)
 	{	
-		send_mutex.lock();
+		SReadPacket readPacket;
+		pWorker->queue.PopWait(readPacket);
+
+		QueryPerformanceCounter(&start);
+		if(readPacket.packet.data != NULL)
+			ReadPacket(pWorker, readPacket);
+		else
+			DropChunks(pWorker, readPacket.pSession);
+		QueryPerformanceCounter(&end);
+
+		// Packet fields point into this buffer, it lives until packet is dispatched
+		delete[] readPacket.packet.data;
+		readPacket.pSession->Release();
+
+		pWorker->busyTime += end.QuadPart - start.QuadPart;
+		pWorker->packets++;
+	}
+}
 
-		if(packetsInSendQueue>0)
-		{
-			SPacket packet;
-			std::vector <SPacket>::iterator it;
+void CPacketQueue::ReadPacket(SReadWorker* pWorker, SReadPacket& readPacket)
+{
+	SPacket Packet = readPacket.packet;
+
+	// Packet is decrypted only here, in place. Readers get view of decoded packet
+	SDecodedPacket Decoded;
+	bool bDecoded = gEnv->pRsp->DecodePacket(Packet, Decoded, readPacket.pKey, readPacket.pAeadKey, readPacket.bProtocolV2);
+
+	if(readPacket.pKey != NULL)
+		readPacket.pKey->Release();
+	if(readPacket.pAeadKey != NULL)
+		readPacket.pAeadKey->Release();
+
+	if(!bDecoded)
+		return;
 
-			it = SendPackets.begin();
+	// Chunk of big message. Message is read when last chunk comes. Only logged in client
+	// can send it, anybody else could make server keep buffers without any account
+	if(Decoded.type == PACKET_CHUNK)
+	{
+		CSession* pSession = readPacket.pSession;
 
-			packet.addr = (*it).addr;
-			packet.data = (*it).data;
-			packet.size = (*it).size;
+		if(pSession->GetPlayerId() == 0)
+		{
+			Log(LOG_DEBUG,"CPacketQueue::Chunk from <%s> before login dropped", pSession->GetIp());
+			gEnv->pRsp->FreePacket(Decoded);
+			return;
+		}
+
+		auto it = pWorker->chunks.find(pSession);
+		if(it == pWorker->chunks.end())
+			it = pWorker->chunks.insert(std::make_pair(pSession, new CPacketChunks(PACKET_MAX_INBOUND_SIZE))).first;
 
-			if(CheckSocket(packet.addr) != -1)
-				send(packet.addr,packet.data,packet.size,0);
-			else
-				Log(LOG_DEBUG,"CPacketQueue::SendThread::Dead socket!");
+		unsigned int size = 0;
+		unsigned char* pMessage = it->second->Add(Decoded.view, size);
+		gEnv->pRsp->FreePacket(Decoded);
 
-			SendPackets.erase(it);
-			packetsInSendQueue--;	
+		if(it->second->IsEmpty())
+		{
+			delete it->second;
+			pWorker->chunks.erase(it);
 		}
 
-		send_mutex.unlock();
+		if(pMessage == NULL)
+			return;
 
-		Sleep(33);
+		Decoded.pMessage = pMessage;
+		Decoded.view = CPacketView(pMessage, size);
+		if(!gEnv->pRsp->DecodeHeader(Decoded, readPacket.bProtocolV2))
+		{
+			gEnv->pRsp->FreePacket(Decoded);
+			return;
+		}
 	}
+
+	Dispatch(readPacket, Decoded);
+
+	gEnv->pRsp->FreePacket(Decoded);
 }
 
-void CPacketQueue::ReadThread()
+void CPacketQueue::DropChunks(SReadWorker* pWorker, CSession* pSession)
 {
-	while(true)
-	{	
-		read_mutex.lock();
+	auto it = pWorker->chunks.find(pSession);
+	if(it == pWorker->chunks.end())
+		return;
 
-		if(packetsInReadQueue>0)
-		{
-			SClient Client;
-			SGameServer GameServer;
-			SPacket Packet;
-			SClient Player;
-
-			std::vector <SReadPacket>::iterator it;
-
-			it = ReadPackets.begin();
-
-			Packet = (*it).packet;
-			Client = (*it).client;
-			GameServer = (*it).server;
-		
-			if(CheckSocket(Client.socket) != -1 || CheckSocket(GameServer.socket) != -1) // If socket aviable start reading
-			{
-				EPacketType packetType = gEnv->pRsp->GetPacketType(Packet);
-
-				switch (packetType)
-				{
-				case PACKET_IDENTIFICATION:
-					break;
-				case PACKET_LOGIN:
-					{
-						Log(LOG_DEBUG,"Login packet recived");
-						Log(LOG_INFO,"Client <%s:%s> trying logining...", Client.nickname.c_str(), Client.ip);
-
-						SLoginPacket loginPacket = gEnv->pRsp->ReadLoginPacket(Packet);
-
-						const char* result = gEnv->pXml->Login(loginPacket.login,loginPacket.password);
-
-						if(!strcmp("PasswordCorrect",result))
-						{
-							Player = gEnv->pXml->GetUserInfo(loginPacket.login);
-
-
-							// Block dual autorization
-							bool blockDual = false;
-
-							SERVER_LOCK
-							for(auto it = gEnv->pServer->vClients.begin(); it != gEnv->pServer->vClients.end(); ++it)
-							{
-								if(it->playerId == Player.playerId)
-								{
-									bool tmp = !!atoi(gEnv->pSettings->GetConfigValue("Server","block_dual_players"));
-
-									if(tmp)
-									{
-										Log(LOG_WARNING, "Block dual authorization from <%s, %s>", Client.nickname.c_str(), Client.ip);
-										blockDual = true;
-
-										SMessage Message;
-										Message.area = CHAT_MESSAGE_SYSTEM;
-										Message.message = "BlockDual";
-										gEnv->pRsp->SendMsg(Client.socket,Message);	
-									}
-									break;
-								}
-							}
-							SERVER_UNLOCK
-
-							if(!blockDual)
-							{
-								gEnv->pRsp->SendAccountInfo(Client.socket,Player);
-
-								gEnv->pServer->SendClientStatus(Player.nickname, CLIENT_CONNECTED);
-
-								Log(LOG_INFO,"Client <%s:%s> has changed the status to <%s:%s>", Client.nickname.c_str(), Client.ip, Player.nickname.c_str(), Client.ip);
-
-
-								SERVER_LOCK
-								for( auto it = gEnv->pServer->vClients.begin(); it != gEnv->pServer->vClients.end(); ++it)
-								{
-									if(it->socket == Client.socket)
-									{
-										it->playerId    = Player.playerId;
-										it->login       = loginPacket.login;
-										it->nickname    = Player.nickname;	
-										it->level       = Player.level;
-										it->money       = Player.money;
-										it->xp          = Player.xp;
-										it->banStatus   = !!Player.banStatus;
-
-										break;
-									}
-								}
-								SERVER_UNLOCK
-							}
-						}
-
-						SMessage Message;
-						Message.area = CHAT_MESSAGE_SYSTEM;
-						Message.message = result;
-						gEnv->pRsp->SendMsg(Client.socket,Message);	
-
-
-
-						break;
-					}
-				case PACKET_REGISTER:
-					{
-						Log(LOG_DEBUG,"Register packet recived");
-
-						SLoginPacket loginPacket = gEnv->pRsp->ReadRegistrationPacket(Packet);
-						const char* result = gEnv->pXml->Register(loginPacket.login, loginPacket.password, loginPacket.nickname);
-
-						SMessage Message;
-						Message.area = CHAT_MESSAGE_SYSTEM;
-						Message.message = result;
-						gEnv->pRsp->SendMsg(Client.socket,Message);
-						break;
-					}
-				case PACKET_ACCOUNT:
-					break;
-				case PACKET_MESSAGE:
-					{
-						Log(LOG_DEBUG,"Message packet recived");
-						SMessage clientMsg = gEnv->pRsp->ReadMsg(Packet);
-
-						switch (clientMsg.area)
-						{
-						case CHAT_MESSAGE_GLOBAL:
-							{
-								char CompleteMsg[256];
-								sprintf(CompleteMsg, "%s : %s", Client.nickname.c_str(), clientMsg.message);
-
-								SERVER_LOCK
-								for(auto conIT = gEnv->pServer->vClients.begin(); conIT != gEnv->pServer->vClients.end(); ++conIT)
-								{
-									SMessage Message;
-									Message.area = CHAT_MESSAGE_GLOBAL;
-									Message.message = CompleteMsg;
-
-									gEnv->pRsp->SendMsg(conIT->socket,Message);
-								}
-								SERVER_UNLOCK
-
-								break;
-							}
-						default:
-							break;
-						}
-
-
-						break;
-					}
-				case PACKET_REQUEST:
-					{
-						Log(LOG_DEBUG,"Request packet recived");
-						SRequestPacket clientRequest = gEnv->pRsp->ReadRequest(Packet);
-
-						if(!strcmp(clientRequest.request,"GetServers"))
-						{
-							if(gEnv->allServers)
-							{
-								gEnv->pRsp->SendGameServers(Client.socket);
-							}
-						}
-
-						if(!strcmp(clientRequest.request,"GetPlayer"))
-						{
-							Player = gEnv->pXml->GetUserInfo(Client.login);
-							gEnv->pRsp->SendAccountInfo(Client.socket,Player);
-						}
-
-						if(!strcmp(clientRequest.request,"GetMasterInfo"))
-						{
-							SERVER_LOCK
-							SMasterServerInfo info;
-							info.playersOnline = (int)gEnv->pServer->vClients.size();
-							info.gameServersOnline = (int)gEnv->pServer->vServers.size();
-							SERVER_UNLOCK
-
-							gEnv->pRsp->SendMasterServerInfo(Client.socket,info);
-						}
-
-						break;
-					}
-				case PACKET_MS_INFO:
-					break;
-				case PACKET_GAME_SERVER:
-					{
-						Log(LOG_DEBUG,"Game server info recived");
-						SGameServer Server = gEnv->pRsp->ReadGameServerInfo(Packet);
-
-						SERVER_LOCK
-						for( auto it = gEnv->pServer->vServers.begin(); it != gEnv->pServer->vServers.end(); ++it)
-						{
-							if(it->socket == GameServer.socket)
-							{
-								(*it).ip = Server.ip;
-								(*it).serverName = Server.serverName;
-								(*it).mapName = Server.mapName;
-								(*it).gameRules = Server.gameRules;
-								(*it).port = Server.port;
-								(*it).currentPlayers = Server.currentPlayers;
-								(*it).maxPlayers = Server.maxPlayers;
-
-								break;
-							}
-						}
-						SERVER_UNLOCK
-
-						if(strcmp(GameServer.serverName,Server.serverName))
-						{
-							Log(LOG_INFO,"Game server <%s:%s> has changed the status to <%s:%s>", GameServer.serverName, GameServer.ip, Server.serverName, Server.ip);
-
-							Server.id = GameServer.id;
-
-							SERVER_LOCK
-							if(gEnv->pServer->vClients.size()>0)
-							{
-								for (auto conIT=gEnv->pServer->vClients.begin(); conIT!=gEnv->pServer->vClients.end(); ++conIT)
-									gEnv->pRsp->SendGameServerInfo(conIT->socket,Server);
-							}
-							SERVER_UNLOCK
-						}
-						else
-						{
-							Server.id = GameServer.id;
-							SERVER_LOCK
-							if(gEnv->pServer->vClients.size()>0)
-							{
-								for (auto conIT=gEnv->pServer->vClients.begin(); conIT!=gEnv->pServer->vClients.end(); ++conIT)
-									gEnv->pRsp->SendGameServerInfo(conIT->socket,Server);
-							}
-							SERVER_UNLOCK
-						}
-
-						
-
-
-						break;
-					}
-				default:
-					break;
-				}
-			}
-			else
-				Log(LOG_DEBUG,"CPacketQueue::ReadThread::Dead socket!");
-
-			ReadPackets.erase(it);
-			packetsInReadQueue--;	
-		}
-		read_mutex.unlock();
+	Log(LOG_DEBUG,"CPacketQueue::Unfinished message of closed connection dropped");
+
+	delete it->second;
+	pWorker->chunks.erase(it);
+}
+
+void CPacketQueue::Dispatch(SReadPacket& readPacket, SDecodedPacket& decoded)
+{
+	unsigned int type = (unsigned int)decoded.type;
+	if(type >= PACKET_HANDLERS || handlers[type].handler == NULL)
+	{
+		Log(LOG_DEBUG,"No handler for packet type %d", (int)type);
+		return;
+	}
+
+	SPacketHandler& handler = handlers[type];
+	CHandlerPool* pPool = GetPool(handler.policy);
+	CSession* pSession = readPacket.pSession;
+
+	if(pPool != NULL && !pPool->IsStarted())
+		pPool = NULL;
+
+	// Any packet of session waits behind its unfinished jobs, so inline chat after login
+	// is not handled before login
+	if(pSession->pendingJobs > 0)
+		pPool = pSession->pPendingPool;
 
-		Sleep(1);
+	if(pPool == NULL)
+	{
+		SPacketContext context;
+		context.pSession = readPacket.pSession;
+		context.decoded = decoded;
+
+		RunHandler(handler, context);
+		return;
+	}
+
+	// Packet buffer is freed when read worker returns, so job gets own copy
+	unsigned int size = decoded.view.GetSize();
+	unsigned char* pMessage = new unsigned char [size];
+	memcpy(pMessage, decoded.view.GetData(), size);
+
+	SPacketJob* pJob = new SPacketJob;
+	pJob->type = (int)type;
+	pJob->context.pSession = readPacket.pSession;
+	pJob->context.pSession->AddRef();
+	pJob->context.decoded.pMessage = pMessage;
+	pJob->context.decoded.view = CPacketView(pMessage, size);
+
+	if(!gEnv->pRsp->DecodeHeader(pJob->context.decoded, readPacket.bProtocolV2))
+	{
+		gEnv->pRsp->FreePacket(pJob->context.decoded);
+		pJob->context.pSession->Release();
+		delete pJob;
+		return;
 	}
+
+	pSession->pPendingPool = pPool;
+	pSession->pendingJobs++;
+
+	pPool->Push(pSession->GetSocket(), pJob);
+}
+
+void CPacketQueue::RunHandler(SPacketHandler& handler, SPacketContext& context)
+{
+	LARGE_INTEGER start, end;
+
+	QueryPerformanceCounter(&start);
+	bool bResult = handler.handler(context);
+	QueryPerformanceCounter(&end);
+
+	long long time = end.QuadPart - start.QuadPart;
+
+	handler.calls++;
+	if(!bResult)
+		handler.errors++;
+
+	handler.totalTime += time;
+
+	long long maxTime = handler.maxTime;
+	while(time > maxTime && !handler.maxTime.compare_exchange_weak(maxTime, time)) {}
+}
+
+void CPacketQueue::RunJob(SPacketJob* pJob)
+{
+	RunHandler(handlers[pJob->type], pJob->context);
+
+	gEnv->pRsp->FreePacket(pJob->context.decoded);
+	pJob->context.pSession->pendingJobs--;
+	pJob->context.pSession->Release();
+	delete pJob;
+}
+
+void CPacketQueue::RegisterHandler(EPacketType type, const char* name, PacketHandler handler, EHandlerPolicy policy)
+{
+	if((unsigned int)type >= PACKET_HANDLERS)
+		return;
+
+	handlers[type].name = name;
+	handlers[type].handler = handler;
+	handlers[type].policy = policy;
+}
+
+bool CPacketQueue::GetHandlerStats(int type, SPacketHandlerStats& stats)
+{
+	if(type < 0 || type >= PACKET_HANDLERS || handlers[type].handler == NULL)
+		return false;
+
+	SPacketHandler& handler = handlers[type];
+
+	stats.name = handler.name;
+	stats.policy = handler.policy;
+	stats.calls = handler.calls;
+	stats.errors = handler.errors;
+	stats.averageTime = stats.calls > 0 ? (int)(handler.totalTime * 1000000 / timerFrequency / stats.calls) : 0;
+	stats.maxTime = (int)(handler.maxTime * 1000000 / timerFrequency);
+
+	return true;
 }
 
+CHandlerPool* CPacketQueue::GetPool(EHandlerPolicy policy)
+{
+	switch(policy)
+	{
+	case HANDLER_WORKER_POOL:
+		return &workerPool;
+	case HANDLER_DB_POOL:
+		return &dbPool;
+	default:
+		return NULL;
+	}
+}
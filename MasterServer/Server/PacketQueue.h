@@ -15,12 +15,75 @@ History:
 //#include <winsock.h>
 typedef UINT_PTR SOCKET;
 #include "TcpServer.h"
+#include <unordered_map>
+#include "MpscQueue.h"
+#include "Packets\PacketChunks.h"
+
+// Max packets waiting in each queue
+#define PACKET_QUEUE_SIZE 8192
+// Biggest message client sends (login, register, chat, request). Chunks of bigger one are
+// dropped before its buffer is made
+#define PACKET_MAX_INBOUND_SIZE 4096
+// Handlers by packet type, protocol v2 opcode is one byte
+#define PACKET_HANDLERS 256
+
+#include "HandlerPool.h"
+#include "PacketHandlers.h"
 
 struct SReadPacket
 {
-	SClient client;
-	SGameServer server;
+	// Sender. Packet holds own reference
+	CSession* pSession;
+	// Data is NULL for close marker : connection is closed, its unfinished message is dropped
 	SPacket packet;
+
+	// Session keys of client connection or NULL. Hold own references
+	CBlowfishKey* pKey;
+	CAesGcmKey* pAeadKey;
+	// Packets of connection have opcode header
+	bool bProtocolV2;
+};
+
+// Read worker. All packets of one connection go to same worker, so they keep order
+struct SReadWorker
+{
+	SReadWorker() : queue(PACKET_QUEUE_SIZE)
+	{
+		busyTime = 0;
+		packets = 0;
+		lastBusyTime = 0;
+		lastTime = 0;
+	}
+
+	CMpscQueue <SReadPacket> queue;
+
+	// Big messages being put together, by session. Used only by worker thread.
+	// Close marker of session removes its entry, marker holds session, so key is not reused before it
+	std::unordered_map <CSession*, CPacketChunks*> chunks;
+
+	// Statistic
+	std::atomic<long long> busyTime;
+	std::atomic<int> packets;
+	long long lastBusyTime;
+	long long lastTime;
+};
+
+// Packet handed to handler pool. Owns copy of decoded packet
+struct SPacketJob
+{
+	int type;
+	SPacketContext context;
+};
+
+// Handler statistic
+struct SPacketHandlerStats
+{
+	const char* name;
+	EHandlerPolicy policy;
+	int calls;
+	int errors;            // Damaged or rejected packets
+	int averageTime;       // Microseconds
+	int maxTime;           // Microseconds
 };
 
 class CPacketQueue
@@ -30,27 +93,65 @@ public:
 	~CPacketQueue(void){}
 
 	void Init();
-	// Insert packet to send queue
-	void InsertPacketToSend(SPacket packet);
+
 	// Inser packet to read queue
 	void InsertPacketToRead(SReadPacket packet);
+	// Connection of session is closed. Marker goes after its packets and frees unfinished message
+	void InsertCloseMarker(CSession* pSession);
 
-private:
-	void SendThread();
-	void ReadThread();
-	int CheckSocket(SOCKET Socket);
+	// Read workers statistic
+	int GetWorkersCount() { return workersCount; }
+	int GetWorkerQueueDepth(int worker);
+	int GetWorkerPackets(int worker);
+	// Busy time in percent since previous call
+	int GetWorkerLoad(int worker);
 
-private:
-	std::mutex send_mutex;
+	// Called by Init before workers start. Packets without handler are dropped
+	void RegisterHandler(EPacketType type, const char* name, PacketHandler handler, EHandlerPolicy policy);
+	// Handler pools run jobs here. Job is freed
+	void RunJob(SPacketJob* pJob);
+
+	// False if type has no handler
+	bool GetHandlerStats(int type, SPacketHandlerStats& stats);
+	// NULL for inline policy
+	CHandlerPool* GetPool(EHandlerPolicy policy);
 
-	int packetsInSendQueue;
-	std::vector <SPacket> SendPackets;
-	
 private:
-	std::mutex read_mutex;
+	struct SPacketHandler
+	{
+		SPacketHandler() : name(NULL), handler(NULL), policy(HANDLER_INLINE)
+		{
+			calls = 0;
+			errors = 0;
+			totalTime = 0;
+			maxTime = 0;
+		}
+
+		const char* name;
+		PacketHandler handler;
+		EHandlerPolicy policy;
+
+		std::atomic<int> calls;
+		std::atomic<int> errors;
+		std::atomic<long long> totalTime;
+		std::atomic<long long> maxTime;
+	};
 
-	int packetsInReadQueue;
-	std::vector <SReadPacket> ReadPackets;
+	// Read worker of session
+	int GetWorker(CSession* pSession);
+	void ReadThread(int worker);
+	void ReadPacket(SReadWorker* pWorker, SReadPacket& readPacket);
+	void DropChunks(SReadWorker* pWorker, CSession* pSession);
+	void Dispatch(SReadPacket& readPacket, SDecodedPacket& decoded);
+	void RunHandler(SPacketHandler& handler, SPacketContext& context);
+
+private:
+	SReadWorker* workers;
+	int workersCount;
 
+	SPacketHandler handlers[PACKET_HANDLERS];
+	CHandlerPool workerPool;
+	CHandlerPool dbPool;
+	long long timerFrequency;
 };
 #endif
\ No newline at end of file
@@ -0,0 +1,328 @@
+/*************************************************************************
+Copyright (C), chernecoff@gmail.com, 2014-2015
+--------------------------------------------------------------------------
+History:
+
+- 16.10.2026   22:51 : Created by agent
+-------------------------------------------------------------------------
+
+*************************************************************************/
+#include "StdAfx.h"
+#include "SendFrame.h"
+#include "FramePool.h"
+#include "Packets\Packets.h"
+#include "Packets\AesGcmKey.h"
+#include "Packets\PacketChunks.h"
+#include "..\..\Common\PacketOpcode.h"
+#include "..\..\Common\PacketCompression.h"
+
+CSendFrame::CSendFrame(const char* bytes, int length)
+{
+	data = CFramePool::Alloc(length);
+	size = length;
+	memcpy(data, bytes, length);
+
+	plain = NULL;
+	plainSize = 0;
+	plainV2 = NULL;
+	plainV2Size = 0;
+	for(int i = 0; i < FRAME_VARIANTS; i++)
+	{
+		variants[i] = NULL;
+		bodies[i] = NULL;
+	}
+
+	refCount = 1;
+}
+
+CSendFrame::CSendFrame(Packet* p, Packet* pV2)
+{
+	// Plain copy is not padded, AES-GCM doesn't need it
+	plainSize = p->getMessageSize();
+	plain = CFramePool::Alloc(plainSize);
+	memcpy(plain, p->getBytesPtr(), plainSize);
+
+	plainV2 = NULL;
+	plainV2Size = 0;
+	if(pV2 != NULL)
+	{
+		plainV2Size = pV2->getMessageSize();
+		plainV2 = CFramePool::Alloc(plainV2Size);
+		memcpy(plainV2, pV2->getBytesPtr(), plainV2Size);
+	}
+
+	for(int i = 0; i < FRAME_VARIANTS; i++)
+	{
+		variants[i] = NULL;
+		bodies[i] = NULL;
+	}
+	refCount = 1;
+
+	data = NULL;
+	size = 0;
+
+	// Body is kept for session keys of same flags
+	SBody* pBody = GetBody(0);
+	if(pBody != NULL)
+		EncodeBody(pBody, NULL, NULL, &data, &size);
+}
+
+CSendFrame* CSendFrame::Encode(const CBlowfishKey* pKey, int flags)
+{
+	SBody* pBody = GetBody(GetUsedFlags(flags));
+	if(pBody == NULL)
+		return NULL;
+
+	char* bytes = NULL;
+	int length = 0;
+	if(!EncodeBody(pBody, pKey, NULL, &bytes, &length))
+		return NULL;
+
+	return new CSendFrame(bytes, length, true);
+}
+
+CSendFrame* CSendFrame::Seal(CAesGcmKey* pKey, int flags)
+{
+	SBody* pBody = GetBody(GetUsedFlags(flags));
+	if(pBody == NULL)
+		return NULL;
+
+	char* bytes = NULL;
+	int length = 0;
+	if(!EncodeBody(pBody, NULL, pKey, &bytes, &length))
+		return NULL;
+
+	return new CSendFrame(bytes, length, true);
+}
+
+CSendFrame* CSendFrame::GetVariant(int flags)
+{
+	flags = GetUsedFlags(flags);
+	if(plain == NULL || flags == 0)
+		return NULL;
+
+	CSendFrame* pFrame = variants[flags];
+
+	if(pFrame == NULL)
+	{
+		pFrame = Encode(NULL, flags);
+		if(pFrame == NULL)
+			return NULL;
+
+		// Other thread could make it first
+		CSendFrame* pExpected = NULL;
+		if(!variants[flags].compare_exchange_strong(pExpected, pFrame))
+		{
+			pFrame->Release();
+			pFrame = pExpected;
+		}
+	}
+
+	pFrame->AddRef();
+	return pFrame;
+}
+
+CSendFrame::CSendFrame(char* bytes, int length, bool)
+{
+	data = bytes;
+	size = length;
+
+	plain = NULL;
+	plainSize = 0;
+	plainV2 = NULL;
+	plainV2Size = 0;
+	for(int i = 0; i < FRAME_VARIANTS; i++)
+	{
+		variants[i] = NULL;
+		bodies[i] = NULL;
+	}
+
+	refCount = 1;
+}
+
+int CSendFrame::GetUsedFlags(int flags)
+{
+	// Small message is not compressed
+	if(plainSize < gEnv->compressionThreshold || gEnv->compressionThreshold <= 0)
+		flags &= ~FRAME_LZ4;
+
+	return flags & (FRAME_VARIANTS - 1);
+}
+
+CSendFrame::SBody* CSendFrame::GetBody(int flags)
+{
+	if(plain == NULL)
+		return NULL;
+
+	SBody* pBody = bodies[flags];
+
+	if(pBody == NULL)
+	{
+		pBody = MakeBody(flags);
+		if(pBody == NULL)
+			return NULL;
+
+		// Other thread could make it first
+		SBody* pExpected = NULL;
+		if(!bodies[flags].compare_exchange_strong(pExpected, pBody))
+		{
+			delete pBody;
+			pBody = pExpected;
+		}
+	}
+
+	return pBody;
+}
+
+bool CSendFrame::EncodePacket(Packet* p, const CBlowfishKey* pKey, CAesGcmKey* pAeadKey)
+{
+	if(pAeadKey != NULL)
+		return pAeadKey->Seal(p);
+
+	p->padPacketTo8ByteLen();
+
+	if(pKey != NULL)
+		p->encodeBlowfish(pKey);
+	else
+		p->encodeBlowfish(gEnv->bBlowFish);
+
+	p->appendChecksum(false);
+	p->appendMore8Bytes();
+
+	return true;
+}
+
+CSendFrame::SBody* CSendFrame::MakeBody(int flags)
+{
+	bool bProtocolV2 = (flags & FRAME_PROTOCOL_V2) != 0;
+
+	const char* message = plain;
+	int length = plainSize;
+
+	// Protocol v2 message is written by sender, old packet goes under opcode 0
+	char* wrapped = NULL;
+	if(bProtocolV2 && plainV2 != NULL)
+	{
+		message = plainV2;
+		length = plainV2Size;
+	}
+	else if(bProtocolV2)
+	{
+		wrapped = CFramePool::Alloc(length + 1);
+		length = (int)CPacketOpcode::Wrap((const unsigned char*)message, length, (unsigned char*)wrapped);
+		message = wrapped;
+	}
+
+	// Compressed packet holds message with opcode header and gets own header,
+	// so receiver decompresses it before reading message header
+	char* compressed = NULL;
+	if(flags & FRAME_LZ4)
+	{
+		Packet* p = CPacketCompression::Compress((const unsigned char*)message, length, gEnv->serverVersion, bProtocolV2);
+		if(p != NULL)
+		{
+			length = (int)p->getMessageSize();
+			compressed = CFramePool::Alloc(length);
+			memcpy(compressed, p->getBytesPtr(), length);
+
+			message = compressed;
+			delete p;
+		}
+	}
+
+	SBody* pBody = new SBody;
+	pBody->data = NULL;
+
+	// Small message is one packet
+	if(length <= PACKET_CHUNK_SIZE)
+	{
+		pBody->data = CFramePool::Alloc(length);
+		memcpy(pBody->data, message, length);
+		pBody->packets.push_back(length);
+
+		CFramePool::Free(wrapped);
+		CFramePool::Free(compressed);
+		return pBody;
+	}
+
+	// Big message goes as chunks, every chunk is encoded alone and all chunks are sent by one frame
+	std::vector <Packet*> chunks;
+	CPacketChunks::Split((const unsigned char*)message, length, gEnv->serverVersion, bProtocolV2, chunks);
+
+	int total = 0;
+
+	for(auto it = chunks.begin(); it != chunks.end(); ++it)
+	{
+		pBody->packets.push_back((*it)->getMessageSize());
+		total += (*it)->getMessageSize();
+	}
+
+	pBody->data = CFramePool::Alloc(total);
+
+	int offset = 0;
+	for(auto it = chunks.begin(); it != chunks.end(); ++it)
+	{
+		memcpy(pBody->data + offset, (*it)->getBytesPtr(), (*it)->getMessageSize());
+		offset += (*it)->getMessageSize();
+		delete *it;
+	}
+
+	CFramePool::Free(wrapped);
+	CFramePool::Free(compressed);
+	return pBody;
+}
+
+bool CSendFrame::EncodeBody(const SBody* pBody, const CBlowfishKey* pKey, CAesGcmKey* pAeadKey, char** ppData, int* pSize)
+{
+	// Small message is one packet
+	if(pBody->packets.size() == 1)
+	{
+		Packet packet((const unsigned char*)pBody->data, pBody->packets[0]);
+		if(!EncodePacket(&packet, pKey, pAeadKey))
+			return false;
+
+		*pSize = packet.getPacketSize();
+		*ppData = CFramePool::Alloc(*pSize);
+		memcpy(*ppData, packet.getBytesPtr(), *pSize);
+		return true;
+	}
+
+	// Chunk packets are encoded alone and sent by one frame
+	std::vector <Packet*> packets;
+	bool bResult = true;
+	int offset = 0;
+	int total = 0;
+
+	for(auto it = pBody->packets.begin(); it != pBody->packets.end(); ++it)
+	{
+		Packet* p = new Packet((const unsigned char*)pBody->data + offset, *it);
+		packets.push_back(p);
+		offset += *it;
+
+		if(!EncodePacket(p, pKey, pAeadKey))
+		{
+			bResult = false;
+			break;
+		}
+
+		total += p->getPacketSize();
+	}
+
+	if(bResult)
+	{
+		*ppData = CFramePool::Alloc(total);
+		*pSize = total;
+
+		offset = 0;
+		for(auto it = packets.begin(); it != packets.end(); ++it)
+		{
+			memcpy(*ppData + offset, (*it)->getBytesPtr(), (*it)->getPacketSize());
+			offset += (*it)->getPacketSize();
+		}
+	}
+
+	for(auto it = packets.begin(); it != packets.end(); ++it)
+		delete *it;
+
+	return bResult;
+}
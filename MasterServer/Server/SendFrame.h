@@ -0,0 +1,127 @@
+/*************************************************************************
+Copyright (C), chernecoff@gmail.com, 2014-2015
+--------------------------------------------------------------------------
+History:
+
+- 16.10.2026   22:42 : Created by agent
+-------------------------------------------------------------------------
+Encoded packet ready to send. Frame is never changed after creation,
+so one frame can wait in outbound queues of many connections.
+Frame made from packet keeps plain copy, connections with own session
+key get frame encoded or sealed by their key from it. Sender writes
+protocol v2 copy of packet directly, frame without it sends old packet
+under opcode 0 to protocol v2 connections.
+Message bigger than PACKET_CHUNK_SIZE is encoded as chunk packets
+following each other in one frame. Buffers are taken from CFramePool
+and go back to it with last reference. Connections with protocol v2
+or LZ4 get frame variant made from plain copies, message not smaller
+than compression threshold is compressed before encoding.
+Protocol v2, LZ4 and chunk split are done once per flags and shared,
+connection with session key runs only its own encode or seal pass
+over that body.
+*************************************************************************/
+
+#ifndef _SendFrame_
+#define _SendFrame_
+
+#include <atomic>
+#include <vector>
+#include "FramePool.h"
+
+class Packet;
+class CBlowfishKey;
+class CAesGcmKey;
+
+// Connection options changing frame bytes
+#define FRAME_PROTOCOL_V2 1
+#define FRAME_LZ4 2
+#define FRAME_VARIANTS 4
+
+class CSendFrame
+{
+public:
+	// Copies encoded packet bytes. Creator holds first reference
+	CSendFrame(const char* bytes, int length);
+	// Pads and encodes packet by default key. Plain copies of packet and its
+	// protocol v2 packet are kept for session keys and variants
+	CSendFrame(Packet* p, Packet* pV2 = NULL);
+
+	// New frame encoded by session key, NULL if frame has no plain copy. Flags - FRAME_*.
+	// Doesn't change this frame, many threads can encode it at once
+	CSendFrame* Encode(const CBlowfishKey* pKey, int flags = 0);
+	// New frame sealed by AES-GCM key, NULL if frame has no plain copy.
+	// Caller keeps packets sealed by one key in sending order
+	CSendFrame* Seal(CAesGcmKey* pKey, int flags = 0);
+	// Frame variant encoded by default key. Made once and shared, caller gets own reference.
+	// NULL if frame has no plain copy or variant is same as this frame
+	CSendFrame* GetVariant(int flags);
+
+	void AddRef() { refCount++; }
+	void Release()
+	{
+		if(--refCount == 0)
+			delete this;
+	}
+
+	// False if packet could not be encoded, such frame is never sent
+	bool IsValid() { return data != NULL && size > 0; }
+
+	char* GetData() { return data; }
+	int   GetSize() { return size; }
+
+private:
+	// Message with protocol v2 and LZ4 applied, big message is split to chunks.
+	// Plain packets follow each other, none of them is encoded
+	struct SBody
+	{
+		char* data;
+		std::vector <int> packets;   // Size of every packet
+
+		~SBody() { CFramePool::Free(data); }
+	};
+
+	// Takes ownership of encoded bytes from CFramePool
+	CSendFrame(char* bytes, int length, bool);
+
+	// Encode one packet in place by session key, AES-GCM key or default key
+	static bool EncodePacket(Packet* p, const CBlowfishKey* pKey, CAesGcmKey* pAeadKey);
+	// Body of plain copy for flags
+	SBody* MakeBody(int flags);
+	// Encode every body packet to new buffer
+	static bool EncodeBody(const SBody* pBody, const CBlowfishKey* pKey, CAesGcmKey* pAeadKey, char** ppData, int* pSize);
+	// Body for flags. Made once and shared, NULL if frame has no plain copy
+	SBody* GetBody(int flags);
+	// Drops flags not changing this message
+	int GetUsedFlags(int flags);
+
+	~CSendFrame()
+	{
+		CFramePool::Free(data);
+		CFramePool::Free(plain);
+		CFramePool::Free(plainV2);
+
+		for(int i = 0; i < FRAME_VARIANTS; i++)
+		{
+			CSendFrame* pFrame = variants[i];
+			if(pFrame != NULL)
+				pFrame->Release();
+
+			delete bodies[i].load();
+		}
+	}
+
+	char* data;
+	int size;
+
+	char* plain;
+	int plainSize;
+	char* plainV2;
+	int plainV2Size;
+	// Indexed by flags, 0 is this frame
+	std::atomic<CSendFrame*> variants[FRAME_VARIANTS];
+	// Indexed by flags
+	std::atomic<SBody*> bodies[FRAME_VARIANTS];
+	std::atomic<int> refCount;
+};
+
+#endif
@@ -0,0 +1,80 @@
+/*************************************************************************
+Copyright (C), chernecoff@gmail.com, 2014-2015
+--------------------------------------------------------------------------
+History:
+
+- 16.10.2026   23:36 : Created by agent
+-------------------------------------------------------------------------
+
+*************************************************************************/
+
+#include "StdAfx.h"
+#include "Session.h"
+
+CSession::CSession(SOCKET sessionSocket, const char* sessionIp)
+{
+	socket = sessionSocket;
+
+	memset(ip, 0, sizeof(ip));
+	strncpy(ip, sessionIp, sizeof(ip) - 1);
+
+	pendingJobs = 0;
+	pPendingPool = NULL;
+
+	client.socket = socket;
+	client.ip = ip;
+	client.login = "";
+	client.playerId = 0;
+	client.nickname = "Unknown";
+	client.level = 0;
+	client.money = 0;
+	client.xp = 0;
+	client.banStatus = false;
+
+	memset(&server, 0, sizeof(SGameServer));
+	server.socket = INVALID_SOCKET;
+
+	refCount = 1;
+}
+
+CSession::~CSession()
+{
+	CTcpServer::FreeGameServerStrings(server);
+}
+
+SClient CSession::GetClient()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return client;
+}
+
+std::string CSession::GetNickname()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return client.nickname;
+}
+
+std::string CSession::GetLogin()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return client.login;
+}
+
+int CSession::GetPlayerId()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return client.playerId;
+}
+
+void CSession::SetPlayer(const char* login, const SClient& player)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	client.playerId    = player.playerId;
+	client.login       = login;
+	client.nickname    = player.nickname;
+	client.level       = player.level;
+	client.money       = player.money;
+	client.xp          = player.xp;
+	client.banStatus   = !!player.banStatus;
+}
@@ -0,0 +1,74 @@
+/*************************************************************************
+Copyright (C), chernecoff@gmail.com, 2014-2015
+--------------------------------------------------------------------------
+History:
+
+- 16.10.2026   23:36 : Created by agent
+-------------------------------------------------------------------------
+Client or game server behind one connection. Session is made when
+connection is accepted and held by connection, by clients or servers
+registry and by every queued packet of connection, it is deleted with
+last reference. Packets carry session handle, so reader needs no search
+in registries and no copy of client.
+Client info is changed by login, game server info by game server
+packets. Both are guarded by session mutex.
+*************************************************************************/
+
+#ifndef _Session_
+#define _Session_
+
+#include <atomic>
+#include <mutex>
+#include "Packets\RSP.h"
+
+class CHandlerPool;
+
+class CSession
+{
+public:
+	// Creator holds first reference
+	CSession(SOCKET socket, const char* ip);
+
+	void AddRef() { refCount++; }
+	void Release()
+	{
+		if(--refCount == 0)
+			delete this;
+	}
+
+	// Never change
+	SOCKET GetSocket() { return socket; }
+	const char* GetIp() { return ip; }
+
+	// Client info, copied under session mutex
+	SClient GetClient();
+	std::string GetNickname();
+	std::string GetLogin();
+	int GetPlayerId();
+	// Login of player. Caller checks dual login under server lock
+	void SetPlayer(const char* login, const SClient& player);
+
+	// Game server info, read and written between Lock and Unlock
+	SGameServer server;
+	void Lock()   { mutex.lock(); }
+	void Unlock() { mutex.unlock(); }
+
+	// Handler jobs of session queued in pool and not finished. While there are any, next packets
+	// of session go to same pool thread after them, so handlers run in order of packets.
+	// Pool is set and read only by read worker of session
+	std::atomic<int> pendingJobs;
+	CHandlerPool* pPendingPool;
+
+private:
+	~CSession();
+
+	SOCKET socket;
+	char ip[16];
+
+	SClient client;
+	std::mutex mutex;
+
+	std::atomic<int> refCount;
+};
+
+#endif
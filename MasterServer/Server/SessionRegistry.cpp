@@ -0,0 +1,142 @@
+/*************************************************************************
+Copyright (C), chernecoff@gmail.com, 2014-2015
+--------------------------------------------------------------------------
+History:
+
+- 16.10.2026   23:39 : Created by agent
+-------------------------------------------------------------------------
+
+*************************************************************************/
+
+#include "StdAfx.h"
+#include "SessionRegistry.h"
+#include "Session.h"
+
+void SSessionList::Release()
+{
+	if(--refCount > 0)
+		return;
+
+	for(auto it = sessions.begin(); it != sessions.end(); ++it)
+		(*it)->Release();
+
+	delete this;
+}
+
+CSessionSnapshot::~CSessionSnapshot()
+{
+	for(auto it = lists.begin(); it != lists.end(); ++it)
+		(*it)->Release();
+}
+
+CSessionRegistry::CSessionRegistry()
+{
+	for(int i = 0; i < REGISTRY_SHARDS; i++)
+		shards[i].pList = new SSessionList();
+
+	count = 0;
+}
+
+CSessionRegistry::~CSessionRegistry()
+{
+	for(int i = 0; i < REGISTRY_SHARDS; i++)
+		shards[i].pList->Release();
+}
+
+CSessionRegistry::SShard& CSessionRegistry::GetShard(CSession* pSession)
+{
+	// Socket handles are multiples of 4
+	return shards[(pSession->GetSocket() >> 2) % REGISTRY_SHARDS];
+}
+
+void CSessionRegistry::Add(CSession* pSession)
+{
+	SShard& shard = GetShard(pSession);
+
+	// Lock
+	shard.mutex.lock();
+
+	SSessionList* pOld = shard.pList;
+	SSessionList* pNew = new SSessionList();
+	pNew->sessions.reserve(pOld->sessions.size() + 1);
+
+	for(auto it = pOld->sessions.begin(); it != pOld->sessions.end(); ++it)
+	{
+		(*it)->AddRef();
+		pNew->sessions.push_back(*it);
+	}
+
+	pSession->AddRef();
+	pNew->sessions.push_back(pSession);
+
+	shard.pList = pNew;
+	count++;
+
+	shard.mutex.unlock();
+	// Unlock
+
+	// Snapshots can still read old list
+	pOld->Release();
+}
+
+bool CSessionRegistry::Remove(CSession* pSession)
+{
+	SShard& shard = GetShard(pSession);
+	bool bFound = false;
+
+	// Lock
+	shard.mutex.lock();
+
+	SSessionList* pOld = shard.pList;
+	SSessionList* pNew = new SSessionList();
+	pNew->sessions.reserve(pOld->sessions.size());
+
+	for(auto it = pOld->sessions.begin(); it != pOld->sessions.end(); ++it)
+	{
+		if(*it == pSession)
+		{
+			bFound = true;
+			continue;
+		}
+
+		(*it)->AddRef();
+		pNew->sessions.push_back(*it);
+	}
+
+	if(bFound)
+	{
+		shard.pList = pNew;
+		count--;
+	}
+
+	shard.mutex.unlock();
+	// Unlock
+
+	if(bFound)
+		pOld->Release();
+	else
+		pNew->Release();
+
+	return bFound;
+}
+
+void CSessionRegistry::GetSnapshot(CSessionSnapshot& snapshot)
+{
+	snapshot.lists.reserve(REGISTRY_SHARDS);
+
+	for(int i = 0; i < REGISTRY_SHARDS; i++)
+	{
+		// Lock only to take list reference
+		shards[i].mutex.lock();
+		SSessionList* pList = shards[i].pList;
+		pList->AddRef();
+		shards[i].mutex.unlock();
+
+		snapshot.lists.push_back(pList);
+	}
+
+	snapshot.sessions.reserve(count);
+
+	for(auto it = snapshot.lists.begin(); it != snapshot.lists.end(); ++it)
+		snapshot.sessions.insert(snapshot.sessions.end(), (*it)->sessions.begin(), (*it)->sessions.end());
+}
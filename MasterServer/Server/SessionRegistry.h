@@ -0,0 +1,86 @@
+/*************************************************************************
+Copyright (C), chernecoff@gmail.com, 2014-2015
+--------------------------------------------------------------------------
+History:
+
+- 16.10.2026   23:39 : Created by agent
+-------------------------------------------------------------------------
+Online clients or game servers. Sessions are split to shards by socket,
+every shard has immutable list of its sessions. Connect and disconnect
+lock only one shard, make new list from old one and publish it.
+Readers (broadcasts, server browser, console) take snapshot : current
+lists of all shards. Snapshot holds lists and their sessions, so it is
+read without locks while lists are replaced.
+*************************************************************************/
+
+#ifndef _SessionRegistry_
+#define _SessionRegistry_
+
+#include <vector>
+#include <mutex>
+#include <atomic>
+
+#define REGISTRY_SHARDS 16
+
+class CSession;
+
+// Immutable list of one shard. Holds reference of every session
+struct SSessionList
+{
+	SSessionList() { refCount = 1; }
+
+	void AddRef() { refCount++; }
+	void Release();
+
+	std::vector <CSession*> sessions;
+	std::atomic<int> refCount;
+};
+
+// Sessions of all shards. Sessions stay valid while snapshot lives
+class CSessionSnapshot
+{
+public:
+	CSessionSnapshot() {}
+	~CSessionSnapshot();
+
+	int GetCount() { return (int)sessions.size(); }
+
+	std::vector <CSession*> sessions;
+
+private:
+	friend class CSessionRegistry;
+
+	CSessionSnapshot(const CSessionSnapshot&);
+	CSessionSnapshot& operator = (const CSessionSnapshot&);
+
+	std::vector <SSessionList*> lists;
+};
+
+class CSessionRegistry
+{
+public:
+	CSessionRegistry();
+	~CSessionRegistry();
+
+	// Registry takes own reference
+	void Add(CSession* pSession);
+	// False if session is not in registry
+	bool Remove(CSession* pSession);
+
+	int GetCount() { return count; }
+	void GetSnapshot(CSessionSnapshot& snapshot);
+
+private:
+	struct SShard
+	{
+		std::mutex mutex;
+		SSessionList* pList;
+	};
+
+	SShard& GetShard(CSession* pSession);
+
+	SShard shards[REGISTRY_SHARDS];
+	std::atomic<int> count;
+};
+
+#endif
@@ -19,6 +19,8 @@ CTcpServer::CTcpServer()
 {
 	addrlen = sizeof(addr);
 	unique_id = 0;
+	bBlockDualServers = false;
+	sListen = INVALID_SOCKET;
 }
 
 CTcpServer::~CTcpServer()
@@ -78,7 +80,15 @@ void CTcpServer::Start()
 
 void CTcpServer::Free()
 {
-	closesocket(sListen);
+	// Stop accepting first, so no connection is added to stopped io engine
+	if(sListen != INVALID_SOCKET)
+	{
+		SOCKET sClose = sListen;
+		sListen = INVALID_SOCKET;
+		closesocket(sClose);
+	}
+
+	gEnv->pIoEngine->Stop();
 	WSACleanup();
 }
 
@@ -96,8 +106,16 @@ void CTcpServer::ServerThread()
 	// Init packet queue
 	gEnv->pPacketQueue->Init();
 
+	// Init io engine
+	if(!gEnv->pIoEngine->Init(atoi(gEnv->pSettings->GetConfigValue("Server","io_threads"))))
+	{
+		Log(LOG_ERROR,"Error startup io engine!!!");
+		return;
+	}
+
+	bBlockDualServers = !!atoi(gEnv->pSettings->GetConfigValue("Server","block_dual_servers"));
+
 	sListen = socket (AF_INET, SOCK_STREAM, NULL);
-	sConnect = socket(AF_INET, SOCK_STREAM, NULL);
 
 	addr.sin_addr.s_addr = inet_addr (gEnv->pSettings->GetConfigValue("Server","ip")); 
 	addr.sin_port        = htons (atoi(gEnv->pSettings->GetConfigValue("Server","port")));   
@@ -105,7 +123,7 @@ void CTcpServer::ServerThread()
 
 	if(bind(sListen, (SOCKADDR*)&addr ,sizeof(addr)) >= 0)
 	{
-		listen (sListen,64);
+		listen (sListen,SOMAXCONN);
 
 		Log(LOG_INFO,"Server started!");
 		Log(LOG_INFO,"Server ip '%s'",gEnv->pSettings->GetConfigValue("Server","ip"));
@@ -115,261 +133,305 @@ void CTcpServer::ServerThread()
 
 		while (true)
 		{
-			if(sConnect = accept (sListen ,(SOCKADDR*)&addr, &addrlen))
+			addrlen = sizeof(addr);
+
+			if((sConnect = accept (sListen ,(SOCKADDR*)&addr, &addrlen)) == INVALID_SOCKET)
 			{
-				Log(LOG_INFO,"New incoming connection from '%s' ...",inet_ntoa((in_addr)addr.sin_addr));
+				// Listening socket is closed by Free
+				if(sListen == INVALID_SOCKET)
+					break;
+
+				continue;
+			}
 
-				// Sending identification package
-				gEnv->pRsp->SendIdentificationPacket(sConnect);
+			Log(LOG_INFO,"New incoming connection from '%s' ...",inet_ntoa((in_addr)addr.sin_addr));
 
-				char *Buffer = new char [2048];
-				int size = 0;
+			// New clients switch to own session key after identification. Key is made by
+			// both sides from exchanged public keys, public key is copied before connection
+			// owns key pair
+			CKeyExchange* pKeyExchange = NULL;
+			char publicKey[KEY_EXCHANGE_HEX_SIZE];
 
-				while(size != SOCKET_ERROR)
+			if(gEnv->bSessionKeys)
+			{
+				pKeyExchange = new CKeyExchange;
+
+				if(!pKeyExchange->Generate() || !pKeyExchange->GetPublicKey(publicKey))
 				{
-					if((size = recv (sConnect,Buffer,2048,NULL)) > 0) 
-					{
-						Log(LOG_DEBUG,"New incoming packet from <%s>...Reading..", inet_ntoa((in_addr)addr.sin_addr));
-
-						SPacket Packet;
-						Packet.data = Buffer;
-						Packet.size = size;
-
-						EPacketType PacketType = gEnv->pRsp->GetPacketType(Packet);
-
-						switch (PacketType)
-						{
-						case PACKET_IDENTIFICATION:
-							{
-								if(gEnv->allPlayers != gEnv->maxPlayers)
-								{
-									Log(LOG_DEBUG,"Client packet from '%s' accepted! Create new thread...", inet_ntoa((in_addr)addr.sin_addr));
-
-									SClient client;
-									client.socket = sConnect;
-									client.ip = inet_ntoa((in_addr)addr.sin_addr);
-
-									std::thread clientThread(&CTcpServer::ClientThread, this, client);
-									clientThread.detach();
-								}
-
-								break;
-							}
-						case PACKET_GAME_SERVER:
-							{
-								if(gEnv->allServers != gEnv->maxGameServers)
-								{					
-									SGameServer server;
-									server.socket = sConnect;
-									server.ip = inet_ntoa((in_addr)addr.sin_addr);
-
-									bool blockDual = false;
-
-									for(auto it = vServers.begin(); it != vServers.end(); ++it)
-									{
-										if(it->ip = server.ip)
-										{
-											// Block dual servers
-											bool tmp = !!atoi(gEnv->pSettings->GetConfigValue("Server","block_dual_servers"));
-
-											if(tmp)
-											{
-												closesocket(server.socket);
-												blockDual = true;
-												Log(LOG_WARNING,"Block dual connection from game server '%s'",inet_ntoa((in_addr)addr.sin_addr));
-											}
-										}
-									}
-
-									if(!blockDual)
-									{
-										std::thread gameServerThread(&CTcpServer::GameServerThread, this, server);
-										gameServerThread.detach();
-
-										Log(LOG_DEBUG,"Game server packet from '%s' accepted! Create new thread...", inet_ntoa((in_addr)addr.sin_addr));
-									}
-								}
-								break;
-							}
-						default:
-							Log(LOG_WARNING,"Unknown packet from <%s> client...ignoring...",inet_ntoa((in_addr)addr.sin_addr));
-							closesocket(sConnect);
-							break;
-						}
-
-						break;
-					}		
+					delete pKeyExchange;
+					pKeyExchange = NULL;
 				}
+			}
 
-				delete[] Buffer;
+			// First packet from connection will be read by io engine
+			if(!gEnv->pIoEngine->AddConnection(sConnect, inet_ntoa((in_addr)addr.sin_addr), pKeyExchange))
+			{
+				closesocket(sConnect);
+				continue;
 			}
+
+			// Sending identification package
+			gEnv->pRsp->SendIdentificationPacket(sConnect, pKeyExchange != NULL ? publicKey : NULL);
 		}
 	}
 	else
 		Log(LOG_ERROR, "Filed bind socket! Please, check you server.cfg and setup server ip and port.");
 }
 
-void CTcpServer::ClientThread(SClient client)
+bool CTcpServer::OnNewConnection(SConnection* pConnection, SPacket packet)
 {
-	std::vector <SClient>::iterator it;
+	Log(LOG_DEBUG,"New incoming packet from <%s>...Reading..", pConnection->ip);
 
-	char *Buffer = new char [2048];
-	int size = 0;
-	client.nickname = "Unknown";
+	SDecodedPacket Decoded;
+	EPacketType PacketType = (EPacketType)-1;
+	ESessionCrypto crypto = SESSION_CRYPTO_NONE;
+	char peerKey[KEY_EXCHANGE_HEX_SIZE];
+	bool bProtocolV2 = false;
+	bool bLz4 = false;
 
-	gEnv->allPlayers++;
+	if(gEnv->pRsp->DecodePacket(packet, Decoded))
+	{
+		PacketType = Decoded.type;
 
-	mutex.lock(); // Lock
-	vClients.push_back(client);
-	mutex.unlock(); // Unlock
+		if(PacketType == PACKET_IDENTIFICATION)
+			crypto = gEnv->pRsp->ReadIdentificationPacket(Decoded, peerKey, bProtocolV2, bLz4);
 
-	Log(LOG_INFO,"Client <%s:%s> connected!",client.nickname.c_str(),client.ip);
+		gEnv->pRsp->FreePacket(Decoded);
+	}
 
-	while(size != SOCKET_ERROR)
+	switch (PacketType)
 	{
-		if((size = recv (client.socket,Buffer,2048,NULL)) > 0 && size != SOCKET_ERROR)
+	case PACKET_IDENTIFICATION:
 		{
-			gEnv->inPackets++;
+			// Key must be set before client gets to broadcast list
+			if(gEnv->pIoEngine->EnableSessionKey(pConnection, crypto, peerKey))
+				Log(LOG_DEBUG,"Client '%s' uses session key, %s", pConnection->ip, crypto == SESSION_CRYPTO_AES_GCM ? "AES-GCM" : "blowfish");
 
-			SPacket packet;
-			packet.data = Buffer;
-			packet.size = size;
+			// Old clients keep old packets
+			if(bProtocolV2 && gEnv->bProtocolV2)
+			{
+				gEnv->pIoEngine->EnableProtocolV2(pConnection);
+				Log(LOG_DEBUG,"Client '%s' uses protocol v2", pConnection->ip);
+			}
 
-			mutex.lock(); // Lock
+			if(bLz4 && gEnv->compressionThreshold > 0)
+			{
+				gEnv->pIoEngine->EnableLz4(pConnection);
+				Log(LOG_DEBUG,"Client '%s' uses LZ4 compression", pConnection->ip);
+			}
+
+			// Limit check and registration are one step, so two clients can't take last place
+			// Lock
+			mutex.lock();
+
+			bool bAccepted = gEnv->allPlayers < gEnv->maxPlayers;
+			if(bAccepted)
+				ClientConnected(pConnection);
+
+			mutex.unlock();
+			// Unlock
+
+			if(bAccepted)
+			{
+				Log(LOG_DEBUG,"Client packet from '%s' accepted!", pConnection->ip);
+				return true;
+			}
+
+			Log(LOG_WARNING,"Players limit reached! Client '%s' rejected", pConnection->ip);
+			break;
+		}
+	case PACKET_GAME_SERVER:
+		{
+			bool blockDual = false;
+			bool bAccepted = false;
+
+			// Dual server and limit checks and registration are one step
+			// Lock
+			mutex.lock();
 
-			for(it = vClients.begin(); it != vClients.end(); ++it)
+			if(gEnv->allServers < gEnv->maxGameServers)
 			{
-				if(it->socket == client.socket)  // Get client iterator
+				if(bBlockDualServers)
 				{
-					client.socket = it->socket;
-					client.ip = it->ip;
-					client.login  = it->login;
-					client.nickname = it->nickname;
-					client.level = it->level;
-					client.money = it->money;
-					client.xp = it->xp;
-					client.banStatus = it->banStatus;
-					break;
+					CSessionSnapshot snapshot;
+					servers.GetSnapshot(snapshot);
+
+					for(auto it = snapshot.sessions.begin(); it != snapshot.sessions.end() && !blockDual; ++it)
+					{
+						// Block dual servers
+						(*it)->Lock();
+						blockDual = !strcmp((*it)->server.ip, pConnection->ip);
+						(*it)->Unlock();
+					}
+				}
+
+				if(!blockDual)
+				{
+					GameServerConnected(pConnection);
+					bAccepted = true;
 				}
 			}
-			
 
-			mutex.unlock(); // Unlock
+			mutex.unlock();
+			// Unlock
 
-			SReadPacket Packet;
-			Packet.client = client;
-			Packet.packet = packet;
+			if(bAccepted)
+			{
+				Log(LOG_DEBUG,"Game server packet from '%s' accepted!", pConnection->ip);
+				return true;
+			}
 
-			gEnv->pPacketQueue->InsertPacketToRead(Packet);
-		}
-		else
+			if(blockDual)
+				Log(LOG_WARNING,"Block dual connection from game server '%s'", pConnection->ip);
 			break;
-
-		Sleep(1);
+		}
+	default:
+		Log(LOG_WARNING,"Unknown packet from <%s> client...ignoring...", pConnection->ip);
+		break;
 	}
 
-	mutex.lock(); // Lock
-	for(it = vClients.begin(); it != vClients.end(); ++it)
-	{
-		if(it->socket == client.socket)
-			break;
-	}
-	vClients.erase(it);
-	mutex.unlock(); // Unlock
+	return false;
+}
 
-	Log(LOG_INFO,"Client <%s:%s> dissconected!",client.nickname.c_str(), client.ip);
+void CTcpServer::ClientConnected(SConnection* pConnection)
+{
+	// Connection holds first reference, registry takes own
+	CSession* pSession = new CSession(pConnection->socket, pConnection->ip);
 
-	if(strcmp(client.nickname.c_str(), "Unknown"))
-		SendClientStatus(client.nickname,CLIENT_DISCONNECTED);
+	pConnection->type = CONNECTION_CLIENT;
+	pConnection->pSession = pSession;
 
-	gEnv->allPlayers--;
+	clients.Add(pSession);
+	gEnv->allPlayers++;
 
-	delete[] Buffer;
-	closesocket(client.socket);	
+	Log(LOG_INFO,"Client <%s:%s> connected!",pSession->GetNickname().c_str(),pSession->GetIp());
 }
 
-void CTcpServer::GameServerThread(SGameServer server)
+void CTcpServer::GameServerConnected(SConnection* pConnection)
 {
-	std::vector <SGameServer>::iterator it;
+	CSession* pSession = new CSession(pConnection->socket, pConnection->ip);
+	pSession->server.socket = pConnection->socket;
+	pSession->server.ip = _strdup(pConnection->ip);
+	pSession->server.serverName = _strdup("Unknown");
+	pSession->server.id = unique_id++;
 
-	char *Buffer = new char [2048];
-	int size = 0;
-	server.serverName = "Unknown";
-	server.id = unique_id;
+	pConnection->type = CONNECTION_GAME_SERVER;
+	pConnection->pSession = pSession;
 
+	servers.Add(pSession);
 	gEnv->allServers++;
-	unique_id++;
 
-	mutex.lock(); // Lock
-	vServers.push_back(server);
-	mutex.unlock(); // Unlock
+	Log(LOG_INFO,"Game server <%s:%s> connected!","Unknown",pSession->GetIp());
+}
 
-	Log(LOG_INFO,"Game server <%s:%s> connected!",server.serverName,server.ip);
+void CTcpServer::OnClientPacket(SConnection* pConnection, SPacket packet)
+{
+	// Receive buffer is reused by next recv, so read queue gets own copy.
+	// Sender goes by session handle, packet holds own reference
+	SReadPacket Packet;
+	Packet.pSession = pConnection->pSession;
+	Packet.pSession->AddRef();
+	Packet.pKey = pConnection->pSessionKey;
+	if(Packet.pKey != NULL)
+		Packet.pKey->AddRef();
+	Packet.pAeadKey = pConnection->pAeadKey;
+	if(Packet.pAeadKey != NULL)
+		Packet.pAeadKey->AddRef();
+	Packet.bProtocolV2 = pConnection->bProtocolV2;
+	Packet.packet.data = new char [packet.size];
+	Packet.packet.size = packet.size;
+	Packet.packet.addr = packet.addr;
+	memcpy(Packet.packet.data, packet.data, packet.size);
+
+	gEnv->pPacketQueue->InsertPacketToRead(Packet);
+}
 
-	while(size != SOCKET_ERROR)
+void CTcpServer::OnGameServerPacket(SConnection* pConnection, SPacket packet)
+{
+	// Receive buffer is reused by next recv, so read queue gets own copy
+	SReadPacket Packet;
+	Packet.pSession = pConnection->pSession;
+	Packet.pSession->AddRef();
+	Packet.pKey = NULL;
+	Packet.pAeadKey = NULL;
+	Packet.bProtocolV2 = false;
+	Packet.packet.data = new char [packet.size];
+	Packet.packet.size = packet.size;
+	Packet.packet.addr = packet.addr;
+	memcpy(Packet.packet.data, packet.data, packet.size);
+
+	gEnv->pPacketQueue->InsertPacketToRead(Packet);
+}
+
+void CTcpServer::OnDisconnect(SConnection* pConnection)
+{
+	CSession* pSession = pConnection->pSession;
+	if(pSession == NULL)
+		return;
+
+	switch (pConnection->type)
 	{
-		if((size = recv (server.socket,Buffer,2048,NULL)) > 0 && size != SOCKET_ERROR)
+	case CONNECTION_CLIENT:
 		{
-			gEnv->inPackets++;
-
-			SPacket packet;
-			packet.data = Buffer;
-			packet.size = size;
+			if(!clients.Remove(pSession))
+				return;
 
-			mutex.lock(); // Lock
+			gEnv->allPlayers--;
 
-			for(it = vServers.begin(); it != vServers.end(); ++it)
-			{
-				if(it->socket == server.socket)  // Get iterator
-				{
-					server.socket = it->socket;
-					server.serverName = it->serverName;
-					server.mapName = it->mapName;
-					server.gameRules = it->gameRules;
-					server.ip = it->ip;
-					server.currentPlayers = it->currentPlayers;
-					server.maxPlayers = it->maxPlayers;
-					server.port = it->port;
-					break;
-				}
-			}
+			std::string nickname = pSession->GetNickname();
 
-			mutex.unlock(); // Unlock
+			Log(LOG_INFO,"Client <%s:%s> dissconected!",nickname.c_str(), pSession->GetIp());
 
-			SReadPacket Packet;
-			Packet.server = server;
-			Packet.packet = packet;
+			if(strcmp(nickname.c_str(), "Unknown"))
+				SendClientStatus(nickname,CLIENT_DISCONNECTED);
 
-			gEnv->pPacketQueue->InsertPacketToRead(Packet);
-		}
-		else
 			break;
+		}
+	case CONNECTION_GAME_SERVER:
+		{
+			if(!servers.Remove(pSession))
+				return;
 
-		Sleep(1);
-	}
+			gEnv->allServers--;
+
+			pSession->Lock();
+			std::string serverName = pSession->server.serverName;
+			int id = pSession->server.id;
+			pSession->Unlock();
+
+			Log(LOG_INFO,"Game server <%s:%s> dissconected!",serverName.c_str(), pSession->GetIp());
+
+			if(strcmp(serverName.c_str(),"Unknown"))
+				RemoveGameServer(id);
 
-	mutex.lock(); // Lock
-	for(it = vServers.begin(); it != vServers.end(); ++it)
-	{
-		if(it->socket == server.socket)
-		{
-			server.serverName = it->serverName;
-			server.ip = it->ip;
 			break;
 		}
+	default:
+		break;
 	}
-	vServers.erase(it);
-	mutex.unlock(); // Unlock
-
-	Log(LOG_INFO,"Game server <%s:%s> dissconected!",server.serverName, server.ip);
+}
 
-	if(strcmp(server.serverName,"Unknown"))
-		RemoveGameServer(server.id);
+void CTcpServer::CopyGameServerStrings(SGameServer& server, const SGameServer& info)
+{
+	FreeGameServerStrings(server);
 
-	gEnv->allServers--;
+	server.ip = info.ip ? _strdup(info.ip) : NULL;
+	server.serverName = info.serverName ? _strdup(info.serverName) : NULL;
+	server.mapName = info.mapName ? _strdup(info.mapName) : NULL;
+	server.gameRules = info.gameRules ? _strdup(info.gameRules) : NULL;
+}
 
-	delete[] Buffer;
-	closesocket(server.socket);	
+void CTcpServer::FreeGameServerStrings(SGameServer& server)
+{
+	free((void*)server.ip);
+	free((void*)server.serverName);
+	free((void*)server.mapName);
+	free((void*)server.gameRules);
+
+	server.ip = NULL;
+	server.serverName = NULL;
+	server.mapName = NULL;
+	server.gameRules = NULL;
 }
 
 int CTcpServer::InitWinSock ()
@@ -383,50 +445,42 @@ int CTcpServer::InitWinSock ()
 
 void CTcpServer::SendServerInfo()
 {
-	mutex.lock();
-
 	SMasterServerInfo info;
-	info.playersOnline = vClients.size();
-	info.gameServersOnline = vServers.size();
+	info.playersOnline = clients.GetCount();
+	info.gameServersOnline = servers.GetCount();
 
-	if(vClients.size()>0)
-	{
-		for (auto conIT=vClients.begin(); conIT!=vClients.end(); ++conIT)
-			gEnv->pRsp->SendMasterServerInfo(conIT->socket, info);
-	}
+	// Snapshot holds sessions while broadcast is queued
+	CSessionSnapshot snapshot;
+	clients.GetSnapshot(snapshot);
 
-	mutex.unlock();
+	if(snapshot.GetCount()>0)
+		gEnv->pRsp->SendMasterServerInfo(snapshot.sessions, info);
 }
 
 void CTcpServer::RemoveGameServer(int id)
 {
-	mutex.lock();
+	CSessionSnapshot snapshot;
+	clients.GetSnapshot(snapshot);
 
-	if(vClients.size()>0)
+	if(snapshot.GetCount()>0)
 	{
 		SRequestPacket request;
-		request.request = "RemoveGameServer";
+		request.id      = REQUEST_REMOVE_GAME_SERVER;
+		request.request = GetRequestName(request.id);
 		request.iParam  = id;
 		request.sParam = "";
 
-		for (auto conIT=vClients.begin(); conIT!=vClients.end(); ++conIT)
-			gEnv->pRsp->SendRequest(conIT->socket, request);
+		gEnv->pRsp->SendRequest(snapshot.sessions, request);
 	}
-
-	mutex.unlock();
 } 
 
 void CTcpServer::SendGlobalMessage(SMessage message)
 {
-	mutex.lock();
-
-	if(vClients.size()>0)
-	{
-		for (auto conIT=vClients.begin(); conIT!=vClients.end(); ++conIT)
-			gEnv->pRsp->SendMsg(conIT->socket,message);
-	}
+	CSessionSnapshot snapshot;
+	clients.GetSnapshot(snapshot);
 
-	mutex.unlock();
+	if(snapshot.GetCount()>0)
+		gEnv->pRsp->SendMsg(snapshot.sessions, message);
 } 
 
 void CTcpServer::SendClientStatus(std::string name, EClientStatus status)
@@ -466,6 +520,6 @@ void CTcpServer::SendClientStatus(std::string name, EClientStatus status)
 void CTcpServer::SetServerStatus()
 {
 	char text[256];
-	sprintf(text,"Input packets : %d , Output packets : %d, Players online : %d, Game servers online :%d", gEnv->inPackets, gEnv->outPackets, gEnv->allPlayers, gEnv->allServers);
+	sprintf(text,"Input packets : %d , Output packets : %d, Players online : %d, Game servers online :%d", gEnv->inPackets, gEnv->outPackets, (int)gEnv->allPlayers, (int)gEnv->allServers);
 	SendMessage (gEnv->statusBox, WM_SETTEXT, FALSE, reinterpret_cast<LPARAM>(text)); 
 }
\ No newline at end of file
@@ -11,8 +11,12 @@ History:
 #ifndef _TCP_SERVER_
 #define _TCP_SERVER_
 
-#include <winsock.h>
+#include <winsock2.h>
 #include "Packets\RSP.h"
+#include "Session.h"
+#include "SessionRegistry.h"
+
+struct SConnection;
 
 class CTcpServer
 {
@@ -25,6 +29,16 @@ public:
 
 	void SendClientStatus(std::string name, EClientStatus status);
 
+	// Io engine events
+	bool OnNewConnection(SConnection* pConnection, SPacket packet);
+	void OnClientPacket(SConnection* pConnection, SPacket packet);
+	void OnGameServerPacket(SConnection* pConnection, SPacket packet);
+	void OnDisconnect(SConnection* pConnection);
+
+	// Game servers list owns copies of strings. Old copies of server are freed
+	static void CopyGameServerStrings(SGameServer& server, const SGameServer& info);
+	static void FreeGameServerStrings(SGameServer& server);
+
 private:
 	void ServerThread();
 	void Update();
@@ -35,11 +49,13 @@ private:
 	
 	int InitWinSock();
 
-	void ClientThread(SClient client);
-	void GameServerThread(SGameServer server);
+	void ClientConnected(SConnection* pConnection);
+	void GameServerConnected(SConnection* pConnection);
 public:
-	std::vector <SClient> vClients;
-	std::vector <SGameServer> vServers;
+	// Online sessions, readers iterate snapshots
+	CSessionRegistry clients;
+	CSessionRegistry servers;
+	// Serializes dual login check and login, limit and dual server checks and registration
 	std::mutex mutex;
 
 protected:
@@ -48,7 +64,8 @@ protected:
 	SOCKET sListen;
 
 	int addrlen;
-	int unique_id;
+	std::atomic<int> unique_id;
+	bool bBlockDualServers;
 };
 
 #endif
\ No newline at end of file
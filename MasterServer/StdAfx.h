@@ -13,6 +13,7 @@ History:
 *************************************************************************/
 #define WIN32_LEAN_AND_MEAN 
 
+#include <winsock2.h>
 #include <windows.h>
 #include <string>
 #include <map>
@@ -20,6 +21,7 @@ History:
 
 #include <thread>
 #include <mutex>
+#include <atomic>
 
 #include "System\Global.h"
 
@@ -0,0 +1,28 @@
+/*************************************************************************
+Copyright (C), chernecoff@gmail.com, 2014-2015
+--------------------------------------------------------------------------
+History:
+
+- 16.10.2026   23:51 : Created by agent
+-------------------------------------------------------------------------
+Account database used by packet handlers. Xml and binary databases
+implement it, use_binary setting selects binary one.
+*************************************************************************/
+
+#ifndef _AccountStore_
+#define _AccountStore_
+
+class IAccountStore
+{
+public:
+	virtual ~IAccountStore(){}
+
+	virtual void Init() = 0;
+
+	// Results are system messages sent to client
+	virtual const char* Register(std::string login, std::string password, std::string nickName) = 0;
+	virtual const char* Login(std::string login, std::string password) = 0;
+	virtual SClient GetUserInfo(std::string login) = 0;
+};
+
+#endif
@@ -62,55 +62,100 @@ void CConsoleCommands::Status()
 {
 	Log(LOG_WARNING,"********************Server status********************");
 	Log(LOG_INFO,"Server working time : %d min.", (clock()-(gEnv->startTime))/60000);
-	Log(LOG_INFO,"Number of connected clients : %d", gEnv->allPlayers);
+	Log(LOG_INFO,"Number of connected clients : %d", (int)gEnv->allPlayers);
 	Log(LOG_INFO,"Number of authorized clients : %d", gEnv->aClients);
 	Log(LOG_INFO,"Number of registered clients : %d", gEnv->rClients);
 	Log(LOG_INFO,"Number of sql queries : %d", gEnv->sqlCounter);
 	Log(LOG_INFO,"Number of all incoming packets : %d", gEnv->inPackets);
 	Log(LOG_INFO,"Number of all send packets : %d", gEnv->outPackets);
-	Log(LOG_INFO,"Number connected game server : %d",gEnv->allServers);
+	Log(LOG_INFO,"Number connected game server : %d",(int)gEnv->allServers);
+
+	for(int i = 0; i < gEnv->pPacketQueue->GetWorkersCount(); i++)
+	{
+		Log(LOG_INFO,"Read worker %d : queue %d, load %d%%, packets %d", i, gEnv->pPacketQueue->GetWorkerQueueDepth(i),
+			gEnv->pPacketQueue->GetWorkerLoad(i), gEnv->pPacketQueue->GetWorkerPackets(i));
+	}
+
+	CHandlerPool* pHandlerPool = gEnv->pPacketQueue->GetPool(HANDLER_WORKER_POOL);
+	CHandlerPool* pDbPool = gEnv->pPacketQueue->GetPool(HANDLER_DB_POOL);
+	Log(LOG_INFO,"Handler workers : %d, queue %d", pHandlerPool->GetWorkersCount(), pHandlerPool->GetQueueDepth());
+	Log(LOG_INFO,"Database workers : %d, queue %d", pDbPool->GetWorkersCount(), pDbPool->GetQueueDepth());
+
+	for(int i = 0; i < PACKET_HANDLERS; i++)
+	{
+		SPacketHandlerStats stats;
+		if(!gEnv->pPacketQueue->GetHandlerStats(i, stats))
+			continue;
+
+		static const char* policies[] = { "inline", "handler pool", "database pool" };
+		Log(LOG_INFO,"Handler %s (%s) : calls %d, errors %d, avg %d us, max %d us", stats.name, policies[stats.policy],
+			stats.calls, stats.errors, stats.averageTime, stats.maxTime);
+	}
+
+	for(int i = 0; i < CFramePool::GetClassesCount(); i++)
+	{
+		SFramePoolStats stats;
+		CFramePool::GetStats(i, stats);
+
+		if(stats.bufferSize > 0)
+			Log(LOG_INFO,"Frame pool %d b : in use %d (peak %d), cached %d/%d, allocations %d, misses %d", stats.bufferSize,
+				stats.inUse, stats.peakInUse, stats.cached, stats.maxCached, stats.allocations, stats.misses);
+		else
+			Log(LOG_INFO,"Frame pool heap : in use %d (peak %d), allocations %d", stats.inUse, stats.peakInUse, stats.allocations);
+	}
+
 	Log(LOG_WARNING,"******************************************************");
 }
 
 
 void CConsoleCommands::ShowPlayers()
 {
-	gEnv->pServer->mutex.lock();
+	// Log is slow, list is printed from snapshot without blocking connects
+	CSessionSnapshot snapshot;
+	gEnv->pServer->clients.GetSnapshot(snapshot);
 
-	if(gEnv->pServer->vClients.size()>0)
+	if(snapshot.GetCount()>0)
 	{
 		Log(LOG_INFO,"-----------------Player list-------------------");
 		//
-		for (auto it = gEnv->pServer->vClients.begin(); it != gEnv->pServer->vClients.end(); ++it)
+		for (auto it = snapshot.sessions.begin(); it != snapshot.sessions.end(); ++it)
 		{
-			Log(LOG_INFO,"Player '%s' , ip '%s', id '%d'" , (*it).nickname, (*it).ip, (*it).playerId);
+			SClient client = (*it)->GetClient();
+			Log(LOG_INFO,"Player '%s' , ip '%s', id '%d'" , client.nickname.c_str(), client.ip, client.playerId);
 		}
 		//
 		Log(LOG_INFO,"-----------------------------------------------");
 	}
 	else
 		Log(LOG_WARNING,"No connected players!");
-
-	gEnv->pServer->mutex.unlock();
 }
 
 void CConsoleCommands::ShowServers()
 {
-	gEnv->pServer->mutex.lock();
+	CSessionSnapshot snapshot;
+	gEnv->pServer->servers.GetSnapshot(snapshot);
 
-	if(gEnv->pServer->vServers.size()>0)
+	if(snapshot.GetCount()>0)
 	{
 		Log(LOG_INFO,"-----------------Server list-------------------");
 		//
-		for (auto it = gEnv->pServer->vServers.begin(); it != gEnv->pServer->vServers.end(); ++it)
-			Log(LOG_INFO,"Server '%s' , Ip '%s' , Port '%d', id = '%d' , Online = '%d'", (*it).serverName, (*it).ip, (*it).port, (*it).id, (*it).currentPlayers);
+		for (auto it = snapshot.sessions.begin(); it != snapshot.sessions.end(); ++it)
+		{
+			(*it)->Lock();
+			std::string serverName = (*it)->server.serverName;
+			std::string ip = (*it)->server.ip;
+			int port = (*it)->server.port;
+			int id = (*it)->server.id;
+			int currentPlayers = (*it)->server.currentPlayers;
+			(*it)->Unlock();
+
+			Log(LOG_INFO,"Server '%s' , Ip '%s' , Port '%d', id = '%d' , Online = '%d'", serverName.c_str(), ip.c_str(), port, id, currentPlayers);
+		}
 		//
 		Log(LOG_INFO,"-----------------------------------------------");
 	}
 	else
 		Log(LOG_WARNING,"No connected game servers!");
-
-	gEnv->pServer->mutex.unlock();
 }
 
 void CConsoleCommands::Quit()
@@ -123,6 +168,9 @@ void CConsoleCommands::Test()
 {
 	Log(LOG_INFO, "Test sending all game servers");
 
-	for (auto it=gEnv->pServer->vClients.begin(); it!=gEnv->pServer->vClients.end(); ++it)
-			gEnv->pRsp->SendGameServers(it->socket);	
+	CSessionSnapshot snapshot;
+	gEnv->pServer->clients.GetSnapshot(snapshot);
+
+	for (auto it=snapshot.sessions.begin(); it!=snapshot.sessions.end(); ++it)
+			gEnv->pRsp->SendGameServers(*it);	
 }
\ No newline at end of file
@@ -16,10 +16,13 @@ History:
 // Server
 #include "Server\PacketQueue.h"
 #include "Server\TcpServer.h"
+#include "Server\IoEngine.h"
 
 // Databases
+#include "AccountStore.h"
 #include "MySql\MySql.h"
 #include "Xml\XmlDatabase.h"
+#include "Binary\BinaryDatabase.h"
 
 // System
 #include "ConsoleCommands.h"
@@ -34,7 +37,11 @@ struct SGlobal
 	// Class pointers
 	CConsoleCommands* pConsole;
 	CTcpServer* pServer;
+	CIoEngine* pIoEngine;
 	CXmlDatabase* pXml;
+	CBinaryDatabase* pBinary;
+	// Xml or binary database, set and initialized by MasterServerInit before server starts
+	IAccountStore* pAccounts;
 	CSettings* pSettings;
 	CMySql* pMySql;
 	CReadSendPacket* pRsp;
@@ -45,6 +52,8 @@ struct SGlobal
 	const char* serverVersion;
 	int maxPlayers;
 	int maxGameServers;
+	// Plain message size from which it is compressed, 0 - compression is off
+	int compressionThreshold;
 
 	// Statistic variables
 	int startTime;
@@ -53,13 +62,19 @@ struct SGlobal
 	int sqlCounter;
 	int inPackets;
 	int outPackets;
-	int allPlayers;
-	int allServers;
+	// Changed by connects and disconnects of io threads
+	std::atomic<int> allPlayers;
+	std::atomic<int> allServers;
 
 	// Booleans
 	bool bUseXml;
+	bool bUseBinary;
 	bool bDebugMode;
 	bool bBlowFish;
+	bool bSessionKeys;
+	bool bAead;
+	bool bProtocolV2;
+	bool bVerifyChecksum;
 
 	// Windows handles
 	HWND logBox;
@@ -76,8 +91,10 @@ struct SGlobal
 		outPackets = 0;
 		allPlayers = 0;
 		allServers = 0;
+		compressionThreshold = 0;
 
 		bUseXml = false;
+		bUseBinary = false;
 
 #if defined RELEASE
 		bDebugMode = false;
@@ -86,12 +103,19 @@ struct SGlobal
 		bDebugMode = true;
 #endif
 		bBlowFish = false;
+		bSessionKeys = false;
+		bAead = false;
+		bProtocolV2 = false;
+		bVerifyChecksum = false;
 
 		pServer      = new CTcpServer;
+		pIoEngine    = new CIoEngine;
 		pPacketQueue = new CPacketQueue;
 		pLog         = new CAppLog;
 		pConsole     = new CConsoleCommands;
 		pXml         = new CXmlDatabase;
+		pBinary      = new CBinaryDatabase;
+		pAccounts    = NULL;
 		pSettings    = new CSettings;
 		pMySql       = new CMySql;
 		pRsp         = new CReadSendPacket;
@@ -26,9 +26,21 @@ char* defParams = "[Server]\n"
 				  "port=64087\n"
 				  "max_players=16\n"
 				  "max_gameservers=1\n"
+				  "io_threads=0\n"
+				  "read_workers=0\n"
+				  "handler_workers=2\n"
+				  "db_workers=1\n"
 				  "use_xml=1\n"
+				  "use_binary=0\n"
+				  "wal_snapshot_size=1024\n"
 				  "block_dual_servers=1\n"
 				  "block_dual_players=1\n"
+				  "session_keys=1\n"
+				  "aead=1\n"
+				  "protocol_v2=1\n"
+				  "verify_checksum=1\n"
+				  "compression_threshold=1024\n"
+				  "frame_pool_size=4096\n"
 				  "securityKey=PLEASE_CHANGE_YOU_MASTER_SERVER_SUPER_STRONG_ENCRYPTION_KEY_HERE";
 
 ////////////////////////////////////////////////////////////////////
@@ -112,6 +124,18 @@ int read_sec_parm(char *filename,char *sect_name,char *parm_name,char *save_buff
 
 const char* CSettings::GetConfigValue(char* sectionName, char* valueName)
 {
+	// Missing value is empty, not value of previous call
+	valueBuffer[0] = '\0';
+
 	read_sec_parm("server.cfg",sectionName,valueName,valueBuffer,256);
 	return valueBuffer;
+}
+
+int CSettings::GetConfigInt(char* sectionName, char* valueName, int defaultValue)
+{
+	const char* value = GetConfigValue(sectionName, valueName);
+	if(value[0] == '\0')
+		return defaultValue;
+
+	return atoi(value);
 }
\ No newline at end of file
@@ -20,6 +20,8 @@ public:
 	~CSettings(void){}
 
 	const char* GetConfigValue(char* sectionName, char* valueName);
+	// Default value is used when value is missing or empty, e.g. in config of older version
+	int GetConfigInt(char* sectionName, char* valueName, int defaultValue);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,251 @@
+/*************************************************************************
+Copyright (C), chernecoff@gmail.com, 2014-2015
+--------------------------------------------------------------------------
+History:
+
+- 16.10.2026   23:46 : Created by agent
+-------------------------------------------------------------------------
+
+*************************************************************************/
+
+#include "StdAfx.h"
+#include "AccountLog.h"
+#include "..\..\Common\Checksum.h"
+
+#include <io.h>
+
+CAccountLog::CAccountLog()
+{
+	hFile = INVALID_HANDLE_VALUE;
+	hWriteEvent = NULL;
+	size = 0;
+	nextLsn = 1;
+	durableLsn = 0;
+	// Records are not written until log is opened, waiting for them fails at once
+	bFailed = true;
+}
+
+CAccountLog::~CAccountLog()
+{
+	if(hFile != INVALID_HANDLE_VALUE)
+		CloseHandle(hFile);
+
+	if(hWriteEvent)
+		CloseHandle(hWriteEvent);
+}
+
+bool CAccountLog::Open(const char* name, std::vector <SWalRecord>& records)
+{
+	fileName = name;
+	oldFileName = fileName + ".old";
+
+	// Old log exists if snapshot was not finished
+	ReadLog(oldFileName, records);
+	unsigned int validSize = ReadLog(fileName, records);
+
+	if(!records.empty())
+		nextLsn = records.back().lsn + 1;
+	durableLsn = nextLsn - 1;
+
+	hFile = CreateFile(fileName.c_str(), GENERIC_WRITE, FILE_SHARE_READ, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if(hFile == INVALID_HANDLE_VALUE)
+	{
+		Log(LOG_ERROR,"Can't open account log <%s>!", fileName.c_str());
+		bFailed = true;
+		return false;
+	}
+
+	// Broken tail is cut, new records follow last valid one
+	LARGE_INTEGER position;
+	position.QuadPart = validSize;
+	SetFilePointerEx(hFile, position, NULL, FILE_BEGIN);
+	SetEndOfFile(hFile);
+	size = validSize;
+
+	hWriteEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+
+	// Lock
+	mutex.lock();
+	bFailed = false;
+	mutex.unlock();
+	// Unlock
+
+	std::thread writerThread(&CAccountLog::WriterThread, this);
+	writerThread.detach();
+
+	return true;
+}
+
+void CAccountLog::Read(const char* fileName, std::vector <SWalRecord>& records)
+{
+	std::string name = fileName;
+
+	ReadLog(name + ".old", records);
+	ReadLog(name, records);
+}
+
+unsigned int CAccountLog::ReadLog(const std::string& name, std::vector <SWalRecord>& records)
+{
+	HANDLE hLog = CreateFile(name.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if(hLog == INVALID_HANDLE_VALUE)
+		return 0;
+
+	unsigned int lastLsn = records.empty() ? 0 : records.back().lsn;
+	unsigned int validSize = 0;
+
+	SWalRecord record;
+	DWORD bytes = 0;
+
+	while(::ReadFile(hLog, &record, sizeof(SWalRecord), &bytes, NULL) && bytes == sizeof(SWalRecord))
+	{
+		unsigned int checksum = record.checksum;
+		record.checksum = 0;
+
+		// Record written partly by crash ends log
+		if(checksum != PacketChecksum((unsigned char*)&record, sizeof(SWalRecord)) || record.lsn <= lastLsn)
+		{
+			Log(LOG_WARNING,"Account log <%s> is broken after %d records, rest is dropped", name.c_str(), (int)(validSize / sizeof(SWalRecord)));
+			break;
+		}
+
+		record.checksum = checksum;
+		records.push_back(record);
+
+		lastLsn = record.lsn;
+		validSize += sizeof(SWalRecord);
+	}
+
+	CloseHandle(hLog);
+	return validSize;
+}
+
+unsigned int CAccountLog::Append(SWalRecord& record)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	record.lsn = nextLsn++;
+	record.checksum = 0;
+	record.checksum = PacketChecksum((unsigned char*)&record, sizeof(SWalRecord));
+
+	// Nobody writes records of failed or not opened log
+	if(!bFailed)
+		queue.push_back(record);
+
+	if(hWriteEvent)
+		SetEvent(hWriteEvent);
+
+	return record.lsn;
+}
+
+bool CAccountLog::Wait(unsigned int lsn)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+
+	while(durableLsn < lsn && !bFailed)
+		durable.wait(lock);
+
+	return durableLsn >= lsn;
+}
+
+bool CAccountLog::Flush()
+{
+	std::lock_guard<std::mutex> writeLock(writeMutex);
+	return WriteQueue();
+}
+
+bool CAccountLog::Rotate()
+{
+	std::lock_guard<std::mutex> writeLock(writeMutex);
+
+	if(!WriteQueue())
+		return false;
+
+	if(_access(oldFileName.c_str(), 0) != -1)
+		return true;
+
+	CloseHandle(hFile);
+
+	bool bMoved = !!MoveFileEx(fileName.c_str(), oldFileName.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+	if(!bMoved)
+		Log(LOG_ERROR,"Can't move account log <%s>!", fileName.c_str());
+
+	// New empty log, or same log again if it was not moved
+	hFile = CreateFile(fileName.c_str(), GENERIC_WRITE, FILE_SHARE_READ, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if(hFile == INVALID_HANDLE_VALUE)
+	{
+		Log(LOG_ERROR,"Can't open account log <%s>!", fileName.c_str());
+
+		mutex.lock();
+		bFailed = true;
+		mutex.unlock();
+
+		durable.notify_all();
+		return false;
+	}
+
+	LARGE_INTEGER position;
+	position.QuadPart = 0;
+	SetFilePointerEx(hFile, position, NULL, FILE_END);
+
+	if(bMoved)
+		size = 0;
+
+	return true;
+}
+
+void CAccountLog::RemoveOld()
+{
+	DeleteFile(oldFileName.c_str());
+}
+
+void CAccountLog::WriterThread()
+{
+	while(true)
+	{
+		WaitForSingleObject(hWriteEvent, INFINITE);
+
+		std::lock_guard<std::mutex> writeLock(writeMutex);
+		WriteQueue();
+	}
+}
+
+bool CAccountLog::WriteQueue()
+{
+	std::vector <SWalRecord> batch;
+
+	// Lock
+	mutex.lock();
+	batch.swap(queue);
+	mutex.unlock();
+	// Unlock
+
+	if(batch.empty())
+		return true;
+
+	DWORD bytes = (DWORD)(batch.size() * sizeof(SWalRecord));
+	DWORD writtenBytes = 0;
+
+	// One write and one flush for all waiting records
+	bool bWritten = hFile != INVALID_HANDLE_VALUE &&
+		WriteFile(hFile, &batch[0], bytes, &writtenBytes, NULL) && writtenBytes == bytes &&
+		FlushFileBuffers(hFile);
+
+	if(bWritten)
+		size += bytes;
+
+	// Lock
+	mutex.lock();
+	if(bWritten)
+		durableLsn = batch.back().lsn;
+	else
+		bFailed = true;
+	mutex.unlock();
+	// Unlock
+
+	durable.notify_all();
+
+	if(!bWritten)
+		Log(LOG_ERROR,"Can't write account log <%s>! Changes are not saved", fileName.c_str());
+
+	return bWritten;
+}
@@ -0,0 +1,94 @@
+/*************************************************************************
+Copyright (C), chernecoff@gmail.com, 2014-2015
+--------------------------------------------------------------------------
+History:
+
+- 16.10.2026   23:46 : Created by agent
+-------------------------------------------------------------------------
+Write ahead log of accounts. Every change is one fixed size record with
+whole account, it is appended to log file. Writer thread takes all
+records appended while previous write was on disk and writes them by
+one write and one flush (group commit).
+Log is compacted by snapshot : current log is closed as old log, new
+records go to empty log, old log is removed when snapshot has its
+records. On start snapshot is loaded and both logs are replayed.
+*************************************************************************/
+
+#ifndef _AccountLog_
+#define _AccountLog_
+
+#include <condition_variable>
+
+#define WAL_STRING_SIZE 64
+
+#pragma pack(push, 1)
+struct SWalRecord
+{
+	unsigned int lsn;                      // Record number, grows in all logs
+	unsigned int checksum;                 // PacketChecksum of record with zero checksum
+	int id;
+	int level;
+	int money;
+	int xp;
+	int ban;
+	char login[WAL_STRING_SIZE];
+	char password[WAL_STRING_SIZE];
+	char nickname[WAL_STRING_SIZE];
+};
+#pragma pack(pop)
+
+class CAccountLog
+{
+public:
+	CAccountLog();
+	~CAccountLog();
+
+	// Gives records of old and current log and opens current log for append
+	bool Open(const char* fileName, std::vector <SWalRecord>& records);
+	// Gives records of old and current log, files are not changed
+	static void Read(const char* fileName, std::vector <SWalRecord>& records);
+
+	// Under lock of account changes, so log keeps their order. Returns record number
+	unsigned int Append(SWalRecord& record);
+	// Without locks. Returns when record is on disk, false at once if log failed or is not opened
+	bool Wait(unsigned int lsn);
+
+	// Writes appended records without lock of account changes, so rotate has little to write
+	bool Flush();
+	// Under lock of account changes. Writes appended records and new records go to empty log.
+	// If old log of unfinished snapshot is not removed, current log is kept and next snapshot
+	// has records of both. False if records are not written, snapshot must not be saved then
+	bool Rotate();
+	// Snapshot has records of old log
+	void RemoveOld();
+
+	// Bytes in current log
+	unsigned int GetSize() { return size; }
+
+private:
+	void WriterThread();
+	// Writes queued records to current log, write lock must be taken
+	bool WriteQueue();
+
+	// Appends valid records of log file, returns their bytes
+	static unsigned int ReadLog(const std::string& name, std::vector <SWalRecord>& records);
+
+	std::string fileName;
+	std::string oldFileName;
+	HANDLE hFile;
+	std::atomic<unsigned int> size;
+
+	// Appended records not written yet
+	std::vector <SWalRecord> queue;
+	unsigned int nextLsn;
+	unsigned int durableLsn;
+	bool bFailed;
+	std::mutex mutex;
+	std::condition_variable durable;
+
+	// Writer thread or rotate own file
+	std::mutex writeMutex;
+	HANDLE hWriteEvent;
+};
+
+#endif
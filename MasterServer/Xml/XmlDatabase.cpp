@@ -16,125 +16,234 @@ History:
 #include "tinyxml.h"
 #include <io.h>
 
+CXmlDatabase::CXmlDatabase(void)
+{
+	lastPlayerId = 10000000;
+	playersCount = 0;
+	snapshotSize = 0;
+	hSnapshotEvent = NULL;
+}
+
+CXmlDatabase::~CXmlDatabase(void)
+{
+	for(auto it = accounts.begin(); it != accounts.end(); ++it)
+		delete it->second;
+
+	if(hSnapshotEvent)
+		CloseHandle(hSnapshotEvent);
+}
+
 void CXmlDatabase::Init()
 {
 	Log(LOG_DEBUG,"CXmlDatabase::Init()");
 
 	if(!FileExists("Database.xml"))
-	{
 		CreateXmlFile("Database.xml");
-		CreateChild("GlobalVariables");
-		SetInt("GlobalVariables","playerIDs",10000000);
-		SetInt("GlobalVariables","players_count",0);
-	}
+
+	if(!LoadFile("Database.xml"))
+		return;
+
+	int snapshotAccounts = (int)accounts.size();
+
+	std::vector <SWalRecord> records;
+	log.Open("Database.wal", records);
+
+	for(auto it = records.begin(); it != records.end(); ++it)
+		ReplayRecord(*it);
+
+	Log(LOG_INFO,"Loaded %d accounts from Database.xml and %d changes from Database.wal", snapshotAccounts, (int)records.size());
+
+	snapshotSize = atoi(gEnv->pSettings->GetConfigValue("Server","wal_snapshot_size")) * 1024;
+	hSnapshotEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+
+	std::thread snapshotThread(&CXmlDatabase::SnapshotThread, this);
+	snapshotThread.detach();
+
+	// Replayed changes go to snapshot at once, so next start replays only new ones
+	if(!records.empty())
+		SetEvent(hSnapshotEvent);
+}
+
+bool CXmlDatabase::Load()
+{
+	Log(LOG_DEBUG,"CXmlDatabase::Load()");
+
+	if(!LoadFile("Database.xml"))
+		return false;
+
+	std::vector <SWalRecord> records;
+	CAccountLog::Read("Database.wal", records);
+
+	for(auto it = records.begin(); it != records.end(); ++it)
+		ReplayRecord(*it);
+
+	return true;
 }
 
 const char* CXmlDatabase::Register(std::string login, std::string password, std::string nickName)
 {
 	Log(LOG_DEBUG,"CXmlDatabase::Register()");
 
-	MD5 md5;
-	char childName[256];
+	// Log record has fixed size strings
+	if(login.size() >= WAL_STRING_SIZE || password.size() >= WAL_STRING_SIZE || nickName.size() >= WAL_STRING_SIZE)
+	{
+		Log(LOG_WARNING,"CXmlDatabase::Register user <%s> failed! Login, password or nickname is too long!", login.c_str());
+		return "RegFailed";
+	}
 
-	sprintf(childName,"Player_%s",md5.digestString((char*)login.c_str()));
+	SXmlAccount* pAccount;
+	unsigned int lsn;
+
+	// Lock
+	mutex.lock();
+
+	bool bLoginUsed = accounts.find(login) != accounts.end();
+	bool bNicknameUsed = accountsByNickname.find(nickName) != accountsByNickname.end();
+
+	int id = lastPlayerId + 1;
 
-	if(!CreateChild(childName))
+	// Accounts of other workers waiting for log write
+	for(size_t i = 0; i < pending.size(); i++)
 	{
+		bLoginUsed = bLoginUsed || pending[i]->login == login;
+		bNicknameUsed = bNicknameUsed || pending[i]->nickname == nickName;
+
+		if(pending[i]->id >= id)
+			id = pending[i]->id + 1;
+	}
+
+	// Id can be taken if file was edited by hand
+	while(accountsById.find(id) != accountsById.end())
+		id++;
+
+	if(bLoginUsed)
+	{
+		mutex.unlock();
 		Log(LOG_WARNING,"CXmlDatabase::Register user <%s> failed! This login alredy registered!", login.c_str());
 		return "LoginAlReg";
 	}
 
-	if(ChildExist(childName))
+	if(bNicknameUsed)
 	{
-		//
-		int id = GetInt("GlobalVariables","playerIDs");
-		int players_count = GetInt("GlobalVariables","players_count");
+		mutex.unlock();
+		Log(LOG_WARNING,"CXmlDatabase::Register user <%s> failed! Nickname <%s> alredy used!", login.c_str(), nickName.c_str());
+		return "RegFailed";
+	}
 
-		id++; players_count++;
+	MD5 md5;
+	char childName[256];
+
+	sprintf(childName,"Player_%s",md5.digestString((char*)login.c_str()));
 
-		SetInt("GlobalVariables","playerIDs",id);
-		SetInt("GlobalVariables","players_count",players_count);
-		//
+	pAccount = new SXmlAccount;
+	pAccount->element = childName;
+	pAccount->login = login;
+	pAccount->password = password;
+	pAccount->nickname = nickName;
+	pAccount->id = id;
+	pAccount->level = 0;
+	pAccount->money = 0;
+	pAccount->xp = 0;
+	pAccount->ban = false;
 
-		SetInt(childName,"id",id);
-		SetString(childName,"login",login);
-		SetString(childName,"password",password);
-		SetString(childName,"nickname",nickName);
-		SetInt(childName,"level",0);
-		SetInt(childName,"game_money",0);
-		SetInt(childName,"xp",0);
-		SetBool(childName,"ban",false);
+	pending.push_back(pAccount);
 
-		Log(LOG_DEBUG,"CXmlDatabase::Register user <%s> success!", login.c_str());
+	SWalRecord record;
+	FillRecord(record, *pAccount);
+	lsn = log.Append(record);
 
-		gEnv->rClients++;
+	mutex.unlock();
+	// Unlock
 
-		return "RegSuccess";
-	}	
+	// Record is written together with records appended by other workers meanwhile
+	bool bWritten = log.Wait(lsn);
 
-	Log(LOG_ERROR,"CXmlDatabase::Register user <%s> failed!", login.c_str());
-	return "RegFailed";
+	// Lock
+	mutex.lock();
+
+	RemovePending(pAccount);
+
+	if(bWritten)
+	{
+		AddAccount(pAccount);
+
+		if(pAccount->id > lastPlayerId)
+			lastPlayerId = pAccount->id;
+		playersCount++;
+	}
+
+	mutex.unlock();
+	// Unlock
+
+	if(!bWritten)
+	{
+		Log(LOG_ERROR,"CXmlDatabase::Register user <%s> failed! Account log is not written!", login.c_str());
+
+		delete pAccount;
+		return "RegFailed";
+	}
+
+	if(snapshotSize > 0 && log.GetSize() >= snapshotSize && hSnapshotEvent)
+		SetEvent(hSnapshotEvent);
+
+	Log(LOG_DEBUG,"CXmlDatabase::Register user <%s> success!", login.c_str());
+
+	gEnv->rClients++;
+
+	return "RegSuccess";
 }
 
 const char* CXmlDatabase::Login(std::string login, std::string password)
 {
 	Log(LOG_DEBUG,"CXmlDatabase::Login()");
 
-	MD5 md5;
-	char childName[256];
+	std::lock_guard<std::mutex> lock(mutex);
 
-	sprintf(childName,"Player_%s",md5.digestString((char*)login.c_str()));
+	auto it = accounts.find(login);
+	if(it == accounts.end())
+	{
+		Log(LOG_WARNING,"CXmlDatabase::Login user <%s> failed! Login not found!",login.c_str());
+		return "LoginNotFound";
+	}
 
-	if(ChildExist(childName))
+	SXmlAccount* pAccount = it->second;
+
+	if(pAccount->password != password)
 	{
-		if(!strcmp(password.c_str(),GetString(childName,"password").c_str()))
-		{
-			if(GetBool(childName,"ban"))
-			{
-				Log(LOG_WARNING,"CXmlDatabase::Login user <%s> failed! Account banned!",login.c_str());
-				return "AccountBlocked";
-			}
-			else
-			{
-				Log(LOG_DEBUG,"CXmlDatabase::Login user <%s> success!",login.c_str());
-				gEnv->aClients++;
-				return "PasswordCorrect";
-			}
-		}
-		else
-		{
-			Log(LOG_WARNING,"CXmlDatabase::Login user <%s> failed! Incorrect password!",login.c_str());	
-			return "PasswordIncorrect";
-		}
+		Log(LOG_WARNING,"CXmlDatabase::Login user <%s> failed! Incorrect password!",login.c_str());
+		return "PasswordIncorrect";
 	}
-	else 
+
+	if(pAccount->ban)
 	{
-		Log(LOG_WARNING,"CXmlDatabase::Login user <%s> failed! Login not found!",login.c_str());
-		return "LoginNotFound";
+		Log(LOG_WARNING,"CXmlDatabase::Login user <%s> failed! Account banned!",login.c_str());
+		return "AccountBlocked";
 	}
 
-	Log(LOG_ERROR,"CXmlDatabase::Login user <%s> failed!",login.c_str());
-	return "LoginFailed";
+	Log(LOG_DEBUG,"CXmlDatabase::Login user <%s> success!",login.c_str());
+	gEnv->aClients++;
+	return "PasswordCorrect";
 }
 
 SClient CXmlDatabase::GetUserInfo(std::string login)
 {
 	Log(LOG_DEBUG,"CXmlDatabase::GetUserInfo()");
 
-	SClient player;
-	MD5 md5;
-	char childName[256];
+	std::lock_guard<std::mutex> lock(mutex);
 
-	sprintf(childName,"Player_%s",md5.digestString((char*)login.c_str()));
+	SClient player;
 
-	if(ChildExist(childName))
+	auto it = accounts.find(login);
+	if(it != accounts.end())
 	{
-		player.playerId = GetInt(childName,"id");
-		player.nickname = (char*)GetString(childName,"nickname").c_str();
-		player.xp = GetInt(childName,"xp");
-		player.level = GetInt(childName,"level");
-		player.money = GetInt(childName,"game_money");		
-		player.banStatus = GetBool(childName,"ban");	
+		SXmlAccount* pAccount = it->second;
+
+		player.playerId = pAccount->id;
+		player.nickname = pAccount->nickname;
+		player.xp = pAccount->xp;
+		player.level = pAccount->level;
+		player.money = pAccount->money;
+		player.banStatus = pAccount->ban;
 
 		return player;
 	}
@@ -144,222 +253,249 @@ SClient CXmlDatabase::GetUserInfo(std::string login)
 	return player;
 }
 
-// Setters
+void CXmlDatabase::GetAccounts(std::vector <SXmlAccount>& copy)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	copy.reserve(accounts.size());
+	for(auto it = accounts.begin(); it != accounts.end(); ++it)
+		copy.push_back(*it->second);
+}
 
-void CXmlDatabase::SetInt(const char* childName, const char* valueName , int value)
+void CXmlDatabase::ReplayRecord(const SWalRecord& record)
 {
-	Log(LOG_DEBUG,"CXmlDatabase::SetInt()");
-	TiXmlDocument xmlFile("Database.xml");
-	TiXmlElement* child;
-	TiXmlElement* root;
-	
-	if (xmlFile.LoadFile())
+	SXmlAccount* pAccount;
+
+	auto it = accounts.find(record.login);
+	if(it != accounts.end())
 	{
-		root = xmlFile.FirstChildElement("Database");
-		if (!root)
-			Log(LOG_WARNING, "CXmlDatabase::No root element!");
+		pAccount = it->second;
 
-		child = root->FirstChildElement(childName);
+		// Secondary indexes are built again from new values
+		accountsById.erase(pAccount->id);
+		accountsByNickname.erase(pAccount->nickname);
+	}
+	else
+	{
+		MD5 md5;
+		char childName[256];
 
-		if(!child)
-		{
-			Log(LOG_WARNING,"CXmlDatabase::Child <%s> not found!",childName);
-			return;
-		}
+		sprintf(childName,"Player_%s",md5.digestString((char*)record.login));
 
-		child->SetAttribute(valueName,value);
+		pAccount = new SXmlAccount;
+		pAccount->element = childName;
+		pAccount->login = record.login;
 
-		xmlFile.SaveFile();
+		playersCount++;
 	}
+
+	pAccount->password = record.password;
+	pAccount->nickname = record.nickname;
+	pAccount->id = record.id;
+	pAccount->level = record.level;
+	pAccount->money = record.money;
+	pAccount->xp = record.xp;
+	pAccount->ban = !!record.ban;
+
+	AddAccount(pAccount);
+
+	if(record.id > lastPlayerId)
+		lastPlayerId = record.id;
 }
 
-void CXmlDatabase::SetString(const char* childName, const char* valueName , std::string value)
+void CXmlDatabase::FillRecord(SWalRecord& record, const SXmlAccount& account)
 {
-	Log(LOG_DEBUG,"CXmlDatabase::SetString()");
-	TiXmlDocument xmlFile("Database.xml");
-	TiXmlElement* child;
-	TiXmlElement* root;
-	
-	if (xmlFile.LoadFile())
-	{
-		root = xmlFile.FirstChildElement("Database");
-		if (!root)
-			Log(LOG_WARNING, "CXmlDatabase::No root element!");
-
-		child = root->FirstChildElement(childName);
+	memset(&record, 0, sizeof(SWalRecord));
 
-		if(!child)
-		{
-			Log(LOG_WARNING,"CXmlDatabase::Child <%s> not found!",childName);
-			return;
-		}
+	record.id = account.id;
+	record.level = account.level;
+	record.money = account.money;
+	record.xp = account.xp;
+	record.ban = account.ban;
 
-		child->SetAttribute(valueName,value.c_str());
+	strncpy(record.login, account.login.c_str(), WAL_STRING_SIZE - 1);
+	strncpy(record.password, account.password.c_str(), WAL_STRING_SIZE - 1);
+	strncpy(record.nickname, account.nickname.c_str(), WAL_STRING_SIZE - 1);
+}
 
-		xmlFile.SaveFile();
+void CXmlDatabase::SnapshotThread()
+{
+	while(true)
+	{
+		WaitForSingleObject(hSnapshotEvent, INFINITE);
+		WriteSnapshot();
 	}
 }
 
-void CXmlDatabase::SetBool(const char* childName, const char* valueName , bool value)
+bool CXmlDatabase::WriteSnapshot()
 {
-	Log(LOG_DEBUG,"CXmlDatabase::SetBool()");
-	TiXmlDocument xmlFile("Database.xml");
-	TiXmlElement* child;
-	TiXmlElement* root;
-	
-	if (xmlFile.LoadFile())
+	Log(LOG_DEBUG,"CXmlDatabase::WriteSnapshot()");
+
+	std::vector <SXmlAccount> copy;
+	int ids;
+	int count;
+
+	// Logins wait for lock below, so records appended so far are written before it
+	if(!log.Flush())
 	{
-		root = xmlFile.FirstChildElement("Database");
-		if (!root)
-			Log(LOG_WARNING, "CXmlDatabase::No root element!");
+		Log(LOG_ERROR, "CXmlDatabase::Account log is not written, snapshot is not saved!");
+		return false;
+	}
 
-		child = root->FirstChildElement(childName);
+	// Lock. Accounts are copied and log is rotated at same point,
+	// so snapshot has every record of old log. Records of waiting accounts
+	// are written by rotate, so they are saved too
+	mutex.lock();
+	copy.reserve(accounts.size() + pending.size());
+	for(auto it = accounts.begin(); it != accounts.end(); ++it)
+		copy.push_back(*it->second);
 
-		if(!child)
-		{
-			Log(LOG_WARNING,"CXmlDatabase::Child <%s> not found!",childName);
-			return;
-		}
+	ids = lastPlayerId;
+	count = playersCount;
 
-		child->SetAttribute(valueName,value);
+	for(size_t i = 0; i < pending.size(); i++)
+	{
+		copy.push_back(*pending[i]);
 
-		xmlFile.SaveFile();
+		if(pending[i]->id > ids)
+			ids = pending[i]->id;
+		count++;
 	}
-}
 
-// Getters
+	bool bRotated = log.Rotate();
+	mutex.unlock();
+	// Unlock
 
-int CXmlDatabase::GetInt(const char* childName, const char* valueName)
-{
-	Log(LOG_DEBUG,"CXmlDatabase::GetInt()");
-	TiXmlDocument xmlFile("Database.xml");
-	TiXmlElement* child;
-	TiXmlElement* root;
-	int result = 0;
-	
-	if (xmlFile.LoadFile())
+	if(!bRotated)
 	{
-		root = xmlFile.FirstChildElement("Database");
-		if (!root)
-			Log(LOG_WARNING, "CXmlDatabase::No root element!");
+		Log(LOG_ERROR, "CXmlDatabase::Account log is not written, snapshot is not saved!");
+		return false;
+	}
 
-		child = root->FirstChildElement(childName);
+	TiXmlDocument xmlFile;
+	TiXmlElement* root = (TiXmlElement*)xmlFile.LinkEndChild(new TiXmlElement("Database"));
 
-		if(!child)
-		{
-			Log(LOG_WARNING,"CXmlDatabase::Child <%s> not found!",childName);
-			return 0;
-		}
+	TiXmlElement* globals = (TiXmlElement*)root->LinkEndChild(new TiXmlElement("GlobalVariables"));
+	globals->SetAttribute("playerIDs",ids);
+	globals->SetAttribute("players_count",count);
 
-		
-		child->QueryIntAttribute(valueName, &result);
-		return result;
+	for(auto it = copy.begin(); it != copy.end(); ++it)
+	{
+		TiXmlElement* child = (TiXmlElement*)root->LinkEndChild(new TiXmlElement(it->element.c_str()));
+
+		child->SetAttribute("id",it->id);
+		child->SetAttribute("login",it->login.c_str());
+		child->SetAttribute("password",it->password.c_str());
+		child->SetAttribute("nickname",it->nickname.c_str());
+		child->SetAttribute("level",it->level);
+		child->SetAttribute("game_money",it->money);
+		child->SetAttribute("xp",it->xp);
+		child->SetAttribute("ban",it->ban);
 	}
 
-	return 0;
-}
-
-std::string CXmlDatabase::GetString(const char* childName, const  char* valueName)
-{
-	Log(LOG_DEBUG,"CXmlDatabase::GetString()");
-	TiXmlDocument xmlFile("Database.xml");
-	TiXmlElement* child;
-	TiXmlElement* root;
-	
-	if (xmlFile.LoadFile())
+	if(!xmlFile.SaveFile("Database.xml.tmp"))
 	{
-		root = xmlFile.FirstChildElement("Database");
-		if (!root)
-			Log(LOG_WARNING, "CXmlDatabase::No root element!");
-
-		child = root->FirstChildElement(childName);
+		Log(LOG_ERROR, "CXmlDatabase::Error saving xml!!!");
+		return false;
+	}
 
-		if(!child)
-			Log(LOG_WARNING,"CXmlDatabase::Child <%s> not found",childName);
+	// Snapshot must be on disk before old log is removed
+	HANDLE hSnapshot = CreateFile("Database.xml.tmp", GENERIC_WRITE, 0, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if(hSnapshot != INVALID_HANDLE_VALUE)
+	{
+		FlushFileBuffers(hSnapshot);
+		CloseHandle(hSnapshot);
+	}
 
-		return child->Attribute(valueName);	
+	if(!MoveFileEx("Database.xml.tmp", "Database.xml", MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH))
+	{
+		Log(LOG_ERROR, "CXmlDatabase::Error saving xml!!!");
+		return false;
 	}
-	else
-		Log(LOG_WARNING,"CXmlDatabase::Failed load xml");
 
-	return NULL;
-}
+	log.RemoveOld();
 
-bool CXmlDatabase::GetBool(const char* childName, const  char* valueName)
-{
-	Log(LOG_DEBUG,"CXmlDatabase::GetBool()");
-	return !!GetInt(childName,valueName);
+	Log(LOG_DEBUG,"CXmlDatabase::Snapshot of %d accounts saved", (int)copy.size());
+	return true;
 }
 
 // Tools
-void CXmlDatabase::CreateXmlFile(const char *xmlName)
+bool CXmlDatabase::LoadFile(const char* xmlName)
 {
-	Log(LOG_DEBUG,"CXmlDatabase::CreateXmlFile()");
+	Log(LOG_DEBUG,"CXmlDatabase::LoadFile()");
 
 	TiXmlDocument xmlFile(xmlName);
 
-	const char* startNode = "<Database/"">\n";
-	xmlFile.Parse(startNode);
-	xmlFile.SaveFile();
-}
+	if(!xmlFile.LoadFile())
+	{
+		Log(LOG_ERROR, "CXmlDatabase::Error loading xml!!!");
+		return false;
+	}
 
-bool CXmlDatabase::CreateChild(const char* childName)
-{
-	Log(LOG_DEBUG,"CXmlDatabase::CreateChild()");
-	TiXmlDocument xmlFile("Database.xml");
-	TiXmlElement child(childName);
-	TiXmlElement* root;
+	TiXmlElement* root = xmlFile.FirstChildElement("Database");
+	if(!root)
+	{
+		Log(LOG_ERROR, "CXmlDatabase::No root element!");
+		return false;
+	}
 
-	if (xmlFile.LoadFile())
+	for(TiXmlElement* child = root->FirstChildElement(); child; child = child->NextSiblingElement())
 	{
-		root = xmlFile.FirstChildElement("Database");
-		if (!root)
+		if(!strcmp(child->Value(),"GlobalVariables"))
 		{
-			Log(LOG_DEBUG, "CXmlDatabase::No root element!");
-			return false;
+			child->QueryIntAttribute("playerIDs", &lastPlayerId);
+			child->QueryIntAttribute("players_count", &playersCount);
+			continue;
 		}
 
-		TiXmlElement *oldChild = root->FirstChildElement(childName);
+		if(strncmp(child->Value(),"Player_",7))
+			continue;
+
+		const char* login = child->Attribute("login");
+		const char* password = child->Attribute("password");
+		const char* nickname = child->Attribute("nickname");
 
-		if(oldChild)
+		if(login == NULL || password == NULL || nickname == NULL || accounts.find(login) != accounts.end())
 		{
-			Log(LOG_DEBUG,"CXmlDatabase::Child <%s> alredy created!",childName);
-			return false;
+			Log(LOG_WARNING,"CXmlDatabase::Child <%s> is damaged or duplicated, skipped",child->Value());
+			continue;
 		}
 
-		root->InsertEndChild(child);
-
-
-		xmlFile.SaveFile();
-		return true;
-	}
-	else
-	{
-		Log(LOG_ERROR, "CXmlDatabase::Error loading xml!!!");
-		return false;
+		SXmlAccount* pAccount = new SXmlAccount;
+		pAccount->element = child->Value();
+		pAccount->login = login;
+		pAccount->password = password;
+		pAccount->nickname = nickname;
+		pAccount->id = 0;
+		pAccount->level = 0;
+		pAccount->money = 0;
+		pAccount->xp = 0;
+
+		int ban = 0;
+		child->QueryIntAttribute("id", &pAccount->id);
+		child->QueryIntAttribute("level", &pAccount->level);
+		child->QueryIntAttribute("game_money", &pAccount->money);
+		child->QueryIntAttribute("xp", &pAccount->xp);
+		child->QueryIntAttribute("ban", &ban);
+		pAccount->ban = !!ban;
+
+		AddAccount(pAccount);
 	}
 
-	return false;
+	return true;
 }
 
-void CXmlDatabase::RemoveChild(const char* childName)
+void CXmlDatabase::CreateXmlFile(const char *xmlName)
 {
-	Log(LOG_DEBUG,"CXmlDatabase::RemoveChild()");
-	TiXmlDocument xmlFile("Database.xml");
-	TiXmlElement* root;
-
-	if (xmlFile.LoadFile())
-	{
-		root = xmlFile.FirstChildElement("Database");
-		if (!root)
-			Log(LOG_DEBUG, "CXmlDatabase::No root element!");
+	Log(LOG_DEBUG,"CXmlDatabase::CreateXmlFile()");
 
-		root->RemoveChild(root->FirstChildElement(childName));
+	TiXmlDocument xmlFile(xmlName);
 
-		xmlFile.SaveFile();
-	}
-	else
-		Log(LOG_ERROR, "CXmlDatabase::Error loading xml!!!");
+	const char* startNode = "<Database>\n"
+		                    "<GlobalVariables playerIDs=\"10000000\" players_count=\"0\" />\n"
+		                    "</Database>\n";
+	xmlFile.Parse(startNode);
+	xmlFile.SaveFile();
 }
 
 bool CXmlDatabase::FileExists(const char *fname)
@@ -367,28 +503,21 @@ bool CXmlDatabase::FileExists(const char *fname)
 	return _access(fname, 0) != -1;
 }
 
-bool CXmlDatabase::ChildExist(const char* childName)
+void CXmlDatabase::AddAccount(SXmlAccount* pAccount)
 {
-	Log(LOG_DEBUG,"CXmlDatabase::ChildExist()");
-	TiXmlDocument xmlFile("Database.xml");
-	TiXmlElement* root;
-
-	if (xmlFile.LoadFile())
-	{
-		root = xmlFile.FirstChildElement("Database");
-		if (!root)
-			Log(LOG_WARNING, "CXmlDatabase::No root element!");
-
-		TiXmlElement *Child = root->FirstChildElement(childName);
+	accounts[pAccount->login] = pAccount;
+	accountsById[pAccount->id] = pAccount;
+	accountsByNickname[pAccount->nickname] = pAccount;
+}
 
-		if(Child)
-			return true;
-	}	
-	else
+void CXmlDatabase::RemovePending(SXmlAccount* pAccount)
+{
+	for(auto it = pending.begin(); it != pending.end(); ++it)
 	{
-		Log(LOG_ERROR, "CXmlDatabase::Error loading xml!!!");
-		return false;
+		if(*it == pAccount)
+		{
+			pending.erase(it);
+			return;
+		}
 	}
-
-	return false;
 }
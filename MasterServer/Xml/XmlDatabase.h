@@ -6,19 +6,38 @@ History:
 - 03.03.2015   16:19 : Created by AfroStalin(chernecoff)
 - 30.04.2015   22:56 : Edited by AfroStalin(chernecoff)
 -------------------------------------------------------------------------
-
+Accounts are kept in memory and found by login, player id or nickname
+without touching files. Every change is appended to account log
+(Database.wal) and is saved when its group of records is flushed.
+Database.xml is snapshot : when log is bigger than wal_snapshot_size kb,
+snapshot thread writes all accounts to it and old log is removed.
 *************************************************************************/
 
 #ifndef __XmlDatabase_H__
 #define __XmlDatabase_H__
 
-class TiXmlElement;
+#include <unordered_map>
+#include "AccountLog.h"
+
+// Player element of Database.xml
+struct SXmlAccount
+{
+	std::string element;     // Player_<md5 of login>
+	std::string login;
+	std::string password;
+	std::string nickname;
+	int id;
+	int level;
+	int money;
+	int xp;
+	bool ban;
+};
 
-class CXmlDatabase
+class CXmlDatabase : public IAccountStore
 {
 public:
-	CXmlDatabase(void){}
-	~CXmlDatabase(void){}
+	CXmlDatabase(void);
+	~CXmlDatabase(void);
 
 	void Init();
 
@@ -26,25 +45,45 @@ public:
 	const char* Login(std::string login, std::string password);
 	SClient GetUserInfo(std::string login);
 
+	// Accounts of Database.xml and its log for import. Log is not opened and
+	// snapshot thread is not started, false if Database.xml is not loaded
+	bool Load();
+	// Copies of all accounts
+	void GetAccounts(std::vector <SXmlAccount>& copy);
+
 private:
-	/*Getters*/
-	int GetInt(const char* childName, const char* valueName);
-	std::string GetString(const char* childName, const  char* valueName);
-	bool GetBool(const char* childName, const  char* valueName);
-
-	/*Setters*/
-	void SetInt(const char* childName, const char* valueName , int value);
-	void SetString(const char* childName, const char* valueName , std::string value);
-	void SetBool(const char* childName, const char* valueName , bool value);
-	//
-
-	bool CreateChild(const char* childName);
-	void RemoveChild(const char* childName);
+	bool LoadFile(const char* xmlName);
 	void CreateXmlFile(const char* xmlName);
-	bool ChildExist(const char* childName);
 	bool FileExists(const char* fname);
 
-	//TiXmlElement* root;
+	void AddAccount(SXmlAccount* pAccount);
+	void RemovePending(SXmlAccount* pAccount);
+
+	// Log records are whole accounts, replay puts them over snapshot
+	void ReplayRecord(const SWalRecord& record);
+	void FillRecord(SWalRecord& record, const SXmlAccount& account);
+
+	void SnapshotThread();
+	bool WriteSnapshot();
+
+	// Accounts by login, player id and nickname
+	std::unordered_map <std::string, SXmlAccount*> accounts;
+	std::unordered_map <int, SXmlAccount*> accountsById;
+	std::unordered_map <std::string, SXmlAccount*> accountsByNickname;
+	// New accounts waiting for log write. Their login, nickname and id are taken,
+	// but login and counters see them only after record is on disk
+	std::vector <SXmlAccount*> pending;
+
+	// GlobalVariables
+	int lastPlayerId;
+	int playersCount;
+
+	CAccountLog log;
+	unsigned int snapshotSize;
+	HANDLE hSnapshotEvent;
+
+	// Read workers use database in parallel
+	std::mutex mutex;
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -91,8 +91,7 @@ SLoginPacket CReadSendPacket::ReadLoginPacket (SPacket packet)
 	std::string version        = p->readString();             // Packet version
 	/*********************************************************************************/
 
-	loginPacket.login    = p->readString();               
-	loginPacket.password = p->readString();    
+	SchemaRead<SLoginSchema>(p, loginPacket);
 
 
 	std::string endBlock     = p->readString();       
@@ -130,9 +129,7 @@ SLoginPacket CReadSendPacket::ReadRegistrationPacket (SPacket packet)
 	std::string version        = p->readString();             // Packet version
 	/*********************************************************************************/
 
-	registerPacket.login    = p->readString();             
-	registerPacket.password = p->readString();                
-	registerPacket.nickname = p->readString();                
+	SchemaRead<SRegistrationSchema>(p, registerPacket);
 
 	std::string endBlock     = p->readString();                //  
 
@@ -171,8 +168,7 @@ SMessage CReadSendPacket::ReadMsg(SPacket packet)
 	std::string version        = p->readString();             // Packet version
 	/*********************************************************************************/
 
-	message.message    = p->readString();              
-	message.area       = (EChatMessageArea)p->readInt();                      
+	SchemaRead<SMessageSchema>(p, message);
 
 	std::string endBlock = p->readString();
 
@@ -212,9 +208,7 @@ SRequestPacket CReadSendPacket::ReadRequest(SPacket packet)
 	/*********************************************************************************/
 
 
-	request.request = p->readString();
-	request.sParam = p->readString();
-	request.iParam = p->readInt();
+	SchemaRead<SRequestSchema>(p, request);
 
 
 	std::string endBlock = p->readString(); 
@@ -248,19 +242,12 @@ SGameServer CReadSendPacket::ReadGameServerInfo(SPacket packet)
 	p->decodeBlowfish(gClientEnv->bBlowFish);
 
 /**************************** ************************************/
-	p->readString();                                        //  
-	p->readInt();                                           //  
-	p->readString();                                        //    
+	EPacketType type = (EPacketType)p->readInt();             // Packet type
+	std::string version        = p->readString();             // Packet version
 
 /******************************* ****************************************/
 
-	Server.ip              = p->readString();               // ip           
-	Server.port            = p->readInt();                  //  
-	Server.serverName      = p->readString();               //  
-	Server.currentPlayers  = p->readInt();                  //   
-	Server.maxPlayers      = p->readInt();                  //  - 
-	Server.mapName         = p->readString();               //  
-	Server.gameRules       = p->readString();               //  
+	SchemaRead<SGameServerSchema>(p, Server);
 
 	std::string endBlock = p->readString();                 //  
 
@@ -36,50 +36,8 @@ enum EPacketType
 	PACKET_GAME_SERVER,
 };
 
-// Chat message area. Global, private, system, etc. messages
-enum EChatMessageArea
-{
-	CHAT_MESSAGE_GLOBAL = 0,
-	CHAT_MESSAGE_PRIVATE,
-	CHAT_MESSAGE_SYSTEM,
-};
-
-
-// Chat message structure. Using for sending chat messages to client/master server
-struct SMessage
-{
-	const char* message;
-	EChatMessageArea area; // Global, private, system, etc.
-};
-
-// Request packet structure. Using for sending request to client/master server.
-struct SRequestPacket
-{
-	const char* request;
-	const char* sParam;
-	int iParam;
-};
-
-// Login packet structure. Using in login and register client!
-struct SLoginPacket
-{
-	const char* login;
-	const char* password;
-	const char* nickname;
-};
-
-// Game server structur. Using for sending game server info to client/master server.
-struct SGameServer
-{
-	SOCKET socket;
-	const char* ip;
-	int port;
-	const char* serverName;
-	int currentPlayers;
-	int maxPlayers;
-	std::string mapName;
-	std::string gameRules;
-};
+// Shared packet structures and schemas
+#include "..\..\..\Common\PacketSchema.h"
 
 // Player structure
 struct SPlayer
@@ -92,13 +50,6 @@ struct SPlayer
 	int banStatus;
 };
 
-// Master server info structure
-struct SMasterServerInfo
-{
-	int playersOnline;
-	int gameServersOnline;
-};
-
 // Packet structurs
 struct SPacket
 {
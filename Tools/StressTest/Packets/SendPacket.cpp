@@ -75,8 +75,8 @@ void CReadSendPacket::SendMsg(SOCKET Socket, SMessage message)
 
 	/******************************* ****************************************/
 
-	p->writeString(message.message);
-	p->writeInt(message.area);                            
+	CSchemaPacketOut <Packet> out(p);
+	SchemaWrite<SMessageSchema>(out, message);
 
 	p->writeString(EndBlock);                                    //   
 
@@ -180,8 +180,8 @@ void CReadSendPacket::SendMasterServerInfo (SOCKET Socket, SMasterServerInfo inf
 
 	/******************************* ****************************************/
 
-	p->writeInt(info.playersOnline);
-	p->writeInt(info.gameServersOnline);
+	CSchemaPacketOut <Packet> out(p);
+	SchemaWrite<SMasterServerInfoSchema>(out, info);
 
 	p->writeString(EndBlock);                                    //  
 
@@ -230,13 +230,8 @@ void CReadSendPacket::SendGameServerInfo (SOCKET Socket, SGameServer server)
 
 	/******************************* ****************************************/
                                     
-	p->writeString(server.ip);                                
-	p->writeInt(server.port);                               
-	p->writeString(server.serverName);                       
-	p->writeInt(server.currentPlayers);                   
-	p->writeInt(server.maxPlayers);                     
-	p->writeString(server.mapName.c_str());                          
-	p->writeString(server.gameRules.c_str());                     
+	CSchemaPacketOut <Packet> out(p);
+	SchemaWrite<SGameServerSchema>(out, server);
 
 	p->writeString(EndBlock);                                    //  
 
@@ -291,9 +286,8 @@ void CReadSendPacket::SendRequest(SOCKET Socket, SRequestPacket request)
 
 	/******************************* ****************************************/
 
-	p->writeString(request.request);
-	p->writeString(request.sParam);
-	p->writeInt(request.iParam);
+	CSchemaPacketOut <Packet> out(p);
+	SchemaWrite<SRequestSchema>(out, request);
 
 	p->writeString(EndBlock);                                    //   
 
@@ -340,8 +334,8 @@ void CReadSendPacket::SendLoginPacket(SOCKET Socket, SLoginPacket packet)
 
 	/******************************* ****************************************/
 
-	p->writeString(packet.login);
-	p->writeString(packet.password);
+	CSchemaPacketOut <Packet> out(p);
+	SchemaWrite<SLoginSchema>(out, packet);
 
 	p->writeString(EndBlock);                                    //  
 
@@ -386,9 +380,8 @@ void CReadSendPacket::SendRegisterPacket(SOCKET Socket, SLoginPacket packet)
 
 	/******************************* ****************************************/
 
-	p->writeString(packet.login);
-	p->writeString(packet.password);
-	p->writeString(packet.nickname);
+	CSchemaPacketOut <Packet> out(p);
+	SchemaWrite<SRegistrationSchema>(out, packet);
 
 	p->writeString(EndBlock);                                    //  
 